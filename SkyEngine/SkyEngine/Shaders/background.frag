@@ -2,6 +2,10 @@
 #extension GL_ARB_separate_shader_objects : enable
 
 layout(set = 0, binding = 0) uniform sampler2D texColor;
+#if defined(HISTORY_R11G11B10_A8)
+// packed cloud history keeps alpha in its own plane, see compute-clouds.comp
+layout(set = 0, binding = 1) uniform sampler2D texAlpha;
+#endif
 layout(set = 1, binding = 0) uniform sampler2D blurMask;
 
 layout(location = 0) in vec3 fragColor;
@@ -11,6 +15,9 @@ layout(location = 0) out vec4 outColor;
 
 void main() {
     vec4 col = texture(texColor, fragUV);
+#if defined(HISTORY_R11G11B10_A8)
+    col.a = texture(texAlpha, fragUV).r;
+#endif
 
     outColor = col;
 }
\ No newline at end of file
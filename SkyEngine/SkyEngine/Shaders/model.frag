@@ -31,6 +31,7 @@ layout(binding = 3) uniform UniformSkyObject {
     vec4 betaV;
     vec4 wind;
     float mie_directional;
+    float weather_map; // which of cloudPlacement is current
 } sky;
 
 
@@ -38,7 +39,7 @@ layout(binding = 3) uniform UniformSkyObject {
 layout(binding = 4) uniform sampler2D texColor;
 layout(binding = 5) uniform sampler2D pbrInfo; 
 layout(binding = 6) uniform sampler2D normalMap;
-layout(binding = 7) uniform sampler2D cloudPlacement;
+layout(binding = 7) uniform sampler2D cloudPlacement[2]; // both weather maps, see weather-map.comp
 layout(binding = 8) uniform sampler3D lowResCloudShape;
 
 layout(location = 0) in vec3 fragColor;
@@ -64,6 +65,11 @@ struct Intersection {
 #define NUM_SHADOW_STEPS 6
 #define WIND_STRENGTH 20.0
 
+// r: coverage, g: precipitation, b: cloud type
+vec3 sampleWeather(vec2 uv) {
+    return sky.weather_map < 0.5 ? texture(cloudPlacement[0], uv).xyz : texture(cloudPlacement[1], uv).xyz;
+}
+
 float remap(in float value, in float oldMin, in float oldMax, in float newMin, in float newMax) {
     return newMin + (((value - oldMin) / (oldMax - oldMin)) * (newMax - newMin));
 }
@@ -121,10 +127,11 @@ float cloudTest(in vec3 pos, in float relativeHeight, in vec3 earthCenter, inout
     float density;
 
     vec3 currentProj = getProjectedShellPoint(pos, earthCenter);
-    vec3 cloudInfo = texture(cloudPlacement, 0.00001 * (currentProj.xz - camera.cameraPosition.xz)).xyz;
+    vec3 cloudInfo = sampleWeather(0.00001 * (currentProj.xz - camera.cameraPosition.xz));
     float layerDensity = cloudLayerDensity(relativeHeight, cloudInfo.z);
 
-    vec4 densityNoise = texture(lowResCloudShape, 0.000057 * vec3(pos));
+    // explicit level, derivatives are undefined inside the shadow march and the volume has mips now
+    vec4 densityNoise = textureLod(lowResCloudShape, 0.000057 * vec3(pos), 0.0);
 
     density = layerDensity * remapClamped(densityNoise.x, 0.3, 1.0, 0.0, 1.0);
 
@@ -11,16 +11,30 @@ layout(binding = 0) uniform UniformCameraObject {
     vec4 cameraPosition;
 } camera;
 
+#if defined(INSTANCED)
+// MeshRegistry, every indirect draw of it has its instance as firstInstance
+struct MeshInstance {
+    mat4 model;
+    mat4 invTranspose;
+    vec4 sphere;
+    uvec4 draw;
+};
+
+layout(std430, binding = 9) readonly buffer MeshInstances {
+    MeshInstance instances[];
+};
+#else
 layout(binding = 1) uniform UniformModelObject {
     mat4 model;
     mat4 invTranspose;
 } model;
+#endif
 
 
+// PackedVertex, the model matrix includes the decode of the snorm positions
 layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inUV;
-layout(location = 3) in vec3 inNormal;
+layout(location = 3) in vec2 inNormal; // octahedral
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragUV;
@@ -30,15 +44,25 @@ layout(location = 4) out vec3 fragTangent;
 layout(location = 5) out vec3 fragBitangent;
 layout(location = 6) out vec3 fragPositionWC;
 
+vec3 octahedralDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
 void main() {
+#if defined(INSTANCED)
+    MeshInstance model = instances[gl_InstanceIndex];
+#endif
     gl_Position = camera.proj * camera.view * model.model * vec4(inPosition, 1.0);
     fragUV = inUV;
-	fragColor = inColor;
+	fragColor = vec3(1.0);
 
     fragPosition = (camera.view * model.model * vec4(inPosition, 1.0)).xyz;
     fragPositionWC = (model.model * vec4(inPosition, 1.0)).xyz;
     
-    fragNormal = normalize((camera.view * vec4(normalize((model.invTranspose * vec4(inNormal, 0.0)).xyz), 0.0)).xyz);
+    fragNormal = normalize((camera.view * vec4(normalize((model.invTranspose * vec4(octahedralDecode(inNormal), 0.0)).xyz), 0.0)).xyz);
     vec3 up = normalize((camera.view * vec4(0.001, 1, -0.004, 0.0)).xyz);
     fragTangent = normalize(cross(fragNormal, up));
     fragBitangent = cross(fragNormal, fragTangent);
@@ -0,0 +1,84 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Fused radial blur + combine + tonemap. Replaces the radialBlur.frag and tonemap.frag passes
+// when ENABLE_FUSED_POST is on, reading the HDR scene exactly once.
+
+layout(binding = 0) uniform sampler2D texColor;
+layout(binding = 3) uniform sampler2D texShafts; // half res, written by light-shafts.comp
+
+layout(location = 0) in vec2 fragUV;
+
+layout(location = 0) out vec4 outColor;
+
+layout(binding = 1) uniform UniformCameraObject {
+    mat4 view;
+    mat4 proj;
+    vec3 cameraPosition;
+    vec3 cameraParams;
+} camera;
+
+// all of these components are calculated in SkyManager.h/.cpp
+layout(set = 0, binding = 2) uniform UniformSunObject {
+    vec4 location;
+    vec4 direction;
+    vec4 color;
+    mat4 directionBasis;
+    float intensity;
+} sun;
+
+#define NUM_SAMPLES 10
+
+// Uncharted 2 Tonemapping made by John Hable, filmicworlds.com
+vec3 uc2Tonemap(vec3 x)
+{
+   return ((x*(0.15*x+0.1*0.5)+0.2*0.02)/(x*(0.15*x+0.5)+0.2*0.3))-0.02/0.3;
+}
+
+vec3 tonemap(vec3 x, float exposure, float invGamma, float whiteBalance) {
+    vec3 white = vec3(whiteBalance);
+    vec3 color = uc2Tonemap(exposure * x);
+    vec3 whitemap = 1.0 / uc2Tonemap(white);
+    color *= whitemap;
+    return pow(color, vec3(invGamma));
+}
+
+// Radial blur of the shaft term, same kernel as radialBlur.frag
+vec3 blurShafts(vec2 scrPt) {
+    const float samples[NUM_SAMPLES] = { -0.08, -0.05, -0.03, -0.02, -0.01, 0.01, 0.02, 0.03, 0.05, 0.08 };
+
+    vec4 sunPos = camera.proj * camera.view * sun.location;
+    sunPos /= sunPos.w;
+
+    vec2 lightVec = sunPos.xy - scrPt;
+    float dist = length(lightVec);
+    lightVec /= dist;
+    float accumSampleAmt = 0.0;
+
+    // shaft texture sampler repeats, clamp by hand
+    for(int i = 0; i < NUM_SAMPLES; ++i) {
+        vec2 uv = clamp((scrPt + samples[i] * lightVec * 1.5 * dist) * 0.5 + 0.5, 0.0, 1.0);
+        accumSampleAmt += texture(texShafts, uv).r * 1.1;
+    }
+    accumSampleAmt /= float(NUM_SAMPLES);
+
+    return sun.color.xyz * sun.intensity * accumSampleAmt;
+}
+
+void main() {
+    vec4 scene = texture(texColor, fragUV);
+    vec3 col = scene.xyz;
+
+    // Negative alpha marks scene geometry, which the separate passes drew after the blur
+    if(sun.direction.y >= 0.0 && scene.a >= 0.0) {
+        col = blurShafts(fragUV * 2.0 - 1.0) + 0.5 * scene.xyz;
+    }
+
+    float whitepoint = 50.2;
+    col = tonemap(col, 0.7, 1.0 / 2.2, whitepoint);
+
+    float vignette = dot(fragUV - 0.5, fragUV - 0.5);
+
+    col = mix(col, vec3(0.1, 0.05, 0.13), vignette);
+    outColor = vec4(col, 1.0);
+}
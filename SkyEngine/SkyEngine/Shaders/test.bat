@@ -1,3 +1,28 @@
 glslc.exe -fshader-stage=comp compute-clouds.comp -o compute-clouds.comp.spv -g
+glslc.exe -fshader-stage=comp -DHISTORY_RGBA16F compute-clouds.comp -o compute-clouds.comp.rgba16f.spv -g
+glslc.exe -fshader-stage=comp -DHISTORY_R11G11B10_A8 compute-clouds.comp -o compute-clouds.comp.r11g11b10a8.spv -g
+glslc.exe -fshader-stage=comp -DCLIPMAP_UPDATE compute-clouds.comp -o compute-clouds.comp.clipmap.spv -g
+glslc.exe -fshader-stage=comp -DFAR_FIELD compute-clouds.comp -o compute-clouds.comp.farfield.spv -g
+glslc.exe -fshader-stage=comp reproject.comp -o reproject.comp.spv -g
+glslc.exe -fshader-stage=comp -DHISTORY_RGBA16F reproject.comp -o reproject.comp.rgba16f.spv -g
+glslc.exe -fshader-stage=comp -DHISTORY_R11G11B10_A8 reproject.comp -o reproject.comp.r11g11b10a8.spv -g
+glslc.exe -fshader-stage=comp weather-map.comp -o weather-map.comp.spv -g
+glslc.exe -fshader-stage=comp noise-volume.comp -o noise-volume.comp.spv -g
+glslc.exe -fshader-stage=comp cull-instances.comp -o cull-instances.comp.spv -g
+glslc.exe -fshader-stage=comp light-shafts.comp -o light-shafts.comp.spv -g
+
+glslc.exe -fshader-stage=vert model.vert -o model.vert.spv -g
+glslc.exe -fshader-stage=vert -DINSTANCED model.vert -o model.vert.instanced.spv -g
+glslc.exe -fshader-stage=frag model.frag -o model.frag.spv -g
+glslc.exe -fshader-stage=vert background.vert -o background.vert.spv -g
+glslc.exe -fshader-stage=frag background.frag -o background.frag.spv -g
+glslc.exe -fshader-stage=frag -DHISTORY_RGBA16F background.frag -o background.frag.rgba16f.spv -g
+glslc.exe -fshader-stage=frag -DHISTORY_R11G11B10_A8 background.frag -o background.frag.r11g11b10a8.spv -g
+
+glslc.exe -fshader-stage=vert post-pass.vert -o post-pass.vert.spv -g
+glslc.exe -fshader-stage=frag post-composite.frag -o post-composite.frag.spv -g
+glslc.exe -fshader-stage=frag god-ray.frag -o god-ray.frag.spv -g
+glslc.exe -fshader-stage=frag radialBlur.frag -o radialBlur.frag.spv -g
+glslc.exe -fshader-stage=frag tonemap.frag -o tonemap.frag.spv -g
 
 pause
\ No newline at end of file
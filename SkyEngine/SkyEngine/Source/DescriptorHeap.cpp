@@ -0,0 +1,134 @@
+#include "DescriptorHeap.h"
+#include <array>
+
+DescriptorHeap::DescriptorHeap(VkDevice device) : device(device) {
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings = {};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[0].descriptorCount = DESCRIPTOR_HEAP_TEXTURES;
+    bindings[0].stageFlags = VK_SHADER_STAGE_ALL;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[1].descriptorCount = DESCRIPTOR_HEAP_VOLUMES;
+    bindings[1].stageFlags = VK_SHADER_STAGE_ALL;
+
+    // empty slots are never read, and written slots may change after the set is bound
+    std::array<VkDescriptorBindingFlagsEXT, 2> bindingFlags = {};
+    for (VkDescriptorBindingFlagsEXT& flags : bindingFlags) {
+        flags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT;
+    }
+    VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo = {};
+    bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+    bindingFlagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+    bindingFlagsInfo.pBindingFlags = bindingFlags.data();
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = &bindingFlagsInfo;
+    layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &layout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor heap layout!");
+    }
+
+    VkDescriptorPoolSize poolSize = {};
+    poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSize.descriptorCount = DESCRIPTOR_HEAP_TEXTURES + DESCRIPTOR_HEAP_VOLUMES;
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = 1;
+
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor heap pool!");
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = pool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &layout;
+
+    if (vkAllocateDescriptorSets(device, &allocInfo, &set) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate descriptor heap!");
+    }
+
+    // lowest handles first
+    for (uint32_t h = DESCRIPTOR_HEAP_TEXTURES; h > 0; h--) {
+        freeTextures.push_back(h - 1);
+    }
+    for (uint32_t h = DESCRIPTOR_HEAP_VOLUMES; h > 0; h--) {
+        freeVolumes.push_back(h - 1);
+    }
+}
+
+DescriptorHeap::~DescriptorHeap() {
+    vkDestroyDescriptorPool(device, pool, nullptr);
+    vkDestroyDescriptorSetLayout(device, layout, nullptr);
+}
+
+uint32_t DescriptorHeap::allocate(std::vector<uint32_t>& freeSlots) {
+    if (freeSlots.empty()) {
+        throw std::runtime_error("failed to add to descriptor heap, it is full!");
+    }
+    const uint32_t handle = freeSlots.back();
+    freeSlots.pop_back();
+    return handle;
+}
+
+void DescriptorHeap::write(uint32_t binding, uint32_t handle, VkImageView view, VkSampler sampler, VkImageLayout imageLayout) {
+    VkDescriptorImageInfo imageInfo = {};
+    imageInfo.imageLayout = imageLayout;
+    imageInfo.imageView = view;
+    imageInfo.sampler = sampler;
+
+    VkWriteDescriptorSet descriptorWrite = {};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = set;
+    descriptorWrite.dstBinding = binding;
+    descriptorWrite.dstArrayElement = handle;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pImageInfo = &imageInfo;
+
+    vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+}
+
+uint32_t DescriptorHeap::add(Texture* texture, VkImageLayout imageLayout) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const uint32_t handle = allocate(freeTextures);
+    write(0, handle, texture->textureImageView, texture->textureSampler, imageLayout);
+    return handle;
+}
+
+uint32_t DescriptorHeap::add(Texture3D* volume, VkImageLayout imageLayout) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const uint32_t handle = allocate(freeVolumes);
+    write(1, handle, volume->textureImageView, volume->textureSampler, imageLayout);
+    return handle;
+}
+
+void DescriptorHeap::update(uint32_t handle, Texture* texture, VkImageLayout imageLayout) {
+    std::lock_guard<std::mutex> lock(mutex);
+    write(0, handle, texture->textureImageView, texture->textureSampler, imageLayout);
+}
+
+void DescriptorHeap::update(uint32_t handle, Texture3D* volume, VkImageLayout imageLayout) {
+    std::lock_guard<std::mutex> lock(mutex);
+    write(1, handle, volume->textureImageView, volume->textureSampler, imageLayout);
+}
+
+void DescriptorHeap::removeTexture(uint32_t handle) {
+    std::lock_guard<std::mutex> lock(mutex);
+    freeTextures.push_back(handle);
+}
+
+void DescriptorHeap::removeVolume(uint32_t handle) {
+    std::lock_guard<std::mutex> lock(mutex);
+    freeVolumes.push_back(handle);
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "Texture.h"
+#include <mutex>
+#include <vector>
+
+// compute-clouds.comp mirrors these
+#define DESCRIPTOR_HEAP_TEXTURES 256
+#define DESCRIPTOR_HEAP_VOLUMES 64
+
+// One descriptor set for the sampled images of the engine (descriptor indexing): binding 0 holds the 2D textures,
+// binding 1 the volumes. Shaders index the arrays with the handles add hands out, passed in push constants, so adding
+// a texture touches no layout or pool. Only the slots in use are written, and update rewrites one in place while
+// command buffers that bind the set are recorded, as long as none of them is executing.
+class DescriptorHeap
+{
+private:
+    VkDevice device;
+    VkDescriptorSetLayout layout;
+    VkDescriptorPool pool;
+    VkDescriptorSet set;
+
+    std::mutex mutex; // shaders register their textures on the startup workers
+    std::vector<uint32_t> freeTextures;
+    std::vector<uint32_t> freeVolumes;
+
+    uint32_t allocate(std::vector<uint32_t>& freeSlots);
+    void write(uint32_t binding, uint32_t handle, VkImageView view, VkSampler sampler, VkImageLayout imageLayout);
+
+public:
+    explicit DescriptorHeap(VkDevice device);
+    ~DescriptorHeap();
+
+    // imageLayout: the layout shaders sample the image in, GENERAL for images compute shaders also write
+    uint32_t add(Texture* texture, VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    uint32_t add(Texture3D* volume, VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    void update(uint32_t handle, Texture* texture, VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    void update(uint32_t handle, Texture3D* volume, VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    // The slot may be handed out again, no shader may read it anymore
+    void removeTexture(uint32_t handle);
+    void removeVolume(uint32_t handle);
+
+    VkDescriptorSetLayout getLayout() const { return layout; }
+    VkDescriptorSet getSet() const { return set; }
+};
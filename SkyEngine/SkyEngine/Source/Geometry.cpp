@@ -1,24 +1,31 @@
 #include "Geometry.h"
+#include "MeshOptimizer.h"
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
+#include <glm/gtc/packing.hpp>
+#include <fstream>
+#include <cstring>
+#include <cmath>
+
+#define MESH_CACHE_VERSION 2 // bump when PackedVertex or the processing in packMesh changes, old caches are then rebuilt
+#define VERTEX_CACHE_SIZE 16 // FIFO entries the ACMR and ATVR reported by packMesh assume
+#define OVERDRAW_THRESHOLD 1.05f // ACMR the overdraw clusters may give up, relative to the cache optimised order
 
 void Geometry::cleanup() {
     vkDestroyBuffer(device, vertexBuffer, nullptr);
-    vkFreeMemory(device, vertexDeviceMemory, nullptr);
+    FreeTrackedMemory(device, vertexDeviceMemory, nullptr);
     vkDestroyBuffer(device, indexBuffer, nullptr);
-    vkFreeMemory(device, indexDeviceMemory, nullptr);
+    FreeTrackedMemory(device, indexDeviceMemory, nullptr);
 }
 
-void Geometry::createVertexBuffer() {
-    VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
-
+void Geometry::createVertexBuffer(const void* vertexData, VkDeviceSize bufferSize) {
     VkBuffer stagingBuffer;
     VkDeviceMemory stagingBufferMemory;
     createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
 
     void* data;
     vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, vertices.data(), (size_t)bufferSize);
+    memcpy(data, vertexData, (size_t)bufferSize);
     vkUnmapMemory(device, stagingBufferMemory);
 
     createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexDeviceMemory);
@@ -26,7 +33,7 @@ void Geometry::createVertexBuffer() {
     copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
 
     vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+    FreeTrackedMemory(device, stagingBufferMemory, nullptr);
 }
 
 void Geometry::createIndexBuffer() {
@@ -47,7 +54,7 @@ void Geometry::createIndexBuffer() {
     copyBuffer(stagingBuffer, indexBuffer, bufferSize);
 
     vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+    FreeTrackedMemory(device, stagingBufferMemory, nullptr);
 }
 
 /* Calls commands to ready the buffers for drawing.
@@ -82,7 +89,7 @@ void Geometry::setupAsQuad() {
         4, 5, 6, 6, 7, 4
     };
 
-    createVertexBuffer();
+    createVertexBuffer(vertices.data(), sizeof(vertices[0]) * vertices.size());
     createIndexBuffer();
 
     initialized = true;
@@ -102,7 +109,7 @@ void Geometry::setupAsBackgroundQuad() {
         0, 1, 2, 2, 3, 0
     };
 
-    createVertexBuffer();
+    createVertexBuffer(vertices.data(), sizeof(vertices[0]) * vertices.size());
     createIndexBuffer();
 
     initialized = true;
@@ -139,9 +146,67 @@ void Geometry::initializeTBN() {
     */
 }
 
-void Geometry::setupFromMesh(std::string path) {
-    if (initialized) cleanup();
+// FNV-1a, like the noise cache keys
+static uint64_t hashFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("failed to open mesh!");
+    }
+    std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    uint64_t hash = 14695981039346656037ull;
+    for (char byte : bytes) {
+        hash = (hash ^ static_cast<unsigned char>(byte)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static int16_t toSnorm16(float value) {
+    return static_cast<int16_t>(std::round(glm::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+// z folded onto the xy plane, decoded by octahedralDecode in model.vert
+static glm::vec2 octahedralEncode(glm::vec3 n) {
+    n /= std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (n.z < 0.0f) {
+        return glm::vec2((1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f), (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+    }
+    return glm::vec2(n.x, n.y);
+}
+
+PackedVertex PackedVertex::pack(const glm::vec3& position, const glm::vec3& normal, const glm::vec2& uv) {
+    PackedVertex vertex = {};
+    vertex.pos[0] = toSnorm16(position.x);
+    vertex.pos[1] = toSnorm16(position.y);
+    vertex.pos[2] = toSnorm16(position.z);
 
+    const glm::vec2 octahedral = octahedralEncode(normal);
+    vertex.nor[0] = toSnorm16(octahedral.x);
+    vertex.nor[1] = toSnorm16(octahedral.y);
+
+    vertex.uv[0] = glm::packHalf1x16(uv.x);
+    vertex.uv[1] = glm::packHalf1x16(uv.y);
+    return vertex;
+}
+
+// vertices are deduplicated on all of their 16 bytes
+struct PackedVertexHash {
+    size_t operator()(const PackedVertex& vertex) const {
+        uint64_t halves[2];
+        std::memcpy(halves, &vertex, sizeof(halves));
+        return std::hash<uint64_t>()(halves[0] ^ (halves[1] * 0x9e3779b97f4a7c15ull));
+    }
+};
+
+struct PackedVertexEqual {
+    bool operator()(const PackedVertex& a, const PackedVertex& b) const {
+        return std::memcmp(&a, &b, sizeof(PackedVertex)) == 0;
+    }
+};
+
+// Parses the obj, quantizes its vertices and merges the ones that come out the same. The triangles are then reordered
+// for the post-transform cache and overdraw, and the vertices for fetch.
+static void packMesh(const std::string& path, PackedMeshHeader& header, std::vector<PackedVertex>& vertices, std::vector<uint32_t>& indices) {
     tinyobj::attrib_t attrib;
     std::vector<tinyobj::shape_t> shapes;
     std::vector<tinyobj::material_t> materials;
@@ -150,48 +215,148 @@ void Geometry::setupFromMesh(std::string path) {
     if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &err, path.c_str())) {
         throw std::runtime_error(err);
     }
+    if (attrib.vertices.empty()) {
+        throw std::runtime_error("mesh has no vertices!");
+    }
+
+    glm::vec3 lo(attrib.vertices[0], attrib.vertices[1], attrib.vertices[2]);
+    glm::vec3 hi = lo;
+    for (size_t i = 0; i < attrib.vertices.size(); i += 3) {
+        const glm::vec3 pos(attrib.vertices[i], attrib.vertices[i + 1], attrib.vertices[i + 2]);
+        lo = glm::min(lo, pos);
+        hi = glm::max(hi, pos);
+    }
+    const glm::vec3 centre = 0.5f * (lo + hi);
+    // a flat axis still needs a scale the decode can invert
+    const glm::vec3 extent = glm::max(0.5f * (hi - lo), glm::vec3(1e-6f));
 
-    std::unordered_map<Vertex, uint32_t> uniqueVertices = {};
+    std::unordered_map<PackedVertex, uint32_t, PackedVertexHash, PackedVertexEqual> uniqueVertices = {};
+    vertices.clear();
+    indices.clear();
 
     for (const auto& shape : shapes) {
 
         for (const auto& index : shape.mesh.indices) {
-            Vertex vertex = {};
-            
-            vertex.pos = {
+            const glm::vec3 pos = (glm::vec3(
                 attrib.vertices[3 * index.vertex_index + 0],
                 attrib.vertices[3 * index.vertex_index + 1],
-                attrib.vertices[3 * index.vertex_index + 2]
-            };
+                attrib.vertices[3 * index.vertex_index + 2]) - centre) / extent;
 
-            vertex.uv = {
-                attrib.texcoords[2 * index.texcoord_index + 0],
-                1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-            };
-
-            vertex.col = { 1.0f, 1.0f, 1.0f };
+            glm::vec2 uv(0.0f);
+            if (index.texcoord_index >= 0) {
+                uv = glm::vec2(
+                    attrib.texcoords[2 * index.texcoord_index + 0],
+                    1.0f - attrib.texcoords[2 * index.texcoord_index + 1]);
+            }
 
-            vertex.nor = {
-                attrib.normals[3 * index.normal_index + 0],
-                attrib.normals[3 * index.normal_index + 1],
-                attrib.normals[3 * index.normal_index + 2]
-            };
+            glm::vec3 nor(0.0f, 1.0f, 0.0f);
+            if (index.normal_index >= 0) {
+                nor = glm::vec3(
+                    attrib.normals[3 * index.normal_index + 0],
+                    attrib.normals[3 * index.normal_index + 1],
+                    attrib.normals[3 * index.normal_index + 2]);
+            }
 
-            //vertex.tan = { 0.f, 0.f, 0.f }; // going to handle in shader for now
-            //vertex.bit = { 0.f, 0.f, 0.f };
+            const PackedVertex vertex = PackedVertex::pack(pos, nor, uv);
 
-            if (uniqueVertices.count(vertex) == 0) {
-                uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
+            auto found = uniqueVertices.find(vertex);
+            if (found == uniqueVertices.end()) {
+                found = uniqueVertices.emplace(vertex, static_cast<uint32_t>(vertices.size())).first;
                 vertices.push_back(vertex);
             }
 
-            indices.push_back(uniqueVertices[vertex]);
+            indices.push_back(found->second);
         }
     }
 
-    createVertexBuffer();
+    const uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+    const VertexCacheStats before = AnalyzeVertexCache(indices, vertexCount, VERTEX_CACHE_SIZE);
+    OptimizeVertexCache(indices, vertexCount);
+
+    // what the snorm positions decode to, the clusters are sorted on them
+    std::vector<glm::vec3> positions(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; v++) {
+        positions[v] = centre + extent * glm::vec3(vertices[v].pos[0], vertices[v].pos[1], vertices[v].pos[2]) / 32767.0f;
+    }
+    OptimizeOverdraw(indices, positions, VERTEX_CACHE_SIZE, OVERDRAW_THRESHOLD);
+
+    const std::vector<uint32_t> fetchOrder = OptimizeVertexFetch(indices, vertexCount);
+    std::vector<PackedVertex> fetchOrdered(fetchOrder.size());
+    for (size_t v = 0; v < fetchOrder.size(); v++) {
+        fetchOrdered[v] = vertices[fetchOrder[v]];
+    }
+    vertices.swap(fetchOrdered);
+
+    const VertexCacheStats after = AnalyzeVertexCache(indices, static_cast<uint32_t>(vertices.size()), VERTEX_CACHE_SIZE);
+    std::cout << path << ": " << vertices.size() << " vertices, " << indices.size() / 3 << " triangles, ACMR "
+        << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+
+    std::memcpy(header.magic, "SKM1", 4);
+    header.version = MESH_CACHE_VERSION;
+    header.vertexCount = static_cast<uint32_t>(vertices.size());
+    header.indexCount = static_cast<uint32_t>(indices.size());
+    for (int axis = 0; axis < 3; axis++) {
+        header.boundsCentre[axis] = centre[axis];
+        header.boundsExtent[axis] = extent[axis];
+    }
+}
+
+static void writePackedMesh(const std::string& path, const PackedMeshHeader& header, const std::vector<PackedVertex>& vertices, const std::vector<uint32_t>& indices) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("failed to write packed mesh!");
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(vertices.data()), sizeof(PackedVertex) * vertices.size());
+    file.write(reinterpret_cast<const char*>(indices.data()), sizeof(uint32_t) * indices.size());
+}
+
+// False when there is no cache, or it was written by another version or from another obj
+static bool loadPackedMesh(const std::string& path, uint64_t sourceHash, PackedMeshHeader& header, std::vector<PackedVertex>& vertices, std::vector<uint32_t>& indices) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file || !file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        return false;
+    }
+    if (std::memcmp(header.magic, "SKM1", 4) != 0 || header.version != MESH_CACHE_VERSION || header.sourceHash != sourceHash) {
+        return false;
+    }
+
+    vertices.resize(header.vertexCount);
+    indices.resize(header.indexCount);
+    return file.read(reinterpret_cast<char*>(vertices.data()), sizeof(PackedVertex) * vertices.size())
+        && file.read(reinterpret_cast<char*>(indices.data()), sizeof(uint32_t) * indices.size());
+}
+
+void LoadMesh(const std::string& path, PackedMeshHeader& header, std::vector<PackedVertex>& vertices, std::vector<uint32_t>& indices) {
+    const uint64_t sourceHash = hashFile(path);
+    const std::string cachePath = path + ".mesh";
+    if (!loadPackedMesh(cachePath, sourceHash, header, vertices, indices)) {
+        packMesh(path, header, vertices, indices);
+        header.sourceHash = sourceHash;
+        writePackedMesh(cachePath, header, vertices, indices);
+    }
+}
+
+void Geometry::decodeMesh(std::string path) {
+    PackedMeshHeader header;
+    LoadMesh(path, header, packedVertices, indices);
+
+    const glm::vec3 centre(header.boundsCentre[0], header.boundsCentre[1], header.boundsCentre[2]);
+    const glm::vec3 extent(header.boundsExtent[0], header.boundsExtent[1], header.boundsExtent[2]);
+    positionDecode = glm::scale(glm::translate(glm::mat4(1.0f), centre), extent);
+    decodedPath = path;
+}
+
+void Geometry::setupFromMesh(std::string path) {
+    if (initialized) cleanup();
+
+    if (decodedPath != path) {
+        decodeMesh(path);
+    }
+    decodedPath.clear();
+
+    createVertexBuffer(packedVertices.data(), sizeof(PackedVertex) * packedVertices.size());
     createIndexBuffer();
-    initializeTBN();
 
     initialized = true;
-}
\ No newline at end of file
+}
@@ -59,6 +59,59 @@ namespace std {
     };
 }
 
+// 16 byte vertex of the meshes from setupFromMesh, what model.vert reads. Positions are snorm16 over the bounds of the
+// mesh (Geometry::getPositionDecode maps them back), normals octahedral snorm16, uvs half floats. No colour, the
+// meshes only ever had white.
+struct PackedVertex {
+    int16_t pos[4]; // w unused
+    int16_t nor[2];
+    uint16_t uv[2];
+
+    // position relative to the bounds, in [-1, 1]
+    static PackedVertex pack(const glm::vec3& position, const glm::vec3& normal, const glm::vec2& uv);
+
+    static VkVertexInputBindingDescription getBindingDescription() {
+        VkVertexInputBindingDescription bindingDescription = {};
+        bindingDescription.binding = 0;
+        bindingDescription.stride = sizeof(PackedVertex);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+        return bindingDescription;
+    }
+
+    // same locations as Vertex, less the colour
+    static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions() {
+        std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions = {};
+        attributeDescriptions[0].binding = 0;
+        attributeDescriptions[0].location = 0;
+        attributeDescriptions[0].format = VK_FORMAT_R16G16B16A16_SNORM;
+        attributeDescriptions[0].offset = offsetof(PackedVertex, pos);
+
+        attributeDescriptions[1].binding = 0;
+        attributeDescriptions[1].location = 2;
+        attributeDescriptions[1].format = VK_FORMAT_R16G16_SFLOAT;
+        attributeDescriptions[1].offset = offsetof(PackedVertex, uv);
+
+        attributeDescriptions[2].binding = 0;
+        attributeDescriptions[2].location = 3;
+        attributeDescriptions[2].format = VK_FORMAT_R16G16_SNORM;
+        attributeDescriptions[2].offset = offsetof(PackedVertex, nor);
+
+        return attributeDescriptions;
+    }
+};
+
+// <obj>.mesh, what setupFromMesh loads instead of the obj once it has parsed it
+struct PackedMeshHeader {
+    char magic[4];        // "SKM1"
+    uint32_t version;     // MESH_CACHE_VERSION of the build that wrote it
+    uint64_t sourceHash;  // FNV-1a of the obj, a cache whose obj has changed is rebuilt
+    uint32_t vertexCount, indexCount;
+    float boundsCentre[3], boundsExtent[3]; // half extent, what the snorm positions are relative to
+};
+
+// Reads <path>.mesh, or parses the obj and writes it when it is missing or older than the obj
+void LoadMesh(const std::string& path, PackedMeshHeader& header, std::vector<PackedVertex>& vertices, std::vector<uint32_t>& indices);
+
 
 class Geometry : VulkanObject
 {
@@ -66,7 +119,10 @@ private:
     virtual void cleanup();
 
     std::vector<Vertex> vertices;
+    std::vector<PackedVertex> packedVertices;
     std::vector<uint32_t> indices;
+    glm::mat4 positionDecode = glm::mat4(1.0f);
+    std::string decodedPath; // of decodeMesh, until setupFromMesh uploads it
 
     VkBuffer vertexBuffer;
     VkDeviceMemory vertexDeviceMemory;
@@ -74,7 +130,7 @@ private:
     VkBuffer indexBuffer;
     VkDeviceMemory indexDeviceMemory;
 
-    void createVertexBuffer();
+    void createVertexBuffer(const void* vertexData, VkDeviceSize bufferSize);
     void createIndexBuffer();
 
     bool initialized = false;
@@ -88,7 +144,11 @@ public:
     // not terribly neat, but better than subclasses for now...
     void setupAsQuad();
     void setupAsBackgroundQuad();
+    // Through LoadMesh. Draw with PackedVertex attributes and getPositionDecode folded into the model matrix.
     void setupFromMesh(std::string path);
+    // The CPU half of setupFromMesh, fine on a worker thread. setupFromMesh with the same path then only uploads.
+    void decodeMesh(std::string path);
+    const glm::mat4& getPositionDecode() const { return positionDecode; }
 
     void enqueueDrawCommands(VkCommandBuffer& commandBuffer);
 };
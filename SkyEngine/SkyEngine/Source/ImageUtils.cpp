@@ -1,8 +1,16 @@
 #include "ImageUtils.h"
+#include "JobSystem.h"
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
+#include <stb_image.h>
 #include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+#include <functional>
+#include <cfloat>
+#include <cmath>
 
 #define CURL_DIM 128
 #define EPS 0.0005
@@ -220,4 +228,302 @@ void GenerateCurlNoise(std::string path) {
     stbi_write_tga(path.c_str(), CURL_DIM, CURL_DIM, 4, pixels);
     delete pixels;
     delete curls;
+}
+
+uint32_t FormatChannelCount(VkFormat format) {
+    switch (format) {
+    case VK_FORMAT_R8_UNORM:
+        return 1;
+    case VK_FORMAT_R8G8_UNORM:
+        return 2;
+    default:
+        return 4;
+    }
+}
+
+const char* FormatName(VkFormat format) {
+    switch (format) {
+    case VK_FORMAT_R8_UNORM: return "R8_UNORM";
+    case VK_FORMAT_R8G8_UNORM: return "R8G8_UNORM";
+    case VK_FORMAT_R8G8B8A8_UNORM: return "R8G8B8A8_UNORM";
+    case VK_FORMAT_R8G8B8A8_UINT: return "R8G8B8A8_UINT";
+    case VK_FORMAT_B8G8R8A8_UNORM: return "B8G8R8A8_UNORM";
+    case VK_FORMAT_R16G16_SFLOAT: return "R16G16_SFLOAT";
+    case VK_FORMAT_R16G16_SNORM: return "R16G16_SNORM";
+    case VK_FORMAT_R16G16B16A16_SFLOAT: return "R16G16B16A16_SFLOAT";
+    case VK_FORMAT_R16G16B16A16_SNORM: return "R16G16B16A16_SNORM";
+    case VK_FORMAT_R32_SFLOAT: return "R32_SFLOAT";
+    case VK_FORMAT_R32G32_SFLOAT: return "R32G32_SFLOAT";
+    case VK_FORMAT_R32G32B32_SFLOAT: return "R32G32B32_SFLOAT";
+    case VK_FORMAT_R32G32B32A32_SFLOAT: return "R32G32B32A32_SFLOAT";
+    case VK_FORMAT_B10G11R11_UFLOAT_PACK32: return "B10G11R11_UFLOAT_PACK32";
+    case VK_FORMAT_D32_SFLOAT: return "D32_SFLOAT";
+    case VK_FORMAT_D32_SFLOAT_S8_UINT: return "D32_SFLOAT_S8_UINT";
+    case VK_FORMAT_D24_UNORM_S8_UINT: return "D24_UNORM_S8_UINT";
+    default: return "other";
+    }
+}
+
+std::string PackedVolumePath(const std::string& path, uint32_t channels) {
+    const char* suffix = channels == 1 ? ".r8.vol" : (channels == 2 ? ".rg8.vol" : ".rgba8.vol");
+    return path + suffix;
+}
+
+void ParallelFor(JobSystem& jobs, uint32_t count, const std::function<void(uint32_t, uint32_t)>& body) {
+    // smaller than an even split, so the threads that finish early steal what is left of the others
+    const uint32_t ranges = jobs.getThreadCount() * 4;
+    jobs.wait(jobs.parallelFor(count, (count + ranges - 1) / ranges, body));
+}
+
+void WritePackedVolume(const std::string& path, const PackedVolumeHeader& header, const std::vector<unsigned char>& texels) {
+    std::ofstream file(PackedVolumePath(path, header.channels), std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("failed to write packed volume!");
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(texels.data()), texels.size());
+}
+
+void PackVolume(const std::string& path, uint32_t depth, uint32_t channels, PackedVolumeHeader& header, std::vector<unsigned char>& texels) {
+    std::memcpy(header.magic, "SKV1", 4);
+    header.depth = depth;
+    header.channels = channels;
+    texels.clear();
+
+    for (uint32_t i = 0; i < depth; ++i) {
+        int width, height, fileChannels;
+        stbi_uc* pixels = stbi_load((path + "(" + std::to_string(i) + ").tga").c_str(), &width, &height, &fileChannels, STBI_rgb_alpha);
+        if (!pixels) {
+            throw std::runtime_error("failed to load volume slice!");
+        }
+        if (i == 0) {
+            header.width = width;
+            header.height = height;
+            texels.reserve(static_cast<size_t>(width) * height * depth * channels);
+        }
+        else if (header.width != static_cast<uint32_t>(width) || header.height != static_cast<uint32_t>(height)) {
+            stbi_image_free(pixels);
+            throw std::runtime_error("volume slices differ in size!");
+        }
+
+        for (size_t p = 0; p < static_cast<size_t>(width) * height; p++) {
+            texels.insert(texels.end(), pixels + 4 * p, pixels + 4 * p + channels);
+        }
+        stbi_image_free(pixels);
+    }
+
+    WritePackedVolume(path, header, texels);
+}
+
+bool LoadPackedVolume(const std::string& path, uint32_t channels, PackedVolumeHeader& header, std::vector<unsigned char>& texels) {
+    std::ifstream file(PackedVolumePath(path, channels), std::ios::binary);
+    if (!file || !file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        return false;
+    }
+    if (std::memcmp(header.magic, "SKV1", 4) != 0 || header.channels != channels) {
+        return false;
+    }
+
+    texels.resize(static_cast<size_t>(header.width) * header.height * header.depth * channels);
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(texels.data()), texels.size()));
+}
+
+void PackBrickPool(const std::string& path, const std::vector<std::string>& volumes, uint32_t size, BrickPool& pool) {
+    if (size % BRICK_SIZE != 0) {
+        throw std::runtime_error("voxel cloud size is not a multiple of the brick size!");
+    }
+    const uint32_t grid = size / BRICK_SIZE;
+    const uint32_t stored = BRICK_SIZE + 2 * BRICK_APRON;
+    const uint32_t cloudCount = static_cast<uint32_t>(volumes.size());
+
+    std::memcpy(pool.header.magic, "SKB1", 4);
+    pool.header.cloudCount = cloudCount;
+    pool.header.gridSize = grid;
+    pool.indirection.assign(static_cast<size_t>(grid) * grid * grid * cloudCount * 4, 0);
+
+    // resident bricks with their apron, placed in the atlas once their count is known
+    std::vector<unsigned char> bricks;
+    std::vector<size_t> brickEntries;
+    for (uint32_t cloud = 0; cloud < cloudCount; cloud++) {
+        PackedVolumeHeader header;
+        std::vector<unsigned char> texels;
+        if (!LoadPackedVolume(volumes[cloud], 2, header, texels) || header.depth != size) {
+            PackVolume(volumes[cloud], size, 2, header, texels);
+        }
+        if (header.width != size || header.height != size) {
+            throw std::runtime_error("voxel cloud is not a cube!");
+        }
+
+        for (uint32_t bz = 0; bz < grid; bz++) {
+            for (uint32_t by = 0; by < grid; by++) {
+                for (uint32_t bx = 0; bx < grid; bx++) {
+                    std::vector<unsigned char> brick(stored * stored * stored * 2);
+                    unsigned char maxDensity = 0, minDistance = 255;
+                    for (uint32_t z = 0; z < stored; z++) {
+                        for (uint32_t y = 0; y < stored; y++) {
+                            for (uint32_t x = 0; x < stored; x++) {
+                                // the apron wraps around like the REPEAT sampler the dense volumes were read with
+                                const uint32_t vx = (bx * BRICK_SIZE + x + size - BRICK_APRON) % size;
+                                const uint32_t vy = (by * BRICK_SIZE + y + size - BRICK_APRON) % size;
+                                const uint32_t vz = (bz * BRICK_SIZE + z + size - BRICK_APRON) % size;
+                                const unsigned char* voxel = &texels[((static_cast<size_t>(vz) * size + vy) * size + vx) * 2];
+                                unsigned char* texel = &brick[((z * stored + y) * stored + x) * 2];
+                                texel[0] = voxel[0];
+                                texel[1] = voxel[1];
+                                maxDensity = std::max(maxDensity, voxel[0]);
+                                minDistance = std::min(minDistance, voxel[1]);
+                            }
+                        }
+                    }
+
+                    const size_t entry = ((static_cast<size_t>(cloud * grid + bz) * grid + by) * grid + bx) * 4;
+                    if (maxDensity == 0) {
+                        // nothing to filter anywhere in the brick, the raymarcher only needs a safe distance
+                        pool.indirection[entry + 3] = std::min<unsigned char>(minDistance, BRICK_RESIDENT - 1);
+                    }
+                    else {
+                        pool.indirection[entry + 3] = BRICK_RESIDENT;
+                        brickEntries.push_back(entry);
+                        bricks.insert(bricks.end(), brick.begin(), brick.end());
+                    }
+                }
+            }
+        }
+    }
+
+    // cube shaped atlas, within the 256 texels per axis every device supports for 3D images
+    uint32_t atlasBricks = 1;
+    while (static_cast<size_t>(atlasBricks) * atlasBricks * atlasBricks < brickEntries.size()) {
+        atlasBricks++;
+    }
+    if (atlasBricks * stored > 256) {
+        throw std::runtime_error("voxel clouds don't fit in the brick atlas!");
+    }
+    pool.header.atlasBricks = atlasBricks;
+    pool.header.residentBricks = static_cast<uint32_t>(brickEntries.size());
+
+    const uint32_t atlasSize = atlasBricks * stored;
+    pool.atlas.assign(static_cast<size_t>(atlasSize) * atlasSize * atlasSize * 2, 0);
+    for (uint32_t i = 0; i < brickEntries.size(); i++) {
+        const uint32_t ax = i % atlasBricks, ay = (i / atlasBricks) % atlasBricks, az = i / (atlasBricks * atlasBricks);
+        pool.indirection[brickEntries[i] + 0] = static_cast<unsigned char>(ax);
+        pool.indirection[brickEntries[i] + 1] = static_cast<unsigned char>(ay);
+        pool.indirection[brickEntries[i] + 2] = static_cast<unsigned char>(az);
+
+        const unsigned char* brick = &bricks[static_cast<size_t>(i) * stored * stored * stored * 2];
+        for (uint32_t z = 0; z < stored; z++) {
+            for (uint32_t y = 0; y < stored; y++) {
+                const size_t row = ((static_cast<size_t>(az * stored + z) * atlasSize + ay * stored + y) * atlasSize + ax * stored) * 2;
+                std::memcpy(&pool.atlas[row], &brick[(z * stored + y) * stored * 2], stored * 2);
+            }
+        }
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("failed to write brick pool!");
+    }
+    file.write(reinterpret_cast<const char*>(&pool.header), sizeof(pool.header));
+    file.write(reinterpret_cast<const char*>(pool.atlas.data()), pool.atlas.size());
+    file.write(reinterpret_cast<const char*>(pool.indirection.data()), pool.indirection.size());
+}
+
+bool LoadBrickPool(const std::string& path, uint32_t cloudCount, BrickPool& pool) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file || !file.read(reinterpret_cast<char*>(&pool.header), sizeof(pool.header))) {
+        return false;
+    }
+    if (std::memcmp(pool.header.magic, "SKB1", 4) != 0 || pool.header.cloudCount != cloudCount) {
+        return false;
+    }
+
+    const size_t atlasSize = pool.header.atlasBricks * (BRICK_SIZE + 2 * BRICK_APRON);
+    const size_t grid = pool.header.gridSize;
+    pool.atlas.resize(atlasSize * atlasSize * atlasSize * 2);
+    pool.indirection.resize(grid * grid * grid * cloudCount * 4);
+    return file.read(reinterpret_cast<char*>(pool.atlas.data()), pool.atlas.size())
+        && file.read(reinterpret_cast<char*>(pool.indirection.data()), pool.indirection.size());
+}
+
+// Squared distance transform of one line (Felzenszwalb and Huttenlocher), f and d hold n values, v and z are scratch
+// for n and n + 1
+static void distanceTransformLine(const float* f, float* d, int n, int* v, float* z) {
+    int k = 0;
+    v[0] = 0;
+    z[0] = -FLT_MAX;
+    z[1] = FLT_MAX;
+    for (int q = 1; q < n; q++) {
+        float s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * (q - v[k]));
+        while (s <= z[k]) {
+            k--;
+            s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * (q - v[k]));
+        }
+        k++;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = FLT_MAX;
+    }
+    k = 0;
+    for (int q = 0; q < n; q++) {
+        while (z[k + 1] < q) {
+            k++;
+        }
+        d[q] = (q - v[k]) * (q - v[k]) + f[v[k]];
+    }
+}
+
+// Runs distanceTransformLine over every line of the volume along one axis, stride apart within a line
+static void distanceTransformAxis(JobSystem& jobs, std::vector<float>& field, uint32_t lines, uint32_t n, const std::function<size_t(uint32_t)>& lineStart, size_t stride) {
+    ParallelFor(jobs, lines, [&](uint32_t begin, uint32_t end) {
+        std::vector<float> f(n), d(n), z(n + 1);
+        std::vector<int> v(n);
+        for (uint32_t line = begin; line < end; line++) {
+            const size_t start = lineStart(line);
+            for (uint32_t i = 0; i < n; i++) {
+                f[i] = field[start + i * stride];
+            }
+            distanceTransformLine(f.data(), d.data(), static_cast<int>(n), v.data(), z.data());
+            for (uint32_t i = 0; i < n; i++) {
+                field[start + i * stride] = d[i];
+            }
+        }
+    });
+}
+
+void BakeVolumeSDF(JobSystem& jobs, const std::string& path, uint32_t depth, float threshold, PackedVolumeHeader& header, std::vector<unsigned char>& texels) {
+    uint32_t channels = 0;
+    for (uint32_t candidate : { 2u, 4u, 1u }) {
+        if (LoadPackedVolume(path, candidate, header, texels) && header.depth == depth) {
+            channels = candidate;
+            break;
+        }
+    }
+    if (channels == 0) {
+        channels = 2;
+        PackVolume(path, depth, channels, header, texels);
+    }
+
+    const uint32_t w = header.width, h = header.height, d = header.depth;
+    const size_t count = static_cast<size_t>(w) * h * d;
+    const unsigned char inside = static_cast<unsigned char>(std::max(1.0f, std::ceil(glm::clamp(threshold, 0.0f, 1.0f) * 255.0f)));
+
+    // squared distance to the cloud, 1e20 rather than infinity keeps the parabola intersections finite
+    std::vector<float> field(count);
+    for (size_t i = 0; i < count; i++) {
+        field[i] = texels[i * channels] >= inside ? 0.0f : 1e20f;
+    }
+    distanceTransformAxis(jobs, field, h * d, w, [&](uint32_t line) { return static_cast<size_t>(line) * w; }, 1);
+    distanceTransformAxis(jobs, field, w * d, h, [&](uint32_t line) { return static_cast<size_t>(line / w) * w * h + line % w; }, w);
+    distanceTransformAxis(jobs, field, w * h, d, [&](uint32_t line) { return static_cast<size_t>(line); }, static_cast<size_t>(w) * h);
+
+    const float edge = static_cast<float>(std::max(w, std::max(h, d)));
+    std::vector<unsigned char> baked(count * 2);
+    for (size_t i = 0; i < count; i++) {
+        baked[i * 2] = texels[i * channels];
+        baked[i * 2 + 1] = static_cast<unsigned char>(std::min(std::sqrt(field[i]) / edge, 1.0f) * 255.0f + 0.5f);
+    }
+    texels.swap(baked);
+    header.channels = 2;
+
+    WritePackedVolume(path, header, texels);
 }
\ No newline at end of file
@@ -8,5 +8,69 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/vec3.hpp>
 #include <string>
+#include <vector>
+#include <functional>
+
+class JobSystem;
 
 void GenerateCurlNoise(std::string path);
+
+// Splits [0, count) into a few contiguous ranges per thread of jobs, runs body(begin, end) on each and waits for all
+// of them, helping out meanwhile. Rethrows what body threw.
+void ParallelFor(JobSystem& jobs, uint32_t count, const std::function<void(uint32_t, uint32_t)>& body);
+
+// Number of 8 bit channels of the formats textures are loaded into: R8, R8G8, or RGBA8 for anything else
+uint32_t FormatChannelCount(VkFormat format);
+// Name of the formats the engine creates images in, without the VK_FORMAT_ prefix, for reports
+const char* FormatName(VkFormat format);
+
+// Packed volume: a header and the texels of every slice, only the channels the shaders read
+struct PackedVolumeHeader {
+    char magic[4]; // "SKV1"
+    uint32_t width, height, depth, channels;
+};
+
+// <path>.r8.vol, <path>.rg8.vol or <path>.rgba8.vol
+std::string PackedVolumePath(const std::string& path, uint32_t channels);
+// Asset build step for a volume stored as RGBA tga slices <path>(0).tga ... <path>(depth - 1).tga. Keeps the first
+// `channels` channels, writes them to PackedVolumePath and returns them in texels. Throws if a slice is missing.
+void PackVolume(const std::string& path, uint32_t depth, uint32_t channels, PackedVolumeHeader& header, std::vector<unsigned char>& texels);
+// False when there is no packed file or it doesn't hold `channels` channels
+bool LoadPackedVolume(const std::string& path, uint32_t channels, PackedVolumeHeader& header, std::vector<unsigned char>& texels);
+// Writes header and texels to PackedVolumePath(path, header.channels)
+void WritePackedVolume(const std::string& path, const PackedVolumeHeader& header, const std::vector<unsigned char>& texels);
+
+// Sparse voxel clouds: BRICK_SIZE^3 voxel bricks in one shared atlas, each stored with a BRICK_APRON voxel border so
+// trilinear filtering never reads a neighbouring brick. Every cloud has an indirection grid of RGBA8_UINT entries,
+// xyz: the brick in the atlas, w: BRICK_RESIDENT, or for an empty brick the smallest distance (g) around it.
+// compute-clouds.comp mirrors these.
+#define BRICK_SIZE 8
+#define BRICK_APRON 1
+#define BRICK_RESIDENT 255
+
+struct BrickPoolHeader {
+    char magic[4]; // "SKB1"
+    uint32_t cloudCount;
+    uint32_t gridSize;    // indirection entries per axis and cloud
+    uint32_t atlasBricks; // bricks per axis of the atlas
+    uint32_t residentBricks;
+};
+
+struct BrickPool {
+    BrickPoolHeader header;
+    std::vector<unsigned char> atlas;       // RG8, atlasBricks * (BRICK_SIZE + 2 * BRICK_APRON) texels per axis
+    std::vector<unsigned char> indirection; // RGBA8_UINT, gridSize x gridSize x gridSize * cloudCount, clouds stacked along z
+};
+
+// Asset build step for the voxel clouds. Bricks the RG8 volumes of every cloud (packed by PackVolume on demand) into
+// one pool and writes it to path. The volumes are cubes of `size` voxels, a multiple of BRICK_SIZE.
+void PackBrickPool(const std::string& path, const std::vector<std::string>& volumes, uint32_t size, BrickPool& pool);
+// False when there is no pool at path or it was built for a different number of clouds
+bool LoadBrickPool(const std::string& path, uint32_t cloudCount, BrickPool& pool);
+
+// Offline distance baker for the voxel clouds, in place of a DCC round-trip. Reads the density from the r channel of
+// a packed volume at path (r8, rg8 or rgba8) or else of the tga slices, and writes PackedVolumePath(path, 2) with
+// r: density, g: distance to the nearest voxel whose density reaches threshold, in units of the volume's edge and
+// 0 inside the cloud, which is what the raymarcher reads. Exact Euclidean distances, each axis pass split across the
+// threads of jobs.
+void BakeVolumeSDF(JobSystem& jobs, const std::string& path, uint32_t depth, float threshold, PackedVolumeHeader& header, std::vector<unsigned char>& texels);
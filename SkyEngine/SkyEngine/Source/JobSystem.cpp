@@ -0,0 +1,215 @@
+#include "JobSystem.h"
+#include <algorithm>
+
+struct Job {
+    std::function<void()> task;
+    // unfinished dependencies, plus one until submit has registered with all of them
+    std::atomic<uint32_t> pending{ 1 };
+    std::atomic<bool> done{ false };
+    std::mutex mutex; // done, continuations and error of a dependency change together
+    std::vector<JobHandle> continuations;
+    std::exception_ptr error; // of the task or the first dependency that failed, the task is skipped then
+};
+
+// slot of the thread, 0 for any thread that isn't a worker
+static thread_local uint32_t currentSlot = 0;
+
+JobSystem::JobSystem(uint32_t workerCount) {
+    if (workerCount == 0) {
+        const uint32_t hardware = std::thread::hardware_concurrency();
+        workerCount = hardware > 1 ? hardware - 1 : 1;
+    }
+    for (uint32_t s = 0; s <= workerCount; s++) {
+        slots.push_back(std::unique_ptr<Slot>(new Slot()));
+    }
+    statsSince = std::chrono::steady_clock::now();
+    for (uint32_t s = 1; s <= workerCount; s++) {
+        workers.push_back(std::thread(&JobSystem::workerLoop, this, s));
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+JobHandle JobSystem::submit(std::function<void()> task, const std::vector<JobHandle>& dependencies) {
+    JobHandle job = std::make_shared<Job>();
+    job->task = std::move(task);
+    job->pending += static_cast<uint32_t>(dependencies.size());
+    for (const JobHandle& dependency : dependencies) {
+        bool finished = !dependency;
+        if (!finished) {
+            std::lock_guard<std::mutex> lock(dependency->mutex);
+            finished = dependency->done;
+            if (!finished) {
+                dependency->continuations.push_back(job);
+            }
+            else if (dependency->error) {
+                std::lock_guard<std::mutex> jobLock(job->mutex);
+                if (!job->error) {
+                    job->error = dependency->error;
+                }
+            }
+        }
+        if (finished) {
+            job->pending--;
+        }
+    }
+    if (--job->pending == 0) {
+        schedule(job);
+    }
+    return job;
+}
+
+JobHandle JobSystem::parallelFor(uint32_t count, uint32_t grain, std::function<void(uint32_t begin, uint32_t end)> task, const std::vector<JobHandle>& dependencies) {
+    grain = std::max(grain, 1u);
+    std::vector<JobHandle> ranges;
+    for (uint32_t begin = 0; begin < count; begin += grain) {
+        const uint32_t end = std::min(count, begin + grain);
+        ranges.push_back(submit([task, begin, end]() { task(begin, end); }, dependencies));
+    }
+    if (ranges.empty()) {
+        return submit([]() {}, dependencies);
+    }
+    return ranges.size() == 1 ? ranges[0] : submit([]() {}, ranges);
+}
+
+void JobSystem::wait(const JobHandle& job) {
+    while (!isDone(job)) {
+        if (!runOne(currentSlot)) {
+            std::this_thread::yield();
+        }
+    }
+    if (job && job->error) {
+        std::rethrow_exception(job->error);
+    }
+}
+
+bool JobSystem::isDone(const JobHandle& job) {
+    return !job || job->done;
+}
+
+uint32_t JobSystem::currentThread() {
+    return currentSlot;
+}
+
+void JobSystem::schedule(const JobHandle& job) {
+    Slot& slot = *slots[currentSlot];
+    {
+        // under the lock, so a worker between its last look at the queues and going to sleep can't miss it. Counted
+        // before the push, a worker that takes the job right away must not count it off first and wrap the counter.
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queued++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(slot.mutex);
+        slot.queue.push_back(job);
+    }
+    wake.notify_one();
+}
+
+void JobSystem::finish(const JobHandle& job) {
+    std::vector<JobHandle> continuations;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->done = true;
+        continuations.swap(job->continuations);
+    }
+    job->task = nullptr; // whatever the task captured goes now, not with the last handle
+    for (const JobHandle& continuation : continuations) {
+        if (job->error) {
+            std::lock_guard<std::mutex> lock(continuation->mutex);
+            if (!continuation->error) {
+                continuation->error = job->error;
+            }
+        }
+        if (--continuation->pending == 0) {
+            schedule(continuation);
+        }
+    }
+}
+
+bool JobSystem::runOne(uint32_t slot) {
+    JobHandle job;
+    bool stolen = false;
+    {
+        Slot& own = *slots[slot];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.queue.empty()) {
+            job = own.queue.back();
+            own.queue.pop_back();
+        }
+    }
+    for (uint32_t i = 1; !job && i < slots.size(); i++) {
+        Slot& victim = *slots[(slot + i) % slots.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.queue.empty()) {
+            job = victim.queue.front();
+            victim.queue.pop_front();
+            stolen = true;
+        }
+    }
+    if (!job) {
+        return false;
+    }
+    queued--;
+
+    const auto begin = std::chrono::steady_clock::now();
+    if (!job->error) {
+        try {
+            job->task();
+        }
+        catch (...) {
+            job->error = std::current_exception();
+        }
+    }
+    const auto end = std::chrono::steady_clock::now();
+    finish(job);
+
+    Slot& own = *slots[slot];
+    own.jobs++;
+    own.steals += stolen ? 1 : 0;
+    own.busyNanoseconds += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+    return true;
+}
+
+void JobSystem::workerLoop(uint32_t slot) {
+    currentSlot = slot;
+    while (true) {
+        if (runOne(slot)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this]() { return stopping || queued > 0; });
+        if (stopping) {
+            return;
+        }
+    }
+}
+
+std::vector<JobWorkerStats> JobSystem::getStats() const {
+    const double elapsed = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - statsSince).count());
+    std::vector<JobWorkerStats> stats(slots.size());
+    for (size_t s = 0; s < slots.size(); s++) {
+        stats[s].jobs = slots[s]->jobs;
+        stats[s].steals = slots[s]->steals;
+        stats[s].utilisation = elapsed > 0.0 ? static_cast<float>(slots[s]->busyNanoseconds / elapsed) : 0.0f;
+    }
+    return stats;
+}
+
+void JobSystem::resetStats() {
+    for (auto& slot : slots) {
+        slot->jobs = 0;
+        slot->steals = 0;
+        slot->busyNanoseconds = 0;
+    }
+    statsSince = std::chrono::steady_clock::now();
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Job;
+typedef std::shared_ptr<Job> JobHandle;
+
+struct JobWorkerStats {
+    uint64_t jobs;      // run on the thread since resetStats
+    uint64_t steals;    // of those, taken from the queue of another thread
+    float utilisation;  // share of the time since resetStats spent running jobs
+};
+
+// Work-stealing scheduler shared by the engine. Every thread has its own queue: it pushes the jobs it submits on the
+// back and runs its own newest first, while idle workers steal the oldest from the front of the others'. A job is
+// queued once all of its dependencies have finished. Slot 0 is the thread that created the system, which has no
+// worker of its own and only runs jobs while it waits on one. A job that throws hands the exception on to the jobs
+// that depend on it, which are skipped, and wait rethrows it.
+class JobSystem
+{
+public:
+    // 0: a worker for every hardware thread but the calling one
+    explicit JobSystem(uint32_t workerCount = 0);
+    ~JobSystem();
+
+    JobHandle submit(std::function<void()> task, const std::vector<JobHandle>& dependencies = {});
+    // [0, count) in ranges of at most grain, the returned job finishes with the last of them
+    JobHandle parallelFor(uint32_t count, uint32_t grain, std::function<void(uint32_t begin, uint32_t end)> task, const std::vector<JobHandle>& dependencies = {});
+    // Runs queued jobs until job has finished. A null handle has always finished. Rethrows what job or any job it
+    // depends on threw.
+    void wait(const JobHandle& job);
+    static bool isDone(const JobHandle& job);
+    // slot of the calling thread, 0 for any thread that isn't a worker
+    static uint32_t currentThread();
+
+    // threads that run jobs, slot 0 included
+    uint32_t getThreadCount() const { return static_cast<uint32_t>(slots.size()); }
+    std::vector<JobWorkerStats> getStats() const;
+    void resetStats();
+
+private:
+    struct Slot {
+        std::mutex mutex;
+        std::deque<JobHandle> queue;
+        std::atomic<uint64_t> jobs{ 0 };
+        std::atomic<uint64_t> steals{ 0 };
+        std::atomic<uint64_t> busyNanoseconds{ 0 };
+    };
+
+    std::vector<std::unique_ptr<Slot>> slots;
+    std::vector<std::thread> workers;
+
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::atomic<uint32_t> queued{ 0 };
+    bool stopping = false;
+    std::chrono::steady_clock::time_point statsSince;
+
+    void schedule(const JobHandle& job);
+    void finish(const JobHandle& job);
+    // Own queue first, then the others. False when all of them were empty.
+    bool runOne(uint32_t slot);
+    void workerLoop(uint32_t slot);
+};
@@ -0,0 +1,151 @@
+#include "MemoryReport.h"
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <mutex>
+
+namespace {
+    struct Tracked {
+        TrackedAllocation allocation;
+        uint32_t memoryType;
+    };
+
+    // workers allocate while the engine starts up
+    std::mutex trackedMutex;
+    std::map<VkDeviceMemory, Tracked> tracked;
+
+    void writeString(std::ostream& out, const std::string& text) {
+        out << '"';
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                out << '\\' << c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20) {
+                // control characters aren't allowed raw in a JSON string
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(static_cast<unsigned char>(c)));
+                out << escaped;
+            }
+            else {
+                out << c;
+            }
+        }
+        out << '"';
+    }
+}
+
+const char* MemoryCategoryName(MemoryCategory category) {
+    switch (category) {
+    case MemoryCategory::Texture: return "texture";
+    case MemoryCategory::Volume: return "volume";
+    case MemoryCategory::Framebuffer: return "framebuffer";
+    case MemoryCategory::UniformBuffer: return "uniform buffer";
+    case MemoryCategory::Buffer: return "buffer";
+    case MemoryCategory::Staging: return "staging";
+    default: return "unknown";
+    }
+}
+
+VkResult AllocateTrackedMemory(VkDevice device, const VkMemoryAllocateInfo& allocInfo, VkDeviceMemory& memory, MemoryCategory category,
+    const std::string& name, const std::string& detail) {
+    VkResult result = vkAllocateMemory(device, &allocInfo, nullptr, &memory);
+    if (result == VK_SUCCESS) {
+        Tracked entry;
+        entry.allocation.category = category;
+        entry.allocation.name = name;
+        entry.allocation.detail = detail;
+        entry.allocation.size = allocInfo.allocationSize;
+        entry.allocation.heap = 0;
+        entry.memoryType = allocInfo.memoryTypeIndex;
+        std::lock_guard<std::mutex> lock(trackedMutex);
+        tracked[memory] = entry;
+    }
+    return result;
+}
+
+void FreeTrackedMemory(VkDevice device, VkDeviceMemory memory, const VkAllocationCallbacks* allocator) {
+    if (memory != VK_NULL_HANDLE) {
+        std::lock_guard<std::mutex> lock(trackedMutex);
+        tracked.erase(memory);
+    }
+    vkFreeMemory(device, memory, allocator);
+}
+
+MemoryReport QueryMemoryReport(VkInstance instance, VkPhysicalDevice physicalDevice, bool memoryBudget) {
+    MemoryReport report = {};
+    VkPhysicalDeviceMemoryProperties properties;
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {};
+    budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+    // the instance is Vulkan 1.0, the query comes from VK_KHR_get_physical_device_properties2
+    auto getMemoryProperties2 = memoryBudget ? (PFN_vkGetPhysicalDeviceMemoryProperties2KHR)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceMemoryProperties2KHR") : nullptr;
+    if (getMemoryProperties2 != nullptr) {
+        VkPhysicalDeviceMemoryProperties2KHR properties2 = {};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2_KHR;
+        properties2.pNext = &budget;
+        getMemoryProperties2(physicalDevice, &properties2);
+        properties = properties2.memoryProperties;
+        report.budgetExtension = true;
+    }
+    else {
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &properties);
+    }
+
+    report.heaps.resize(properties.memoryHeapCount);
+    for (uint32_t h = 0; h < properties.memoryHeapCount; h++) {
+        MemoryHeapReport& heap = report.heaps[h];
+        heap.size = properties.memoryHeaps[h].size;
+        heap.deviceLocal = (properties.memoryHeaps[h].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+        heap.budget = report.budgetExtension ? budget.heapBudget[h] : heap.size;
+        heap.usage = report.budgetExtension ? budget.heapUsage[h] : 0;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(trackedMutex);
+        report.allocations.reserve(tracked.size());
+        for (const auto& entry : tracked) {
+            TrackedAllocation allocation = entry.second.allocation;
+            allocation.heap = properties.memoryTypes[entry.second.memoryType].heapIndex;
+            report.allocations.push_back(allocation);
+        }
+    }
+    for (const TrackedAllocation& allocation : report.allocations) {
+        report.heaps[allocation.heap].tracked += allocation.size;
+        report.categoryBytes[static_cast<int>(allocation.category)] += allocation.size;
+        if (!report.budgetExtension) {
+            report.heaps[allocation.heap].usage += allocation.size;
+        }
+    }
+    std::sort(report.allocations.begin(), report.allocations.end(),
+        [](const TrackedAllocation& a, const TrackedAllocation& b) { return a.size > b.size; });
+    return report;
+}
+
+void WriteMemoryReport(const MemoryReport& report, std::ostream& out) {
+    out << "{\n  \"budgetExtension\": " << (report.budgetExtension ? "true" : "false") << ",\n  \"heaps\": [\n";
+    for (size_t h = 0; h < report.heaps.size(); h++) {
+        const MemoryHeapReport& heap = report.heaps[h];
+        out << "    { \"heap\": " << h << ", \"deviceLocal\": " << (heap.deviceLocal ? "true" : "false") << ", \"size\": " << heap.size
+            << ", \"budget\": " << heap.budget << ", \"usage\": " << heap.usage << ", \"tracked\": " << heap.tracked << " }"
+            << (h + 1 < report.heaps.size() ? ",\n" : "\n");
+    }
+    out << "  ],\n  \"categories\": {\n";
+    for (int c = 0; c < static_cast<int>(MemoryCategory::Count); c++) {
+        out << "    ";
+        writeString(out, MemoryCategoryName(static_cast<MemoryCategory>(c)));
+        out << ": " << report.categoryBytes[c] << (c + 1 < static_cast<int>(MemoryCategory::Count) ? ",\n" : "\n");
+    }
+    out << "  },\n  \"allocations\": [\n";
+    for (size_t a = 0; a < report.allocations.size(); a++) {
+        const TrackedAllocation& allocation = report.allocations[a];
+        out << "    { \"category\": ";
+        writeString(out, MemoryCategoryName(allocation.category));
+        out << ", \"name\": ";
+        writeString(out, allocation.name);
+        out << ", \"detail\": ";
+        writeString(out, allocation.detail);
+        out << ", \"heap\": " << allocation.heap << ", \"size\": " << allocation.size << " }"
+            << (a + 1 < report.allocations.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
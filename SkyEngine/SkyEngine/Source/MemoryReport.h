@@ -0,0 +1,56 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+enum class MemoryCategory {
+    Texture,       // 2D images read by the shaders, files and storage targets
+    Volume,        // 3D images: cloud noise, voxel bricks
+    Framebuffer,   // offscreen colour blocks and depth
+    UniformBuffer,
+    Buffer,        // vertex, index, storage and indirect buffers
+    Staging,       // host visible copies on their way to the GPU
+    Count
+};
+
+const char* MemoryCategoryName(MemoryCategory category);
+
+struct TrackedAllocation {
+    MemoryCategory category;
+    std::string name;   // file it was loaded from, or what the memory backs
+    std::string detail; // extent and format of an image
+    VkDeviceSize size;
+    uint32_t heap;
+};
+
+struct MemoryHeapReport {
+    VkDeviceSize size;
+    // What the process may use before the driver starts paging and what it uses, allocations made by the driver and
+    // the swapchain included. Without VK_EXT_memory_budget: the heap size and the tracked allocations only.
+    VkDeviceSize budget;
+    VkDeviceSize usage;
+    VkDeviceSize tracked; // by AllocateTrackedMemory
+    bool deviceLocal;
+};
+
+struct MemoryReport {
+    bool budgetExtension; // heaps come from VK_EXT_memory_budget
+    std::vector<MemoryHeapReport> heaps;
+    std::vector<TrackedAllocation> allocations; // largest first
+    VkDeviceSize categoryBytes[static_cast<int>(MemoryCategory::Count)];
+};
+
+// vkAllocateMemory that also lists the allocation in the memory report, until FreeTrackedMemory. Fine on any thread.
+VkResult AllocateTrackedMemory(VkDevice device, const VkMemoryAllocateInfo& allocInfo, VkDeviceMemory& memory, MemoryCategory category,
+    const std::string& name, const std::string& detail = "");
+// vkFreeMemory for every allocation, tracked or not
+void FreeTrackedMemory(VkDevice device, VkDeviceMemory memory, const VkAllocationCallbacks* allocator);
+
+// memoryBudget: VK_EXT_memory_budget is enabled on the device, and with it VK_KHR_get_physical_device_properties2 on
+// the instance
+MemoryReport QueryMemoryReport(VkInstance instance, VkPhysicalDevice physicalDevice, bool memoryBudget);
+// The report as JSON, sizes in bytes
+void WriteMemoryReport(const MemoryReport& report, std::ostream& out);
@@ -0,0 +1,275 @@
+#include "MeshOptimizer.h"
+#include <glm/geometric.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// Forsyth's scoring, tuned for an LRU cache of this size
+#define FORSYTH_CACHE_SIZE 32
+#define FORSYTH_CACHE_DECAY 1.5f
+#define FORSYTH_LAST_TRIANGLE_SCORE 0.75f // the vertices of the last triangle, low so strips don't run back on themselves
+#define FORSYTH_VALENCE_SCALE 2.0f        // vertices with few triangles left go first, so none are left stranded
+#define FORSYTH_VALENCE_POWER 0.5f
+
+// FIFO of cacheSize entries, a vertex is in it while fewer than cacheSize misses happened since its own
+class FifoCache {
+public:
+    FifoCache(uint32_t vertexCount, uint32_t cacheSize) : timestamps(vertexCount, 0), cacheSize(cacheSize) {
+        reset();
+    }
+
+    void reset() {
+        // far enough ahead of every timestamp that all of them miss
+        time += cacheSize + 1;
+    }
+
+    // true on a miss, which transforms the vertex
+    bool access(uint32_t vertex) {
+        if (time - timestamps[vertex] > cacheSize) {
+            timestamps[vertex] = time++;
+            return true;
+        }
+        return false;
+    }
+
+private:
+    std::vector<uint32_t> timestamps;
+    uint32_t cacheSize;
+    uint32_t time = 0;
+};
+
+VertexCacheStats AnalyzeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize) {
+    FifoCache cache(vertexCount, cacheSize);
+    std::vector<bool> used(vertexCount, false);
+    uint32_t transformed = 0;
+    uint32_t usedCount = 0;
+    for (uint32_t index : indices) {
+        transformed += cache.access(index) ? 1 : 0;
+        if (!used[index]) {
+            used[index] = true;
+            usedCount++;
+        }
+    }
+
+    VertexCacheStats stats = {};
+    stats.acmr = indices.empty() ? 0.0f : static_cast<float>(transformed) / (indices.size() / 3);
+    stats.atvr = usedCount == 0 ? 0.0f : static_cast<float>(transformed) / usedCount;
+    return stats;
+}
+
+static float forsythScore(int cachePosition, uint32_t remaining) {
+    if (remaining == 0) {
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        score = cachePosition < 3 ? FORSYTH_LAST_TRIANGLE_SCORE
+            : std::pow(1.0f - (cachePosition - 3) / static_cast<float>(FORSYTH_CACHE_SIZE - 3), FORSYTH_CACHE_DECAY);
+    }
+    return score + FORSYTH_VALENCE_SCALE * std::pow(static_cast<float>(remaining), -FORSYTH_VALENCE_POWER);
+}
+
+void OptimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount) {
+    const size_t triangleCount = indices.size() / 3;
+
+    // triangles not yet emitted of each vertex, the first remaining[v] entries of its row
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (uint32_t index : indices) {
+        offsets[index + 1]++;
+    }
+    for (uint32_t v = 0; v < vertexCount; v++) {
+        offsets[v + 1] += offsets[v];
+    }
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> remaining(vertexCount, 0);
+    for (size_t i = 0; i < indices.size(); i++) {
+        const uint32_t v = indices[i];
+        adjacency[offsets[v] + remaining[v]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; v++) {
+        vertexScore[v] = forsythScore(-1, remaining[v]);
+    }
+    std::vector<float> triangleScore(triangleCount);
+    for (size_t t = 0; t < triangleCount; t++) {
+        triangleScore[t] = vertexScore[indices[3 * t]] + vertexScore[indices[3 * t + 1]] + vertexScore[indices[3 * t + 2]];
+    }
+
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> cache;
+    std::vector<uint32_t> nextCache;
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    size_t cursor = 0; // no triangle before it is left
+    int64_t best = -1;
+
+    for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++) {
+        if (best < 0) {
+            // nothing in the cache has a triangle left, carry on in input order
+            while (emitted[cursor]) {
+                cursor++;
+            }
+            best = static_cast<int64_t>(cursor);
+        }
+
+        const uint32_t* triangle = &indices[3 * best];
+        result.insert(result.end(), triangle, triangle + 3);
+        emitted[best] = true;
+
+        // the vertices of the triangle go to the front of the cache
+        nextCache.clear();
+        for (int k = 0; k < 3; k++) {
+            const uint32_t v = triangle[k];
+            if (std::find(nextCache.begin(), nextCache.end(), v) == nextCache.end()) {
+                nextCache.push_back(v);
+            }
+
+            uint32_t* row = &adjacency[offsets[v]];
+            uint32_t* found = std::find(row, row + remaining[v], static_cast<uint32_t>(best));
+            *found = row[--remaining[v]];
+        }
+        for (uint32_t v : cache) {
+            if (std::find(nextCache.begin(), nextCache.end(), v) == nextCache.end()) {
+                nextCache.push_back(v);
+            }
+        }
+
+        // rescore everything that moved in the cache, including what just fell out of it
+        for (size_t i = 0; i < nextCache.size(); i++) {
+            const uint32_t v = nextCache[i];
+            cachePosition[v] = i < FORSYTH_CACHE_SIZE ? static_cast<int>(i) : -1;
+            const float score = forsythScore(cachePosition[v], remaining[v]);
+            for (uint32_t a = 0; a < remaining[v]; a++) {
+                triangleScore[adjacency[offsets[v] + a]] += score - vertexScore[v];
+            }
+            vertexScore[v] = score;
+        }
+
+        best = -1;
+        float bestScore = -FLT_MAX;
+        nextCache.resize(std::min<size_t>(nextCache.size(), FORSYTH_CACHE_SIZE));
+        for (uint32_t v : nextCache) {
+            for (uint32_t a = 0; a < remaining[v]; a++) {
+                const uint32_t t = adjacency[offsets[v] + a];
+                if (triangleScore[t] > bestScore) {
+                    bestScore = triangleScore[t];
+                    best = t;
+                }
+            }
+        }
+        cache.swap(nextCache);
+    }
+
+    indices.swap(result);
+}
+
+void OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions, uint32_t cacheSize, float threshold) {
+    const size_t triangleCount = indices.size() / 3;
+    const uint32_t vertexCount = static_cast<uint32_t>(positions.size());
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // hard boundaries where the cache holds none of a triangle's vertices, splitting there costs no reuse
+    std::vector<size_t> hardStarts;
+    FifoCache cache(vertexCount, cacheSize);
+    for (size_t t = 0; t < triangleCount; t++) {
+        const int misses = (cache.access(indices[3 * t]) ? 1 : 0) + (cache.access(indices[3 * t + 1]) ? 1 : 0) + (cache.access(indices[3 * t + 2]) ? 1 : 0);
+        if (misses == 3) {
+            hardStarts.push_back(t);
+        }
+    }
+    if (hardStarts.empty() || hardStarts[0] != 0) {
+        hardStarts.insert(hardStarts.begin(), 0);
+    }
+    hardStarts.push_back(triangleCount);
+
+    // soft boundaries inside those, wherever the part so far already reuses about as well as the whole cluster
+    std::vector<size_t> starts;
+    for (size_t c = 0; c + 1 < hardStarts.size(); c++) {
+        const size_t begin = hardStarts[c];
+        const size_t end = hardStarts[c + 1];
+
+        cache.reset();
+        uint32_t clusterMisses = 0;
+        for (size_t i = 3 * begin; i < 3 * end; i++) {
+            clusterMisses += cache.access(indices[i]) ? 1 : 0;
+        }
+        const float clusterAcmr = static_cast<float>(clusterMisses) / (end - begin);
+
+        cache.reset();
+        starts.push_back(begin);
+        size_t start = begin;
+        uint32_t misses = 0;
+        for (size_t t = begin; t + 1 < end; t++) {
+            for (int k = 0; k < 3; k++) {
+                misses += cache.access(indices[3 * t + k]) ? 1 : 0;
+            }
+            if (static_cast<float>(misses) / (t + 1 - start) <= clusterAcmr * threshold) {
+                start = t + 1;
+                starts.push_back(start);
+                misses = 0;
+                cache.reset();
+            }
+        }
+    }
+    starts.push_back(triangleCount);
+
+    // clusters facing away from the centre of the mesh are in front of the rest from most directions
+    const size_t clusterCount = starts.size() - 1;
+    std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0.0f));
+    std::vector<glm::vec3> normals(clusterCount, glm::vec3(0.0f));
+    std::vector<float> areas(clusterCount, 0.0f);
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < clusterCount; c++) {
+        for (size_t t = starts[c]; t < starts[c + 1]; t++) {
+            const glm::vec3& a = positions[indices[3 * t]];
+            const glm::vec3& b = positions[indices[3 * t + 1]];
+            const glm::vec3& d = positions[indices[3 * t + 2]];
+            const glm::vec3 n = glm::cross(b - a, d - a);
+            const float area = glm::length(n);
+            centroids[c] += area * (a + b + d) / 3.0f;
+            normals[c] += n;
+            areas[c] += area;
+        }
+        meshCentroid += centroids[c];
+        meshArea += areas[c];
+        centroids[c] /= std::max(areas[c], FLT_MIN);
+    }
+    meshCentroid /= std::max(meshArea, FLT_MIN);
+
+    std::vector<float> keys(clusterCount);
+    std::vector<size_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++) {
+        const float length = glm::length(normals[c]);
+        keys[c] = length > 0.0f ? glm::dot(centroids[c] - meshCentroid, normals[c] / length) : 0.0f;
+        order[c] = c;
+    }
+    std::stable_sort(order.begin(), order.end(), [&keys](size_t a, size_t b) { return keys[a] > keys[b]; });
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    for (size_t c : order) {
+        result.insert(result.end(), indices.begin() + 3 * starts[c], indices.begin() + 3 * starts[c + 1]);
+    }
+    indices.swap(result);
+}
+
+std::vector<uint32_t> OptimizeVertexFetch(std::vector<uint32_t>& indices, uint32_t vertexCount) {
+    const uint32_t unused = ~0u;
+    std::vector<uint32_t> remap(vertexCount, unused);
+    std::vector<uint32_t> order;
+    order.reserve(vertexCount);
+    for (uint32_t& index : indices) {
+        if (remap[index] == unused) {
+            remap[index] = static_cast<uint32_t>(order.size());
+            order.push_back(index);
+        }
+        index = remap[index];
+    }
+    return order;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <glm/vec3.hpp>
+#include <vector>
+#include <cstdint>
+
+// Reordering of indexed triangle lists for the vertex shader, run once when a mesh is packed. Triangles are first put in
+// an order that reuses the post-transform cache (Forsyth), then grouped into clusters that keep most of that reuse and
+// sorted so outward facing clusters draw first and hide what is behind them (Sander et al.), and last the vertices are
+// put in the order the triangles first use them.
+
+// ACMR: vertices transformed per triangle, 0.5 at best on a regular grid and 3 at worst. ATVR: vertices transformed per
+// vertex used, 1 at best.
+struct VertexCacheStats {
+    float acmr;
+    float atvr;
+};
+
+// Simulates a FIFO post-transform cache of cacheSize entries over the triangles
+VertexCacheStats AnalyzeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize);
+
+void OptimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount);
+
+// Keeps the order within clusters, which only split where the ACMR of the part before stays within threshold of the
+// whole cluster. positions are per vertex.
+void OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions, uint32_t cacheSize, float threshold);
+
+// Rewrites indices for vertices numbered in order of first use and returns, for each new vertex, the old one. Vertices
+// no triangle uses are left out.
+std::vector<uint32_t> OptimizeVertexFetch(std::vector<uint32_t>& indices, uint32_t vertexCount);
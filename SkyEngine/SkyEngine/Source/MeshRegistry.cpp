@@ -0,0 +1,119 @@
+#include "MeshRegistry.h"
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+#include <cmath>
+#include <cstring>
+
+void MeshRegistry::cleanup() {
+    vkDestroyBuffer(device, vertexBuffer, nullptr);
+    FreeTrackedMemory(device, vertexDeviceMemory, nullptr);
+    vkDestroyBuffer(device, indexBuffer, nullptr);
+    FreeTrackedMemory(device, indexDeviceMemory, nullptr);
+    vkDestroyBuffer(device, instanceBuffer, nullptr);
+    FreeTrackedMemory(device, instanceDeviceMemory, nullptr);
+    vkDestroyBuffer(device, drawBuffer, nullptr);
+    FreeTrackedMemory(device, drawDeviceMemory, nullptr);
+}
+
+void MeshRegistry::createDeviceLocalBuffer(const void* data, VkDeviceSize bufferSize, VkBufferUsageFlags usage, VkBuffer& buffer, VkDeviceMemory& memory) {
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+    void* mapped;
+    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &mapped);
+    memcpy(mapped, data, (size_t)bufferSize);
+    vkUnmapMemory(device, stagingBufferMemory);
+
+    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, memory);
+    copyBuffer(stagingBuffer, buffer, bufferSize);
+
+    vkDestroyBuffer(device, stagingBuffer, nullptr);
+    FreeTrackedMemory(device, stagingBufferMemory, nullptr);
+}
+
+uint32_t MeshRegistry::addMesh(const std::string& path) {
+    PackedMeshHeader header;
+    std::vector<PackedVertex> meshVertices;
+    std::vector<uint32_t> meshIndices;
+    LoadMesh(path, header, meshVertices, meshIndices);
+
+    RegisteredMesh mesh = {};
+    mesh.indexCount = header.indexCount;
+    mesh.firstIndex = static_cast<uint32_t>(indices.size());
+    mesh.vertexOffset = static_cast<int32_t>(vertices.size());
+    const glm::vec3 centre(header.boundsCentre[0], header.boundsCentre[1], header.boundsCentre[2]);
+    const glm::vec3 extent(header.boundsExtent[0], header.boundsExtent[1], header.boundsExtent[2]);
+    mesh.positionDecode = glm::scale(glm::translate(glm::mat4(1.0f), centre), extent);
+
+    vertices.insert(vertices.end(), meshVertices.begin(), meshVertices.end());
+    indices.insert(indices.end(), meshIndices.begin(), meshIndices.end());
+    meshes.push_back(mesh);
+    return static_cast<uint32_t>(meshes.size() - 1);
+}
+
+uint32_t MeshRegistry::addInstance(uint32_t mesh, const glm::mat4& model) {
+    const RegisteredMesh& registered = meshes[mesh];
+
+    MeshInstanceObject instance = {};
+    instance.model = model * registered.positionDecode;
+    instance.invTranspose = glm::inverse(glm::transpose(model));
+    // The snorm positions fill a box, its corners are this far from the centre as long as the model matrix doesn't
+    // shear. glm matrices are indexed by column.
+    const glm::mat4& m = instance.model;
+    const float radius = std::sqrt(glm::dot(glm::vec3(m[0]), glm::vec3(m[0])) + glm::dot(glm::vec3(m[1]), glm::vec3(m[1])) + glm::dot(glm::vec3(m[2]), glm::vec3(m[2])));
+    instance.sphere = glm::vec4(glm::vec3(m[3]), radius);
+    instance.draw = glm::uvec4(registered.indexCount, registered.firstIndex, static_cast<uint32_t>(registered.vertexOffset), 0);
+
+    instances.push_back(instance);
+    return static_cast<uint32_t>(instances.size() - 1);
+}
+
+void MeshRegistry::build() {
+    if (instances.empty()) {
+        throw std::runtime_error("failed to build mesh registry, nothing to draw!");
+    }
+
+    createDeviceLocalBuffer(vertices.data(), sizeof(PackedVertex) * vertices.size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertexBuffer, vertexDeviceMemory);
+    createDeviceLocalBuffer(indices.data(), sizeof(uint32_t) * indices.size(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indexBuffer, indexDeviceMemory);
+    createDeviceLocalBuffer(instances.data(), sizeof(MeshInstanceObject) * instances.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, instanceBuffer, instanceDeviceMemory);
+    createBuffer(sizeof(VkDrawIndexedIndirectCommand) * instances.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, drawBuffer, drawDeviceMemory);
+
+    // the GPU has its own copy
+    vertices.clear();
+    vertices.shrink_to_fit();
+    indices.clear();
+    indices.shrink_to_fit();
+}
+
+void MeshRegistry::recordCulling(VkCommandBuffer& commandBuffer) {
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = drawBuffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+
+    // the draws of the frame before are done reading the commands
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    const uint32_t groups = (getInstanceCount() + MESH_CULL_WORKGROUP_SIZE - 1) / MESH_CULL_WORKGROUP_SIZE;
+    vkCmdDispatch(commandBuffer, groups, 1, 1);
+
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+void MeshRegistry::enqueueDrawCommands(VkCommandBuffer& commandBuffer) {
+    VkBuffer vertexBuffers[] = { vertexBuffer };
+    VkDeviceSize offsets[] = { 0 };
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+    vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    // firstInstance of every command is its instance, the vertex shader finds its transform with gl_InstanceIndex
+    vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer, 0, getInstanceCount(), sizeof(VkDrawIndexedIndirectCommand));
+}
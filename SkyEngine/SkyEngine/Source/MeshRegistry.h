@@ -0,0 +1,66 @@
+#pragma once
+#include "Geometry.h"
+#include <glm/mat4x4.hpp>
+
+#define MESH_CULL_WORKGROUP_SIZE 64 // set in cull-instances.comp at the same time
+
+// std430, one per instance, what cull-instances.comp and model.vert INSTANCED read
+struct MeshInstanceObject {
+    glm::mat4 model;        // decode of the mesh folded in
+    glm::mat4 invTranspose; // of the model matrix without the decode, the normals aren't quantized
+    glm::vec4 sphere;       // world space bounds, xyz: centre, w: radius
+    glm::uvec4 draw;        // x: indexCount, y: firstIndex, z: vertexOffset of the mesh
+};
+
+struct RegisteredMesh {
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    glm::mat4 positionDecode;
+};
+
+// Many meshes in one vertex and one index buffer, all of their instances drawn by a single indirect call. Each frame
+// recordCulling dispatches cull-instances.comp, which frustum culls every instance and writes its
+// VkDrawIndexedIndirectCommand, empty when culled. The CPU cost per frame stays the same however many instances there
+// are. Meshes and instances are fixed once build has uploaded them.
+class MeshRegistry : VulkanObject
+{
+private:
+    virtual void cleanup();
+
+    std::vector<RegisteredMesh> meshes;
+    std::vector<PackedVertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<MeshInstanceObject> instances;
+
+    VkBuffer vertexBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory vertexDeviceMemory = VK_NULL_HANDLE;
+    VkBuffer indexBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory indexDeviceMemory = VK_NULL_HANDLE;
+    VkBuffer instanceBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory instanceDeviceMemory = VK_NULL_HANDLE;
+    // written by cull-instances.comp only
+    VkBuffer drawBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory drawDeviceMemory = VK_NULL_HANDLE;
+
+    void createDeviceLocalBuffer(const void* data, VkDeviceSize bufferSize, VkBufferUsageFlags usage, VkBuffer& buffer, VkDeviceMemory& memory);
+
+public:
+    MeshRegistry(VkDevice device, VkPhysicalDevice physicalDevice, VkCommandPool commandPool, VkQueue queue) : VulkanObject(device, physicalDevice, commandPool, queue) {}
+    ~MeshRegistry() { cleanup(); }
+
+    // Through LoadMesh, returns the mesh for addInstance
+    uint32_t addMesh(const std::string& path);
+    uint32_t addInstance(uint32_t mesh, const glm::mat4& model);
+    void build();
+
+    // With a CullShader bound, outside of a render pass. Orders the draws against the cull of the next frame and the
+    // cull against the draws that follow it, the render graph only tracks images.
+    void recordCulling(VkCommandBuffer& commandBuffer);
+    // With MeshShader::bindInstanced
+    void enqueueDrawCommands(VkCommandBuffer& commandBuffer);
+
+    VkBuffer getInstanceBuffer() const { return instanceBuffer; }
+    VkBuffer getDrawBuffer() const { return drawBuffer; }
+    uint32_t getInstanceCount() const { return static_cast<uint32_t>(instances.size()); }
+};
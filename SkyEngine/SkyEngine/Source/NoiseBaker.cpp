@@ -0,0 +1,314 @@
+#include "NoiseBaker.h"
+#include "JobSystem.h"
+#include <emmintrin.h>
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+
+#define NOISE_CACHE_VERSION 1 // bump when the noise functions change, old cache entries are then ignored
+#define CURL_EPS 0.0005f
+
+static const float gradients[12][3] = {
+    { 0.7071f, 0.7071f, 0.0f }, { 0.7071f, -0.7071f, 0.0f }, { -0.7071f, 0.7071f, 0.0f }, { -0.7071f, -0.7071f, 0.0f },
+    { 0.7071f, 0.0f, 0.7071f }, { 0.7071f, 0.0f, -0.7071f }, { -0.7071f, 0.0f, 0.7071f }, { -0.7071f, 0.0f, -0.7071f },
+    { 0.0f, 0.7071f, 0.7071f }, { 0.0f, 0.7071f, -0.7071f }, { 0.0f, -0.7071f, 0.7071f }, { 0.0f, -0.7071f, -0.7071f },
+};
+
+// Integer lattice hash, the same on every platform and thread count
+static inline uint32_t hashLattice(int x, int y, int z, uint32_t seed) {
+    uint32_t h = seed;
+    h ^= static_cast<uint32_t>(x) * 0x8da6b343u;
+    h ^= static_cast<uint32_t>(y) * 0xd8163841u;
+    h ^= static_cast<uint32_t>(z) * 0xcb1ab31fu;
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return h;
+}
+
+static inline int wrap(int i, int period) {
+    const int m = i % period;
+    return m < 0 ? m + period : m;
+}
+
+static inline __m128 floor4(__m128 v) {
+    const __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, v), _mm_set1_ps(1.0f)));
+}
+
+static inline __m128 lerp4(__m128 a, __m128 b, __m128 t) {
+    return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+}
+
+// 6t^5 - 15t^4 + 10t^3
+static inline __m128 fade4(__m128 t) {
+    const __m128 inner = _mm_add_ps(_mm_mul_ps(t, _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f))), _mm_set1_ps(10.0f));
+    return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, t), t), inner);
+}
+
+// Perlin noise of four points in lattice units, tiling every period cells
+static __m128 perlin4(__m128 x, __m128 y, __m128 z, const int period[3], uint32_t seed) {
+    const __m128 fx = floor4(x), fy = floor4(y), fz = floor4(z);
+    const __m128 rx = _mm_sub_ps(x, fx), ry = _mm_sub_ps(y, fy), rz = _mm_sub_ps(z, fz);
+
+    // gradients of the 8 cell corners, hashed per lane
+    alignas(16) float cell[3][4];
+    alignas(16) float grad[8][3][4];
+    _mm_store_ps(cell[0], fx);
+    _mm_store_ps(cell[1], fy);
+    _mm_store_ps(cell[2], fz);
+    for (int lane = 0; lane < 4; lane++) {
+        const int ix = static_cast<int>(cell[0][lane]), iy = static_cast<int>(cell[1][lane]), iz = static_cast<int>(cell[2][lane]);
+        for (int corner = 0; corner < 8; corner++) {
+            const uint32_t h = hashLattice(wrap(ix + (corner & 1), period[0]), wrap(iy + ((corner >> 1) & 1), period[1]), wrap(iz + (corner >> 2), period[2]), seed) % 12;
+            grad[corner][0][lane] = gradients[h][0];
+            grad[corner][1][lane] = gradients[h][1];
+            grad[corner][2][lane] = gradients[h][2];
+        }
+    }
+
+    __m128 n[8];
+    const __m128 one = _mm_set1_ps(1.0f);
+    for (int corner = 0; corner < 8; corner++) {
+        const __m128 ox = (corner & 1) ? _mm_sub_ps(rx, one) : rx;
+        const __m128 oy = ((corner >> 1) & 1) ? _mm_sub_ps(ry, one) : ry;
+        const __m128 oz = (corner >> 2) ? _mm_sub_ps(rz, one) : rz;
+        n[corner] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(grad[corner][0]), ox), _mm_mul_ps(_mm_load_ps(grad[corner][1]), oy)), _mm_mul_ps(_mm_load_ps(grad[corner][2]), oz));
+    }
+
+    const __m128 ux = fade4(rx), uy = fade4(ry), uz = fade4(rz);
+    const __m128 y0 = lerp4(lerp4(n[0], n[1], ux), lerp4(n[2], n[3], ux), uy);
+    const __m128 y1 = lerp4(lerp4(n[4], n[5], ux), lerp4(n[6], n[7], ux), uy);
+    return lerp4(y0, y1, uz);
+}
+
+// F1 cellular noise of four points in lattice units: distance to the nearest feature point, one point per cell
+static __m128 worley4(__m128 x, __m128 y, __m128 z, const int period[3], uint32_t seed) {
+    const __m128 fx = floor4(x), fy = floor4(y), fz = floor4(z);
+    alignas(16) float cell[3][4];
+    _mm_store_ps(cell[0], fx);
+    _mm_store_ps(cell[1], fy);
+    _mm_store_ps(cell[2], fz);
+
+    __m128 nearest = _mm_set1_ps(FLT_MAX);
+    for (int dz = -1; dz <= 1; dz++) {
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                alignas(16) float point[3][4];
+                for (int lane = 0; lane < 4; lane++) {
+                    const int ix = static_cast<int>(cell[0][lane]) + dx, iy = static_cast<int>(cell[1][lane]) + dy, iz = static_cast<int>(cell[2][lane]) + dz;
+                    const uint32_t h = hashLattice(wrap(ix, period[0]), wrap(iy, period[1]), wrap(iz, period[2]), seed);
+                    point[0][lane] = ix + (h & 1023) / 1024.0f;
+                    point[1][lane] = iy + ((h >> 10) & 1023) / 1024.0f;
+                    point[2][lane] = iz + ((h >> 20) & 1023) / 1024.0f;
+                }
+                const __m128 ox = _mm_sub_ps(_mm_load_ps(point[0]), x);
+                const __m128 oy = _mm_sub_ps(_mm_load_ps(point[1]), y);
+                const __m128 oz = _mm_sub_ps(_mm_load_ps(point[2]), z);
+                nearest = _mm_min_ps(nearest, _mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oy, oy)), _mm_mul_ps(oz, oz)));
+            }
+        }
+    }
+    return _mm_sqrt_ps(nearest);
+}
+
+// FBM of four points given in texture space [0, 1), weights halve with every octave
+static __m128 fbm4(bool worley, __m128 x, __m128 y, __m128 z, const NoiseChannelDesc& desc, uint32_t seed) {
+    __m128 sum = _mm_setzero_ps();
+    float weight = 1.0f, totalWeight = 0.0f;
+    for (uint32_t octave = 0; octave < desc.octaves; octave++) {
+        const int period[3] = { static_cast<int>(desc.frequency[0] << octave), static_cast<int>(desc.frequency[1] << octave), static_cast<int>(desc.frequency[2] << octave) };
+        const __m128 px = _mm_mul_ps(x, _mm_set1_ps(static_cast<float>(period[0])));
+        const __m128 py = _mm_mul_ps(y, _mm_set1_ps(static_cast<float>(period[1])));
+        const __m128 pz = _mm_mul_ps(z, _mm_set1_ps(static_cast<float>(period[2])));
+        const __m128 n = worley ? worley4(px, py, pz, period, seed + octave) : perlin4(px, py, pz, period, seed + octave);
+        sum = _mm_add_ps(sum, _mm_mul_ps(n, _mm_set1_ps(weight)));
+        totalWeight += weight;
+        weight *= 0.5f;
+    }
+    return _mm_div_ps(sum, _mm_set1_ps(totalWeight));
+}
+
+static __m128 clamp01(__m128 v) {
+    return _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+}
+
+// One channel at four points in texture space. Curl channels come back unnormalised.
+static __m128 evaluateChannel(const NoiseChannelDesc& desc, __m128 x, __m128 y, __m128 z, uint32_t seed) {
+    const __m128 half = _mm_set1_ps(0.5f), one = _mm_set1_ps(1.0f);
+    switch (desc.type) {
+    case NoiseType::Perlin:
+        return clamp01(_mm_add_ps(half, _mm_mul_ps(half, fbm4(false, x, y, z, desc, seed))));
+    case NoiseType::Worley:
+        return clamp01(_mm_sub_ps(one, fbm4(true, x, y, z, desc, seed)));
+    case NoiseType::PerlinWorley: {
+        // remap(perlin, worley - 1, 1, 0, 1)
+        const __m128 perlin = clamp01(_mm_add_ps(half, _mm_mul_ps(half, fbm4(false, x, y, z, desc, seed))));
+        const __m128 worley = clamp01(_mm_sub_ps(one, fbm4(true, x, y, z, desc, seed ^ 0x9e3779b9u)));
+        return clamp01(_mm_div_ps(_mm_add_ps(_mm_sub_ps(perlin, worley), one), _mm_sub_ps(_mm_set1_ps(2.0f), worley)));
+    }
+    case NoiseType::CurlX:
+    case NoiseType::CurlY:
+    case NoiseType::CurlZ: {
+        // the potential is the same field sampled on three planes, as GenerateCurlNoise does
+        const __m128 eps = _mm_set1_ps(CURL_EPS);
+        auto derivative = [&](__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz) {
+            return _mm_div_ps(_mm_sub_ps(fbm4(false, bx, by, bz, desc, seed), fbm4(false, ax, ay, az, desc, seed)), _mm_set1_ps(2.0f * CURL_EPS));
+        };
+        if (desc.type == NoiseType::CurlX) {
+            const __m128 dzdy = derivative(half, _mm_sub_ps(y, eps), x, half, _mm_add_ps(y, eps), x);
+            const __m128 dydz = derivative(half, y, _mm_sub_ps(x, eps), half, y, _mm_add_ps(x, eps));
+            return _mm_sub_ps(dzdy, dydz);
+        }
+        if (desc.type == NoiseType::CurlY) {
+            const __m128 dxdz = derivative(x, half, _mm_sub_ps(y, eps), x, half, _mm_add_ps(y, eps));
+            const __m128 dzdx = derivative(_mm_sub_ps(x, eps), half, y, _mm_add_ps(x, eps), half, y);
+            return _mm_sub_ps(dxdz, dzdx);
+        }
+        const __m128 dydx = derivative(_mm_sub_ps(x, eps), y, half, _mm_add_ps(x, eps), y, half);
+        const __m128 dxdy = derivative(x, _mm_sub_ps(y, eps), half, x, _mm_add_ps(y, eps), half);
+        return _mm_sub_ps(dydx, dxdy);
+    }
+    default:
+        return _mm_setzero_ps();
+    }
+}
+
+static bool isCurl(NoiseType type) {
+    return type == NoiseType::CurlX || type == NoiseType::CurlY || type == NoiseType::CurlZ;
+}
+
+// FNV-1a of the desc, every member is 32 bit so there is no padding to hash
+std::string NoiseVolumeKey(const NoiseVolumeDesc& desc) {
+    uint64_t hash = 14695981039346656037ull;
+    const uint32_t version = NOISE_CACHE_VERSION;
+    auto add = [&hash](const void* data, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ static_cast<const unsigned char*>(data)[i]) * 1099511628211ull;
+        }
+    };
+    add(&version, sizeof(version));
+    add(&desc, sizeof(desc));
+    std::stringstream ss;
+    ss << "noise-" << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return ss.str();
+}
+
+NoiseVolumeDesc LowResCloudNoise(uint32_t size, uint32_t seed) {
+    NoiseVolumeDesc desc = {};
+    desc.width = desc.height = desc.depth = size;
+    desc.seed = seed;
+    desc.channels = 4;
+    desc.channel[0] = { NoiseType::PerlinWorley, { 4, 4, 4 }, 4 };
+    desc.channel[1] = { NoiseType::Worley, { 4, 4, 4 }, 3 };
+    desc.channel[2] = { NoiseType::Worley, { 8, 8, 8 }, 3 };
+    desc.channel[3] = { NoiseType::Worley, { 16, 16, 16 }, 3 };
+    return desc;
+}
+
+NoiseVolumeDesc HiResCloudNoise(uint32_t size, uint32_t seed) {
+    NoiseVolumeDesc desc = {};
+    desc.width = desc.height = desc.depth = size;
+    desc.seed = seed;
+    desc.channels = 4;
+    desc.channel[0] = { NoiseType::Worley, { 2, 2, 2 }, 3 };
+    desc.channel[1] = { NoiseType::Worley, { 4, 4, 4 }, 3 };
+    desc.channel[2] = { NoiseType::Worley, { 8, 8, 8 }, 3 };
+    return desc;
+}
+
+NoiseVolumeDesc CurlNoise(uint32_t size, uint32_t seed) {
+    NoiseVolumeDesc desc = {};
+    desc.width = desc.height = size;
+    desc.depth = 1;
+    desc.seed = seed;
+    desc.channels = 4;
+    desc.channel[0] = { NoiseType::CurlX, { 3, 3, 3 }, 4 };
+    desc.channel[1] = { NoiseType::CurlY, { 3, 3, 3 }, 4 };
+    desc.channel[2] = { NoiseType::CurlZ, { 3, 3, 3 }, 4 };
+    return desc;
+}
+
+NoiseVolumeDesc CirrusNoise(uint32_t size, uint32_t seed) {
+    NoiseVolumeDesc desc = {};
+    desc.width = desc.height = size;
+    desc.depth = 1;
+    desc.seed = seed;
+    desc.channels = 4;
+    desc.channel[0] = { NoiseType::Perlin, { 2, 16, 1 }, 5 };       // stretched along x
+    desc.channel[1] = { NoiseType::Perlin, { 8, 8, 1 }, 6 };
+    desc.channel[2] = { NoiseType::PerlinWorley, { 4, 4, 1 }, 3 };
+    return desc;
+}
+
+void BakeNoiseVolume(JobSystem& jobs, const NoiseVolumeDesc& desc, const std::string& cacheDir, PackedVolumeHeader& header, std::vector<unsigned char>& texels) {
+    if (desc.width % 4 != 0 || (desc.channels != 1 && desc.channels != 2 && desc.channels != 4)) {
+        throw std::runtime_error("unsupported noise volume layout!");
+    }
+
+    const std::string cachePath = cacheDir + "/" + NoiseVolumeKey(desc);
+    if (LoadPackedVolume(cachePath, desc.channels, header, texels)
+        && header.width == desc.width && header.height == desc.height && header.depth == desc.depth) {
+        return;
+    }
+
+    const uint32_t channels = desc.channels;
+    const size_t count = static_cast<size_t>(desc.width) * desc.height * desc.depth;
+    texels.assign(count * channels, 0);
+    // curl is normalised over the whole image once it is done
+    std::vector<float> curl;
+    bool hasCurl = false;
+    for (uint32_t c = 0; c < channels; c++) {
+        hasCurl = hasCurl || isCurl(desc.channel[c].type);
+    }
+    if (hasCurl) {
+        curl.assign(count * channels, 0.0f);
+    }
+
+    ParallelFor(jobs, desc.height * desc.depth, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t row = begin; row < end; row++) {
+            const __m128 y = _mm_set1_ps((row % desc.height + 0.5f) / desc.height);
+            const __m128 z = _mm_set1_ps((row / desc.height + 0.5f) / desc.depth);
+            for (uint32_t x0 = 0; x0 < desc.width; x0 += 4) {
+                const __m128 x = _mm_div_ps(_mm_add_ps(_mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f), _mm_set1_ps(static_cast<float>(x0))), _mm_set1_ps(static_cast<float>(desc.width)));
+                const size_t first = static_cast<size_t>(row) * desc.width + x0;
+                for (uint32_t c = 0; c < channels; c++) {
+                    alignas(16) float values[4];
+                    _mm_store_ps(values, evaluateChannel(desc.channel[c], x, y, z, desc.seed + 0x632be5abu * c));
+                    for (int lane = 0; lane < 4; lane++) {
+                        if (isCurl(desc.channel[c].type)) {
+                            curl[(first + lane) * channels + c] = values[lane];
+                        }
+                        else {
+                            texels[(first + lane) * channels + c] = static_cast<unsigned char>(values[lane] * 255.0f + 0.5f);
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    for (uint32_t c = 0; hasCurl && c < channels; c++) {
+        if (!isCurl(desc.channel[c].type)) continue;
+        float lo = FLT_MAX, hi = -FLT_MAX;
+        for (size_t i = 0; i < count; i++) {
+            lo = std::min(lo, curl[i * channels + c]);
+            hi = std::max(hi, curl[i * channels + c]);
+        }
+        for (size_t i = 0; i < count; i++) {
+            texels[i * channels + c] = static_cast<unsigned char>((curl[i * channels + c] - lo) / std::max(hi - lo, FLT_EPSILON) * 255.0f + 0.5f);
+        }
+    }
+
+    std::memcpy(header.magic, "SKV1", 4);
+    header.width = desc.width;
+    header.height = desc.height;
+    header.depth = desc.depth;
+    header.channels = channels;
+    WritePackedVolume(cachePath, header, texels);
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "ImageUtils.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Tileable noise for the clouds, evaluated four texels at a time with SSE2 and spread over the job system. A bake is a
+// pure function of its NoiseVolumeDesc, seed included, so BakeNoiseVolume keeps each result on disk under a name
+// hashed from the desc and only bakes what it hasn't seen.
+enum class NoiseType : uint32_t {
+    Zero,
+    Perlin,       // gradient noise FBM, 0.5 centred
+    Worley,       // inverted cellular FBM, 1 on the feature points
+    PerlinWorley, // Perlin eroded by Worley, the billowy base shape
+    CurlX,        // curl of a Perlin FBM potential over the xy plane, 2D only. Remapped to [0, 1] over the image.
+    CurlY,
+    CurlZ
+};
+
+struct NoiseChannelDesc {
+    NoiseType type;
+    uint32_t frequency[3]; // lattice cells across the texture per axis, the noise tiles at the texture's edges
+    uint32_t octaves;      // each doubles the frequency and halves the weight
+};
+
+struct NoiseVolumeDesc {
+    uint32_t width, height, depth; // depth 1 bakes a 2D image. width is a multiple of 4.
+    uint32_t seed;
+    uint32_t channels;             // 1, 2 or 4, like the packed volumes
+    NoiseChannelDesc channel[4];
+};
+
+// Presets for the shipped textures, at any resolution
+NoiseVolumeDesc LowResCloudNoise(uint32_t size, uint32_t seed);  // r: Perlin-Worley base, gba: Worley erosion octaves
+NoiseVolumeDesc HiResCloudNoise(uint32_t size, uint32_t seed);   // rgb: Worley detail octaves
+NoiseVolumeDesc CurlNoise(uint32_t size, uint32_t seed);         // 2D, rgb: curl
+NoiseVolumeDesc CirrusNoise(uint32_t size, uint32_t seed);       // 2D, r: streaky, g: wispy, b: round
+
+// Hash of desc, names its bake in the cache and its volume in TextureCache
+std::string NoiseVolumeKey(const NoiseVolumeDesc& desc);
+
+// Bakes desc, or reads it back from cacheDir when the same desc was baked before. Rows are split across the threads of
+// jobs.
+void BakeNoiseVolume(JobSystem& jobs, const NoiseVolumeDesc& desc, const std::string& cacheDir, PackedVolumeHeader& header, std::vector<unsigned char>& texels);
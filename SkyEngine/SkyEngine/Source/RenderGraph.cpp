@@ -0,0 +1,360 @@
+#include "RenderGraph.h"
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+static const char* queueName(RenderGraphQueue queue) {
+	switch (queue) {
+	case RenderGraphQueue::Compute: return "compute";
+	case RenderGraphQueue::Offscreen: return "offscreen";
+	default: return "present";
+	}
+}
+
+void RenderGraph::setQueue(RenderGraphQueue queue, VkQueue handle, uint32_t family) {
+	queueHandles[static_cast<int>(queue)] = handle;
+	queueFamilies[static_cast<int>(queue)] = family;
+}
+
+RenderGraphResource RenderGraph::importImage(const std::string& name, const std::vector<VkImage>& images, VkImageLayout sampledLayout) {
+	resources.push_back({ name, images, sampledLayout, false, UINT32_MAX, 0 });
+	return static_cast<RenderGraphResource>(resources.size() - 1);
+}
+
+RenderGraphResource RenderGraph::createTransient(const std::string& name) {
+	resources.push_back({ name, {}, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, true, UINT32_MAX, 0 });
+	transients.push_back(static_cast<RenderGraphResource>(resources.size() - 1));
+	return transients.back();
+}
+
+void RenderGraph::setImage(RenderGraphResource resource, VkImage image) {
+	resources[resource].images = { image };
+}
+
+void RenderGraph::addPass(const std::string& name, RenderGraphQueue queue, const std::vector<std::pair<RenderGraphResource, ImageUsage>>& uses, RecordFunction record) {
+	// barriers between command buffers rely on the submission order in drawFrame
+	if (!passes.empty() && queue < passes.back().queue) {
+		throw std::runtime_error("render graph: pass " + name + " is out of submission order!");
+	}
+
+	const uint32_t index = static_cast<uint32_t>(passes.size());
+	for (auto& use : uses) {
+		Resource& resource = resources[use.first];
+		resource.firstPass = std::min(resource.firstPass, index);
+		resource.lastPass = index;
+	}
+
+	Pass pass = {};
+	pass.name = name;
+	pass.queue = queue;
+	pass.uses = uses;
+	pass.record = record;
+	passes.push_back(pass);
+}
+
+// Greedy interval allocation: a transient takes the first block whose last reader has finished before it is written.
+// Passes run in order, so that is enough to keep the lifetimes in one block apart, compile() orders the accesses.
+std::vector<uint32_t> RenderGraph::planAliasing() const {
+	std::vector<uint32_t> order(transients.size());
+	for (uint32_t i = 0; i < order.size(); i++) {
+		order[i] = i;
+	}
+	std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+		return resources[transients[a]].firstPass < resources[transients[b]].firstPass;
+	});
+
+	std::vector<uint32_t> blockOf(transients.size());
+	std::vector<uint32_t> blockLastPass;
+	for (uint32_t i : order) {
+		const Resource& resource = resources[transients[i]];
+		uint32_t block = static_cast<uint32_t>(blockLastPass.size());
+		for (uint32_t b = 0; b < blockLastPass.size(); b++) {
+			if (blockLastPass[b] < resource.firstPass) {
+				block = b;
+				break;
+			}
+		}
+		if (block == blockLastPass.size()) {
+			blockLastPass.push_back(0);
+		}
+		blockLastPass[block] = resource.lastPass;
+		blockOf[i] = block;
+	}
+	return blockOf;
+}
+
+RenderGraph::UsageInfo RenderGraph::describeUsage(const Resource& resource, ImageUsage usage) const {
+	switch (usage) {
+	case ImageUsage::ColorAttachment:
+		return { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, true, true };
+	case ImageUsage::SampledFragment:
+		return { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, resource.sampledLayout, resource.sampledLayout, false, false };
+	case ImageUsage::SampledCompute:
+		return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, resource.sampledLayout, resource.sampledLayout, false, false };
+	case ImageUsage::StorageRead:
+		return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, false, false };
+	case ImageUsage::StorageWrite:
+		return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, true, false };
+	case ImageUsage::StorageReadWrite:
+		return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, true, false };
+	case ImageUsage::TransferSrc:
+		// storage images are copied from in place
+		return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, false, false };
+	default:
+		return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true, true };
+	}
+}
+
+VkImageMemoryBarrier RenderGraph::imageBarrier(VkImage image, VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkImageLayout oldLayout, VkImageLayout newLayout) const {
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcAccessMask = srcAccess;
+	barrier.dstAccessMask = dstAccess;
+	barrier.oldLayout = oldLayout;
+	barrier.newLayout = newLayout;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	return barrier;
+}
+
+void RenderGraph::addQueueEdge(RenderGraphQueue producer, RenderGraphQueue consumer, VkPipelineStageFlags waitStage, bool previousFrame) {
+	for (auto& edge : queueEdges) {
+		if (edge.producer == producer && edge.consumer == consumer && edge.previousFrame == previousFrame) {
+			edge.waitStage |= waitStage;
+			return;
+		}
+	}
+	queueEdges.push_back({ producer, consumer, waitStage, previousFrame });
+}
+
+void RenderGraph::walk(std::vector<UseState>& states, const std::vector<uint32_t>& stateOf, bool emit) {
+	for (uint32_t p = 0; p < passes.size(); p++) {
+		Pass& pass = passes[p];
+		for (auto& use : pass.uses) {
+			const Resource& resource = resources[use.first];
+			UseState& state = states[stateOf[use.first]];
+			const UsageInfo usage = describeUsage(resource, use.second);
+
+			if (resource.transient && p == resource.firstPass) {
+				// whatever the block held before is dead, only the pending accesses to it still matter
+				if (use.second != ImageUsage::ColorAttachment) {
+					throw std::runtime_error("render graph: transient " + resource.name + " is read before it is written!");
+				}
+				state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			}
+
+			const bool layoutChange = usage.layout != VK_IMAGE_LAYOUT_UNDEFINED && usage.layout != state.layout;
+			const bool previousFrame = state.pass >= static_cast<int>(p);
+			const bool crossQueue = state.pass >= 0
+				&& queueHandles[static_cast<int>(state.queue)] != queueHandles[static_cast<int>(pass.queue)];
+			// discarded contents have nothing to hand over
+			const bool crossFamily = crossQueue && !usage.discard
+				&& queueFamilies[static_cast<int>(state.queue)] != queueFamilies[static_cast<int>(pass.queue)];
+			const VkImageLayout oldLayout = usage.discard ? VK_IMAGE_LAYOUT_UNDEFINED : (layoutChange ? state.layout : usage.layout);
+
+			// writes and layout transitions wait for every access since the last write, reads only for the write itself
+			VkPipelineStageFlags srcStages = 0;
+			VkAccessFlags srcAccess = 0;
+			if (usage.write || layoutChange) {
+				srcStages = state.writeStage | state.readStages;
+				srcAccess = state.writeAccess;
+			}
+			else if (state.writeStage != 0 && (state.visibleStages & usage.stage) != usage.stage) {
+				srcStages = state.writeStage;
+				srcAccess = state.writeAccess;
+			}
+
+			if (emit && (srcStages != 0 || layoutChange || crossFamily)) {
+				if (crossQueue) {
+					addQueueEdge(state.queue, pass.queue, usage.stage, previousFrame);
+				}
+
+				if (use.second == ImageUsage::ColorAttachment) {
+					// the render pass waits on everything before it (BOTTOM_OF_PIPE dependency), pending writes still
+					// have to be made available. Aliased memory has no single image to name, so a global barrier.
+					if (srcAccess != 0 && !crossQueue) {
+						VkMemoryBarrier barrier = {};
+						barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+						barrier.srcAccessMask = srcAccess;
+						barrier.dstAccessMask = usage.access;
+						pass.memoryBarriers.push_back(barrier);
+						pass.srcStages |= srcStages;
+						pass.dstStages |= usage.stage;
+					}
+				}
+				else if (crossFamily) {
+					// release after the last pass on the old family, acquire before this one. Both halves
+					// carry the same layout transition, the semaphore between the queues orders them.
+					Pass& producer = passes[state.pass];
+					const VkPipelineStageFlags lastStages = state.writeStage | state.readStages;
+					for (VkImage image : resource.images) {
+						VkImageMemoryBarrier release = imageBarrier(image, srcAccess, 0, oldLayout, usage.layout);
+						release.srcQueueFamilyIndex = queueFamilies[static_cast<int>(state.queue)];
+						release.dstQueueFamilyIndex = queueFamilies[static_cast<int>(pass.queue)];
+						producer.releases.push_back(release);
+
+						VkImageMemoryBarrier acquire = release;
+						acquire.srcAccessMask = 0;
+						acquire.dstAccessMask = usage.access;
+						pass.acquires.push_back(acquire);
+					}
+					producer.releaseStages |= lastStages ? lastStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+					pass.acquireStages |= usage.stage;
+				}
+				else if (crossQueue) {
+					// the semaphore wait already makes the writes visible, only a layout change is left to do
+					if (layoutChange) {
+						for (VkImage image : resource.images) {
+							pass.imageBarriers.push_back(imageBarrier(image, 0, usage.access, oldLayout, usage.layout));
+						}
+						pass.srcStages |= usage.stage;
+						pass.dstStages |= usage.stage;
+					}
+				}
+				else {
+					for (VkImage image : resource.images) {
+						pass.imageBarriers.push_back(imageBarrier(image, srcAccess, usage.access, oldLayout, usage.layout));
+					}
+					pass.srcStages |= srcStages;
+					pass.dstStages |= usage.stage;
+				}
+			}
+
+			if (usage.write) {
+				state.writeStage = usage.stage;
+				state.writeAccess = usage.access & (VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+				state.readStages = 0;
+				state.visibleStages = 0;
+			}
+			else {
+				if (layoutChange) {
+					// the transition is a write of its own, later readers in other stages wait for it
+					state.writeStage |= usage.stage;
+					state.readStages = 0;
+					state.visibleStages = 0;
+				}
+				state.readStages |= usage.stage;
+				if (srcStages != 0 || crossQueue) {
+					state.visibleStages |= usage.stage;
+				}
+			}
+			state.layout = usage.resultLayout;
+			state.pass = static_cast<int>(p);
+			state.queue = pass.queue;
+		}
+	}
+}
+
+// The frame is walked twice. The first walk only finds the state each image is left in at the end of a frame,
+// the second derives the barriers against it so that a frame's first accesses wait on the frame before.
+void RenderGraph::compile() {
+	queueEdges.clear();
+	for (auto& pass : passes) {
+		pass.srcStages = 0;
+		pass.dstStages = 0;
+		pass.memoryBarriers.clear();
+		pass.imageBarriers.clear();
+		pass.acquireStages = 0;
+		pass.acquires.clear();
+		pass.releaseStages = 0;
+		pass.releases.clear();
+	}
+
+	std::vector<uint32_t> blockOf = planAliasing();
+	uint32_t blockCount = 0;
+	for (uint32_t block : blockOf) {
+		blockCount = std::max(blockCount, block + 1);
+	}
+
+	std::vector<UseState> states(resources.size() + blockCount);
+	std::vector<uint32_t> stateOf(resources.size());
+	for (uint32_t r = 0; r < resources.size(); r++) {
+		if (resources[r].images.empty()) {
+			throw std::runtime_error("render graph: no image for " + resources[r].name + "!");
+		}
+		if (resources[r].firstPass == UINT32_MAX) {
+			throw std::runtime_error("render graph: " + resources[r].name + " is never used!");
+		}
+		stateOf[r] = r;
+		// imported images are handed over in the layout they are sampled in
+		states[r].layout = resources[r].transient ? VK_IMAGE_LAYOUT_UNDEFINED : resources[r].sampledLayout;
+	}
+	for (uint32_t t = 0; t < transients.size(); t++) {
+		stateOf[transients[t]] = static_cast<uint32_t>(resources.size()) + blockOf[t];
+	}
+
+	walk(states, stateOf, false);
+	walk(states, stateOf, true);
+}
+
+void RenderGraph::enableTimestamps(RenderGraphQueue queue, VkQueryPool pool) {
+	timestampPools[static_cast<int>(queue)] = pool;
+}
+
+void RenderGraph::record(RenderGraphQueue queue, VkCommandBuffer commandBuffer, uint32_t variant) const {
+	const VkQueryPool timestampPool = timestampPools[static_cast<int>(queue)];
+	for (uint32_t p = 0; p < passes.size(); p++) {
+		const Pass& pass = passes[p];
+		if (pass.queue != queue) {
+			continue;
+		}
+
+		if (timestampPool != VK_NULL_HANDLE) {
+			vkCmdResetQueryPool(commandBuffer, timestampPool, 2 * p, 2);
+		}
+
+		if (!pass.acquires.empty()) {
+			vkCmdPipelineBarrier(commandBuffer, pass.acquireStages, pass.acquireStages, 0,
+				0, nullptr, 0, nullptr, static_cast<uint32_t>(pass.acquires.size()), pass.acquires.data());
+		}
+		if (!pass.memoryBarriers.empty() || !pass.imageBarriers.empty()) {
+			vkCmdPipelineBarrier(commandBuffer, pass.srcStages ? pass.srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, pass.dstStages, 0,
+				static_cast<uint32_t>(pass.memoryBarriers.size()), pass.memoryBarriers.data(),
+				0, nullptr,
+				static_cast<uint32_t>(pass.imageBarriers.size()), pass.imageBarriers.data());
+		}
+
+		if (timestampPool != VK_NULL_HANDLE) {
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampPool, 2 * p);
+		}
+		pass.record(commandBuffer, variant);
+		if (timestampPool != VK_NULL_HANDLE) {
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool, 2 * p + 1);
+		}
+
+		if (!pass.releases.empty()) {
+			vkCmdPipelineBarrier(commandBuffer, pass.releaseStages, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+				0, nullptr, 0, nullptr, static_cast<uint32_t>(pass.releases.size()), pass.releases.data());
+		}
+	}
+}
+
+void RenderGraph::print() const {
+	std::vector<uint32_t> blockOf = planAliasing();
+
+	std::cout << "render graph:" << std::endl;
+	for (const Pass& pass : passes) {
+		std::cout << "  " << pass.name << " [" << queueName(pass.queue) << "]";
+		for (auto& use : pass.uses) {
+			std::cout << " " << resources[use.first].name;
+		}
+		std::cout << " - " << pass.imageBarriers.size() << " image / " << pass.memoryBarriers.size() << " memory barriers";
+		if (!pass.acquires.empty() || !pass.releases.empty()) {
+			std::cout << ", " << pass.acquires.size() << " acquire / " << pass.releases.size() << " release";
+		}
+		std::cout << std::endl;
+	}
+	for (uint32_t t = 0; t < transients.size(); t++) {
+		std::cout << "  " << resources[transients[t]].name << " in block " << blockOf[t] << std::endl;
+	}
+	for (auto& edge : queueEdges) {
+		std::cout << "  " << queueName(edge.producer) << " -> " << queueName(edge.consumer)
+			<< (edge.previousFrame ? " (previous frame)" : "") << " needs a semaphore" << std::endl;
+	}
+}
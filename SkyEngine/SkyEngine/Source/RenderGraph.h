@@ -0,0 +1,136 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <vector>
+#include <string>
+#include <functional>
+
+// Command buffer a pass is recorded into. They are submitted once per frame in this order.
+enum class RenderGraphQueue {
+    Compute = 0,
+    Offscreen,
+    Present,
+    Count
+};
+
+// How a pass touches an image, the stage, access and layout follow from it
+enum class ImageUsage {
+    ColorAttachment,  // offscreen render pass, starts from UNDEFINED and leaves the image in SHADER_READ_ONLY_OPTIMAL
+    SampledFragment,
+    SampledCompute,
+    StorageRead,
+    StorageWrite,
+    StorageReadWrite,
+    TransferSrc,
+    TransferDst       // overwritten whole by a copy, the old contents are discarded
+};
+
+typedef uint32_t RenderGraphResource;
+
+// Passes are added in execution order and declare the images they read and write. compile() derives the barriers,
+// layout transitions and queue family ownership transfers between them, and planAliasing() which transient targets
+// can share memory. The frame loops, so the first use of an image in a frame is ordered against its last use in the
+// frame before. The graph is compiled once at startup. The graphics command buffers are recorded from it then, the
+// compute ones again every frame for their push constants.
+class RenderGraph
+{
+public:
+    // second argument is the variant of the command buffer being recorded (ping-pong index or swapchain image)
+    typedef std::function<void(VkCommandBuffer, uint32_t)> RecordFunction;
+
+    // A dependency between passes on different VkQueues. The graph can't order those with a barrier, the submit
+    // of the consumer has to wait on a semaphore signalled by the producer.
+    struct QueueEdge {
+        RenderGraphQueue producer;
+        RenderGraphQueue consumer;
+        VkPipelineStageFlags waitStage;
+        bool previousFrame; // the producer ran in the frame before, e.g. a read the next frame's write must wait for
+    };
+
+    void setQueue(RenderGraphQueue queue, VkQueue handle, uint32_t family);
+
+    // Persistent images created elsewhere, ping-ponged images are tracked together as one resource
+    RenderGraphResource importImage(const std::string& name, const std::vector<VkImage>& images, VkImageLayout sampledLayout);
+    // Offscreen colour target that only lives within a frame. Its image is created by the caller after planAliasing.
+    RenderGraphResource createTransient(const std::string& name);
+    void setImage(RenderGraphResource resource, VkImage image);
+
+    void addPass(const std::string& name, RenderGraphQueue queue, const std::vector<std::pair<RenderGraphResource, ImageUsage>>& uses, RecordFunction record);
+
+    const std::vector<RenderGraphResource>& getTransients() const { return transients; }
+    const std::string& getName(RenderGraphResource resource) const { return resources[resource].name; }
+    // Memory block index for each entry of getTransients()
+    std::vector<uint32_t> planAliasing() const;
+
+    void compile();
+    void record(RenderGraphQueue queue, VkCommandBuffer commandBuffer, uint32_t variant) const;
+
+    const std::vector<QueueEdge>& getQueueEdges() const { return queueEdges; }
+    void print() const;
+
+    // Brackets every pass on the queue with two timestamps, pass i writes queries 2i and 2i + 1 of pool.
+    // Must be set before recording, the pool needs 2 * getPassCount() queries.
+    void enableTimestamps(RenderGraphQueue queue, VkQueryPool pool);
+    uint32_t getPassCount() const { return static_cast<uint32_t>(passes.size()); }
+    const std::string& getPassName(uint32_t pass) const { return passes[pass].name; }
+    RenderGraphQueue getPassQueue(uint32_t pass) const { return passes[pass].queue; }
+
+private:
+    struct Resource {
+        std::string name;
+        std::vector<VkImage> images;
+        VkImageLayout sampledLayout;
+        bool transient;
+        uint32_t firstPass, lastPass; // within the frame, transients only
+    };
+
+    struct Pass {
+        std::string name;
+        RenderGraphQueue queue;
+        std::vector<std::pair<RenderGraphResource, ImageUsage>> uses;
+        RecordFunction record;
+
+        // derived by compile()
+        VkPipelineStageFlags srcStages, dstStages;
+        std::vector<VkMemoryBarrier> memoryBarriers;
+        std::vector<VkImageMemoryBarrier> imageBarriers;
+        VkPipelineStageFlags acquireStages;
+        std::vector<VkImageMemoryBarrier> acquires;
+        VkPipelineStageFlags releaseStages;
+        std::vector<VkImageMemoryBarrier> releases;
+    };
+
+    // What the last uses of an image (or of an aliased memory block) left behind
+    struct UseState {
+        int pass = -1;
+        RenderGraphQueue queue = RenderGraphQueue::Compute;
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags writeStage = 0;
+        VkAccessFlags writeAccess = 0;
+        VkPipelineStageFlags readStages = 0;   // readers since the last write
+        VkPipelineStageFlags visibleStages = 0; // stages the last write has been made visible to
+    };
+
+    struct UsageInfo {
+        VkPipelineStageFlags stage;
+        VkAccessFlags access;
+        VkImageLayout layout; // UNDEFINED when the render pass does the transition
+        VkImageLayout resultLayout;
+        bool write;
+        bool discard; // old contents are not needed, no ownership transfer and transitions start from UNDEFINED
+    };
+    UsageInfo describeUsage(const Resource& resource, ImageUsage usage) const;
+    // stateOf maps a resource to its slot in states, aliased transients share the slot of their memory block
+    void walk(std::vector<UseState>& states, const std::vector<uint32_t>& stateOf, bool emit);
+    void addQueueEdge(RenderGraphQueue producer, RenderGraphQueue consumer, VkPipelineStageFlags waitStage, bool previousFrame);
+    VkImageMemoryBarrier imageBarrier(VkImage image, VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkImageLayout oldLayout, VkImageLayout newLayout) const;
+
+    VkQueue queueHandles[static_cast<int>(RenderGraphQueue::Count)] = {};
+    uint32_t queueFamilies[static_cast<int>(RenderGraphQueue::Count)] = {};
+    VkQueryPool timestampPools[static_cast<int>(RenderGraphQueue::Count)] = {};
+
+    std::vector<Resource> resources;
+    std::vector<RenderGraphResource> transients;
+    std::vector<Pass> passes;
+    std::vector<QueueEdge> queueEdges;
+};
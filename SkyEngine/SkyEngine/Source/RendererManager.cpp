@@ -15,6 +15,7 @@ void RendererManager::InitCloudRenderer()
 	CreateFloatParams("erosion_rate", 1.0f);
 	CreateFloatParams("extinction", 1.2f);
 	CreateFloatParams("tempfloat", 0.5f);
+	CreateFloatParams("voxel_cloud_count", 2.0f);
 	CreateVectorParams("wind_direction", glm::vec4(1.0f,0.05f,1.0f,0.0f));
 	CreateVectorParams("cloudinfo1", glm::vec4(1.0f, 1.f, 1.0f, 0.0f));
 	CreateVectorParams("cloudinfo2", glm::vec4(0.0f, 0.0f, 0.7f, 0.35f));
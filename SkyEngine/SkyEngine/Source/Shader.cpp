@@ -1,5 +1,7 @@
 #include "Shader.h"
 
+VkPipelineCache Shader::pipelineCache = VK_NULL_HANDLE;
+
 void Shader::cleanup() {
     vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
     vkDestroyDescriptorPool(device, descriptorPool, nullptr);
@@ -26,12 +28,13 @@ VkShaderModule Shader::createShaderModule(const std::vector<char>& code, VkDevic
 void MeshShader::cleanupUniforms() {
     vkDestroyBuffer(device, uniformCameraBuffer, nullptr);
     vkDestroyBuffer(device, uniformModelBuffer, nullptr);
-    vkFreeMemory(device, uniformCameraBufferMemory, nullptr);
-    vkFreeMemory(device, uniformModelBufferMemory, nullptr);
+    FreeTrackedMemory(device, uniformCameraBufferMemory, nullptr);
+    FreeTrackedMemory(device, uniformModelBufferMemory, nullptr);
     vkDestroyBuffer(device, uniformSunBuffer, nullptr);
-    vkFreeMemory(device, uniformSunBufferMemory, nullptr);
+    FreeTrackedMemory(device, uniformSunBufferMemory, nullptr);
     vkDestroyBuffer(device, uniformSkyBuffer, nullptr);
-    vkFreeMemory(device, uniformSkyBufferMemory, nullptr);
+    FreeTrackedMemory(device, uniformSkyBufferMemory, nullptr);
+    vkDestroyPipeline(device, instancedPipeline, nullptr);
 }
 
 void MeshShader::createDescriptorSetLayout() {
@@ -43,9 +46,17 @@ void MeshShader::createDescriptorSetLayout() {
     VkDescriptorSetLayoutBinding samplerLayoutBinding2 = Texture::getLayoutBinding(5);
     VkDescriptorSetLayoutBinding samplerLayoutBinding3 = Texture::getLayoutBinding(6);
     VkDescriptorSetLayoutBinding samplerLayoutBinding4 = Texture::getLayoutBinding(7);
+    samplerLayoutBinding4.descriptorCount = 2; // both weather maps
     VkDescriptorSetLayoutBinding samplerLayoutBinding5 = Texture3D::getLayoutBinding(8);
-
-    std::array<VkDescriptorSetLayoutBinding, 9> bindings = { camLayoutBinding, modelLayoutBinding, sunLayoutBinding, skyLayoutBinding, samplerLayoutBinding, samplerLayoutBinding2, samplerLayoutBinding3, samplerLayoutBinding4, samplerLayoutBinding5 };
+    // MeshRegistry instances, only written by setupInstancing
+    VkDescriptorSetLayoutBinding instanceLayoutBinding = {};
+    instanceLayoutBinding.binding = 9;
+    instanceLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    instanceLayoutBinding.descriptorCount = 1;
+    instanceLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    instanceLayoutBinding.pImmutableSamplers = nullptr;
+
+    std::array<VkDescriptorSetLayoutBinding, 10> bindings = { camLayoutBinding, modelLayoutBinding, sunLayoutBinding, skyLayoutBinding, samplerLayoutBinding, samplerLayoutBinding2, samplerLayoutBinding3, samplerLayoutBinding4, samplerLayoutBinding5, instanceLayoutBinding };
     VkDescriptorSetLayoutCreateInfo layoutInfo = {};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
     layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
@@ -57,7 +68,7 @@ void MeshShader::createDescriptorSetLayout() {
 }
 
 void MeshShader::createDescriptorPool() {
-    std::array<VkDescriptorPoolSize, 6> poolSizes = {};
+    std::array<VkDescriptorPoolSize, 7> poolSizes = {};
     poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     poolSizes[0].descriptorCount = 4;
     poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
@@ -67,9 +78,11 @@ void MeshShader::createDescriptorPool() {
     poolSizes[3].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     poolSizes[3].descriptorCount = 1;
     poolSizes[4].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSizes[4].descriptorCount = 1;
+    poolSizes[4].descriptorCount = 2;
     poolSizes[5].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     poolSizes[5].descriptorCount = 1;
+    poolSizes[6].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[6].descriptorCount = 1;
 
     VkDescriptorPoolCreateInfo poolInfo = {};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
@@ -129,10 +142,13 @@ void MeshShader::createDescriptorSet() {
     imageInfoNormal.imageView = textures[NORMAL]->textureImageView;
     imageInfoNormal.sampler = textures[NORMAL]->textureSampler;
 
-    VkDescriptorImageInfo imageInfoCloudPlacement = {};
-    imageInfoCloudPlacement.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    imageInfoCloudPlacement.imageView = textures[3]->textureImageView;
-    imageInfoCloudPlacement.sampler = textures[3]->textureSampler;
+    // the static placement map in both slots until setWeatherMaps
+    std::array<VkDescriptorImageInfo, 2> imageInfoCloudPlacement = {};
+    for (VkDescriptorImageInfo& info : imageInfoCloudPlacement) {
+        info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        info.imageView = textures[3]->textureImageView;
+        info.sampler = textures[3]->textureSampler;
+    }
 
     VkDescriptorImageInfo imageInfoLoResShape = {};
     imageInfoLoResShape.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
@@ -202,8 +218,8 @@ void MeshShader::createDescriptorSet() {
     descriptorWrites[7].dstBinding = 7;
     descriptorWrites[7].dstArrayElement = 0;
     descriptorWrites[7].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descriptorWrites[7].descriptorCount = 1;
-    descriptorWrites[7].pImageInfo = &imageInfoCloudPlacement;
+    descriptorWrites[7].descriptorCount = static_cast<uint32_t>(imageInfoCloudPlacement.size());
+    descriptorWrites[7].pImageInfo = imageInfoCloudPlacement.data();
 
     descriptorWrites[8].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
     descriptorWrites[8].dstSet = descriptorSet;
@@ -216,8 +232,86 @@ void MeshShader::createDescriptorSet() {
     vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
 }
 
+void MeshShader::setCloudShapeTexture(Texture3D* loResCloudShape) {
+    textures3D[0] = loResCloudShape;
+
+    VkDescriptorImageInfo imageInfoLoResShape = {};
+    imageInfoLoResShape.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    imageInfoLoResShape.imageView = textures3D[0]->textureImageView;
+    imageInfoLoResShape.sampler = textures3D[0]->textureSampler;
+
+    VkWriteDescriptorSet descriptorWrite = {};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = descriptorSet;
+    descriptorWrite.dstBinding = 8;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pImageInfo = &imageInfoLoResShape;
+
+    vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+}
+
+void MeshShader::setWeatherMaps(Texture* weatherMap, Texture* weatherMapNext) {
+    // written by weather-map.comp, they stay in GENERAL
+    std::array<VkDescriptorImageInfo, 2> imageInfos = {};
+    Texture* maps[] = { weatherMap, weatherMapNext };
+    for (uint32_t i = 0; i < 2; i++) {
+        imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        imageInfos[i].imageView = maps[i]->textureImageView;
+        imageInfos[i].sampler = maps[i]->textureSampler;
+    }
+
+    VkWriteDescriptorSet descriptorWrite = {};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = descriptorSet;
+    descriptorWrite.dstBinding = 7;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrite.descriptorCount = static_cast<uint32_t>(imageInfos.size());
+    descriptorWrite.pImageInfo = imageInfos.data();
+
+    vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+}
+
+void MeshShader::setupInstancing(const std::string& vertPath, VkBuffer instanceBuffer) {
+    createVariantPipeline(vertPath, instancedPipeline);
+
+    VkDescriptorBufferInfo instanceBufferInfo = {};
+    instanceBufferInfo.buffer = instanceBuffer;
+    instanceBufferInfo.offset = 0;
+    instanceBufferInfo.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet descriptorWrite = {};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = descriptorSet;
+    descriptorWrite.dstBinding = 9;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pBufferInfo = &instanceBufferInfo;
+
+    vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+}
+
 void MeshShader::createPipeline() {
-    auto vertShaderCode = readFile(shaderFilePaths[0]);
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
+    pipelineLayoutInfo.pPushConstantRanges = 0; // Optional
+
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pipeline layout!");
+    }
+
+    createVariantPipeline(shaderFilePaths[0], pipeline);
+}
+
+// Everything but the vertex shader is shared, and so is the layout
+void MeshShader::createVariantPipeline(const std::string& vertPath, VkPipeline& variantPipeline) {
+    auto vertShaderCode = readFile(vertPath);
     auto fragShaderCode = readFile(shaderFilePaths[1]);
     VkShaderModule vertShaderModule;
     VkShaderModule fragShaderModule;
@@ -238,8 +332,9 @@ void MeshShader::createPipeline() {
 
     VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
 
-    auto bindingDescription = Vertex::getBindingDescription();
-    auto attributeDescriptions = Vertex::getAttributeDescriptions();
+    // meshes from Geometry::setupFromMesh
+    auto bindingDescription = PackedVertex::getBindingDescription();
+    auto attributeDescriptions = PackedVertex::getAttributeDescriptions();
 
     VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
     vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
@@ -307,9 +402,12 @@ void MeshShader::createPipeline() {
     colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA; // Optional
     colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA; // Optional
     colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD; // Optional
-    colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE; // Optional
-    colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
-    colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD; // Optional
+    colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_CONSTANT_ALPHA;
+    colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    // Stored alpha ends up as the sky's minus 2 for every layer drawn over it. The fused post path uses that to tell
+    // geometry apart from sky, whose alpha is the sun visibility in [0, 1], and still gets the sun visibility behind
+    // the geometry back with mod 2. Nothing else reads the mesh alpha.
+    colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_REVERSE_SUBTRACT;
 
     VkPipelineColorBlendStateCreateInfo colorBlending = {};
     colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
@@ -320,18 +418,7 @@ void MeshShader::createPipeline() {
     colorBlending.blendConstants[0] = 1.0f; // Optional
     colorBlending.blendConstants[1] = 1.0f; // Optional
     colorBlending.blendConstants[2] = 1.0f; // Optional
-    colorBlending.blendConstants[3] = 1.0f; // Optional
-
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 1;
-    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
-    pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-    pipelineLayoutInfo.pPushConstantRanges = 0; // Optional
-
-    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create pipeline layout!");
-    }
+    colorBlending.blendConstants[3] = 2.0f; // the alpha subtracted above, the target is float so it isn't clamped
 
     // Initialize depth pass
     VkPipelineDepthStencilStateCreateInfo depthStencil = {};
@@ -364,7 +451,7 @@ void MeshShader::createPipeline() {
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
     pipelineInfo.basePipelineIndex = -1; // Optional
 
-    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+    if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &variantPipeline) != VK_SUCCESS) {
         throw std::runtime_error("failed to create graphics pipeline!");
     }
 
@@ -393,7 +480,10 @@ void BackgroundShader::createDescriptorSetLayout() {
     VkDescriptorSetLayoutBinding samplerLayoutBinding = Texture::getLayoutBinding(0);
     samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-    std::array<VkDescriptorSetLayoutBinding, 1> bindings = { samplerLayoutBinding };
+    std::vector<VkDescriptorSetLayoutBinding> bindings = { samplerLayoutBinding };
+    if (alphaA) {
+        bindings.push_back(Texture::getLayoutBinding(1));
+    }
     VkDescriptorSetLayoutCreateInfo layoutInfo = {};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
     layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
@@ -408,7 +498,7 @@ void BackgroundShader::createDescriptorPool() {
     std::array<VkDescriptorPoolSize, 1> poolSizes = {};
 
     poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSizes[0].descriptorCount = 2;
+    poolSizes[0].descriptorCount = alphaA ? 4 : 2;
 
     VkDescriptorPoolCreateInfo poolInfo = {};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
@@ -439,7 +529,14 @@ void BackgroundShader::createDescriptorSet() {
     imageInfo.imageView = textures[0]->textureImageView;
     imageInfo.sampler = textures[0]->textureSampler;
 
-    std::array<VkWriteDescriptorSet, 1> descriptorWrites = {};
+    VkDescriptorImageInfo alphaInfo = {};
+    alphaInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    if (alphaA) {
+        alphaInfo.imageView = alphaA->textureImageView;
+        alphaInfo.sampler = alphaA->textureSampler;
+    }
+
+    std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
 
     descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
     descriptorWrites[0].dstSet = descriptorSet;
@@ -449,7 +546,16 @@ void BackgroundShader::createDescriptorSet() {
     descriptorWrites[0].descriptorCount = 1;
     descriptorWrites[0].pImageInfo = &imageInfo;
 
-    vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[1].dstSet = descriptorSet;
+    descriptorWrites[1].dstBinding = 1;
+    descriptorWrites[1].dstArrayElement = 0;
+    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrites[1].descriptorCount = 1;
+    descriptorWrites[1].pImageInfo = &alphaInfo;
+
+    uint32_t writeCount = alphaA ? 2 : 1;
+    vkUpdateDescriptorSets(device, writeCount, descriptorWrites.data(), 0, nullptr);
 
     // B
     if (vkAllocateDescriptorSets(device, &allocInfo, &descriptorSetB) != VK_SUCCESS) {
@@ -459,10 +565,15 @@ void BackgroundShader::createDescriptorSet() {
     // Swapped background image
     imageInfo.imageView = textures[1]->textureImageView;
     imageInfo.sampler = textures[1]->textureSampler;
+    if (alphaB) {
+        alphaInfo.imageView = alphaB->textureImageView;
+        alphaInfo.sampler = alphaB->textureSampler;
+    }
 
     descriptorWrites[0].dstSet = descriptorSetB;
+    descriptorWrites[1].dstSet = descriptorSetB;
 
-    vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    vkUpdateDescriptorSets(device, writeCount, descriptorWrites.data(), 0, nullptr);
 
 }
 
@@ -616,7 +727,7 @@ void BackgroundShader::createPipeline() {
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
     pipelineInfo.basePipelineIndex = -1; // Optional
 
-    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+    if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
         throw std::runtime_error("failed to create graphics pipeline!");
     }
 
@@ -632,24 +743,53 @@ void BackgroundShader::createUniformBuffer() {
 
 void ComputeShader::cleanupUniforms() {
     vkDestroyBuffer(device, uniformCameraBuffer, nullptr);
-    vkFreeMemory(device, uniformCameraBufferMemory, nullptr);
+    FreeTrackedMemory(device, uniformCameraBufferMemory, nullptr);
     vkDestroyBuffer(device, uniformCameraBufferPrev, nullptr);
-    vkFreeMemory(device, uniformCameraBufferMemoryPrev, nullptr);
+    FreeTrackedMemory(device, uniformCameraBufferMemoryPrev, nullptr);
 
     vkDestroyBuffer(device, uniformSkyBuffer, nullptr);
-    vkFreeMemory(device, uniformSkyBufferMemory, nullptr);
+    FreeTrackedMemory(device, uniformSkyBufferMemory, nullptr);
     vkDestroyBuffer(device, uniformSunBuffer, nullptr);
-    vkFreeMemory(device, uniformSunBufferMemory, nullptr);
+    FreeTrackedMemory(device, uniformSunBufferMemory, nullptr);
     vkDestroyBuffer(device, uniformCloudRenderBuffer, nullptr);
-    vkFreeMemory(device, uniformCloudRenderBufferMemory, nullptr);
+    FreeTrackedMemory(device, uniformCloudRenderBufferMemory, nullptr);
+    vkDestroyBuffer(device, voxelCloudBuffer, nullptr);
+    FreeTrackedMemory(device, voxelCloudBufferMemory, nullptr);
+    vkDestroyBuffer(device, uniformClipmapBuffer, nullptr);
+    FreeTrackedMemory(device, uniformClipmapBufferMemory, nullptr);
+    vkDestroyBuffer(device, uniformFarFieldBuffer, nullptr);
+    FreeTrackedMemory(device, uniformFarFieldBufferMemory, nullptr);
+    vkDestroyPipeline(device, clipmapPipeline, nullptr);
+    vkDestroyPipeline(device, farFieldPipeline, nullptr);
 
     vkDestroyDescriptorSetLayout(device, storageSetLayout, nullptr);
+
+    if (handlesAllocated) {
+        for (uint32_t handle : { handles.cloudPlacement[0], handles.cloudPlacement[1], handles.nightSkyMap, handles.curlNoise, handles.cirroNoise }) {
+            heap->removeTexture(handle);
+        }
+        heap->removeVolume(handles.lowResCloudShape);
+        heap->removeVolume(handles.hiResCloudShape);
+        heap->removeVolume(handles.voxelBrickAtlas);
+        handlesAllocated = false;
+    }
+    if (farFieldPipeline != VK_NULL_HANDLE) {
+        heap->removeTexture(handles.farFieldPanorama);
+    }
+    if (clipmapPipeline != VK_NULL_HANDLE) {
+        for (uint32_t handle : handles.densityClipmap) {
+            heap->removeVolume(handle);
+        }
+    }
 }
 
 void ComputeShader::createStorageSetLayout() {
     VkDescriptorSetLayoutBinding storageImageLayoutBinding = UniformStorageImageObject::getLayoutBinding(0);
 
-    std::array<VkDescriptorSetLayoutBinding, 1> bindings = { storageImageLayoutBinding };
+    std::vector<VkDescriptorSetLayoutBinding> bindings = { storageImageLayoutBinding };
+    if (storageAlpha) {
+        bindings.push_back(UniformStorageImageObject::getLayoutBinding(1));
+    }
 
     VkDescriptorSetLayoutCreateInfo layoutInfo = {};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -669,33 +809,22 @@ void ComputeShader::createDescriptorSetLayout() {
     VkDescriptorSetLayoutBinding skyLayoutBinding = UniformSkyObject::getLayoutBinding(3);
     VkDescriptorSetLayoutBinding cloudrendererLayoutBinding = UniformSkyObject::getLayoutBinding(4);
 
-    // Cloud placement texture
-    VkDescriptorSetLayoutBinding samplerLayoutBinding = Texture::getLayoutBinding(5);
-    samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-
-    VkDescriptorSetLayoutBinding samplerLayoutBindingNightSky = Texture::getLayoutBinding(6);
-    samplerLayoutBindingNightSky.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-
-    VkDescriptorSetLayoutBinding samplerLayoutBindingCurl = Texture::getLayoutBinding(7);
-    samplerLayoutBindingCurl.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    // The samplers of bindings 5 to 12, 14 and 17 are in the descriptor heap, the rest keep their numbers
 
-    // Low Res cloud shape
-    VkDescriptorSetLayoutBinding samplerLayoutBinding2 = Texture3D::getLayoutBinding(8);
-    // Hi res cloud shape
-    VkDescriptorSetLayoutBinding samplerLayoutBinding3 = Texture3D::getLayoutBinding(9);
+    // voxel cloud instances and their grid
+    VkDescriptorSetLayoutBinding voxelCloudLayoutBinding = VoxelCloudSceneObject::getLayoutBinding(13);
 
-    // cloud cirro texture
-    VkDescriptorSetLayoutBinding samplerLayoutBindingCirro = Texture::getLayoutBinding(10);
-    samplerLayoutBindingCirro.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    // density clipmap levels, written by the clipmap update
+    VkDescriptorSetLayoutBinding clipmapStorageLayoutBinding = UniformStorageImageObject::getLayoutBinding(15);
+    clipmapStorageLayoutBinding.descriptorCount = DENSITY_CLIPMAP_LEVELS;
+    VkDescriptorSetLayoutBinding clipmapUniformLayoutBinding = UniformClipmapObject::getLayoutBinding(16);
 
-    // sdf cloud shape 01
-    VkDescriptorSetLayoutBinding samplerLayoutBinding4 = Texture3D::getLayoutBinding(11);
+    // far field panorama, written a window of tiles at a time
+    VkDescriptorSetLayoutBinding farFieldStorageLayoutBinding = UniformStorageImageObject::getLayoutBinding(18);
+    VkDescriptorSetLayoutBinding farFieldUniformLayoutBinding = UniformFarFieldObject::getLayoutBinding(19);
 
-    // sdf cloud shape 02
-    VkDescriptorSetLayoutBinding samplerLayoutBinding5 = Texture3D::getLayoutBinding(12);
-
-    std::array<VkDescriptorSetLayoutBinding, 13> bindings = { camLayoutBinding, camLayoutBindingPrev, sunLayoutBinding, skyLayoutBinding,cloudrendererLayoutBinding,
-        samplerLayoutBinding, samplerLayoutBindingNightSky, samplerLayoutBindingCurl, samplerLayoutBinding2, samplerLayoutBinding3,samplerLayoutBindingCirro,samplerLayoutBinding4,samplerLayoutBinding5 };
+    std::array<VkDescriptorSetLayoutBinding, 10> bindings = { camLayoutBinding, camLayoutBindingPrev, sunLayoutBinding, skyLayoutBinding,cloudrendererLayoutBinding,
+        voxelCloudLayoutBinding, clipmapStorageLayoutBinding, clipmapUniformLayoutBinding, farFieldStorageLayoutBinding, farFieldUniformLayoutBinding };
 
     VkDescriptorSetLayoutCreateInfo layoutInfo = {};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -710,11 +839,11 @@ void ComputeShader::createDescriptorSetLayout() {
 void ComputeShader::createDescriptorPool() {
     std::array<VkDescriptorPoolSize, 3> poolSizes = {};
     poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-    poolSizes[0].descriptorCount = 2;
+    poolSizes[0].descriptorCount = (storageAlpha ? 4 : 2) + DENSITY_CLIPMAP_LEVELS + 1;
     poolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[1].descriptorCount = 5;
-    poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSizes[2].descriptorCount = 6;
+    poolSizes[1].descriptorCount = 7;
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[2].descriptorCount = 1;
 
     VkDescriptorPoolCreateInfo poolInfo = {};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
@@ -754,7 +883,21 @@ void ComputeShader::createStorageDescriptorSets() {
     imageInfoPrev.imageView = textures[1]->textureImageView;
     imageInfoPrev.sampler = textures[1]->textureSampler;
 
-    std::array<VkWriteDescriptorSet, 1> descriptorWrites = {};
+    // Alpha planes, packed history only
+    VkDescriptorImageInfo alphaInfo = {};
+    VkDescriptorImageInfo alphaInfoPrev = {};
+    if (storageAlpha) {
+        alphaInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        alphaInfo.imageView = storageAlpha->textureImageView;
+        alphaInfo.sampler = storageAlpha->textureSampler;
+
+        alphaInfoPrev.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        alphaInfoPrev.imageView = storageAlphaPrev->textureImageView;
+        alphaInfoPrev.sampler = storageAlphaPrev->textureSampler;
+    }
+    uint32_t writeCount = storageAlpha ? 2 : 1;
+
+    std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
     
     descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
     descriptorWrites[0].dstSet = storageBufferSetA;
@@ -764,7 +907,15 @@ void ComputeShader::createStorageDescriptorSets() {
     descriptorWrites[0].descriptorCount = 1;
     descriptorWrites[0].pImageInfo = &imageInfo;
 
-    vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[1].dstSet = storageBufferSetA;
+    descriptorWrites[1].dstBinding = 1;
+    descriptorWrites[1].dstArrayElement = 0;
+    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    descriptorWrites[1].descriptorCount = 1;
+    descriptorWrites[1].pImageInfo = &alphaInfo;
+
+    vkUpdateDescriptorSets(device, writeCount, descriptorWrites.data(), 0, nullptr);
 
     // B
     if (vkAllocateDescriptorSets(device, &allocInfo, &storageBufferSetB) != VK_SUCCESS) {
@@ -779,7 +930,10 @@ void ComputeShader::createStorageDescriptorSets() {
     descriptorWrites[0].descriptorCount = 1;
     descriptorWrites[0].pImageInfo = &imageInfoPrev;
 
-    vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    descriptorWrites[1].dstSet = storageBufferSetB;
+    descriptorWrites[1].pImageInfo = &alphaInfoPrev;
+
+    vkUpdateDescriptorSets(device, writeCount, descriptorWrites.data(), 0, nullptr);
 
 }
 
@@ -820,51 +974,35 @@ void ComputeShader::createDescriptorSet() {
     cloudRendererInfo.offset = 0;
     cloudRendererInfo.range = sizeof(UniformCloudRendererObject);
 
-    // TODO: other relevant textures
-
-    // Placement Tex
-    VkDescriptorImageInfo imageInfo2 = {};
-    imageInfo2.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    imageInfo2.imageView = textures[2]->textureImageView;
-    imageInfo2.sampler = textures[2]->textureSampler;
-
-    VkDescriptorImageInfo imageInfoNightSky = {};
-    imageInfoNightSky.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    imageInfoNightSky.imageView = textures[3]->textureImageView;
-    imageInfoNightSky.sampler = textures[3]->textureSampler;
-
-    VkDescriptorImageInfo imageInfoCurl = {};
-    imageInfoCurl.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    imageInfoCurl.imageView = textures[4]->textureImageView;
-    imageInfoCurl.sampler = textures[4]->textureSampler;
-
-    VkDescriptorImageInfo imageInfo3 = {};//lowRes 
-    imageInfo3.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    imageInfo3.imageView = textures3D[0]->textureImageView;
-    imageInfo3.sampler = textures3D[0]->textureSampler;
-
-    VkDescriptorImageInfo imageInfo4 = {};//highRes
-    imageInfo4.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    imageInfo4.imageView = textures3D[1]->textureImageView;
-    imageInfo4.sampler = textures3D[1]->textureSampler;
-
-    VkDescriptorImageInfo imageInfoCirro = {};
-    imageInfoCirro.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    imageInfoCirro.imageView = textures[5]->textureImageView;
-    imageInfoCirro.sampler = textures[5]->textureSampler;
-
-    VkDescriptorImageInfo imageInfo5 = {};//sdf_01
-    imageInfo5.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    imageInfo5.imageView = textures3D[2]->textureImageView;
-    imageInfo5.sampler = textures3D[2]->textureSampler;
-
-    VkDescriptorImageInfo imageInfo6 = {};//sdf_02
-    imageInfo6.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    imageInfo6.imageView = textures3D[3]->textureImageView;
-    imageInfo6.sampler = textures3D[3]->textureSampler;
+    VkDescriptorBufferInfo voxelCloudInfo = {};
+    voxelCloudInfo.buffer = voxelCloudBuffer;
+    voxelCloudInfo.offset = 0;
+    voxelCloudInfo.range = sizeof(VoxelCloudSceneObject);
+
+    VkDescriptorBufferInfo clipmapBufferInfo = {};
+    clipmapBufferInfo.buffer = uniformClipmapBuffer;
+    clipmapBufferInfo.offset = 0;
+    clipmapBufferInfo.range = sizeof(UniformClipmapObject);
+
+    VkDescriptorBufferInfo farFieldBufferInfo = {};
+    farFieldBufferInfo.buffer = uniformFarFieldBuffer;
+    farFieldBufferInfo.offset = 0;
+    farFieldBufferInfo.range = sizeof(UniformFarFieldObject);
+
+    // Placement Tex, in both slots until setWeatherMaps
+    handles.cloudPlacement[0] = heap->add(textures[2]);
+    handles.cloudPlacement[1] = heap->add(textures[2]);
+    handles.nightSkyMap = heap->add(textures[3]);
+    handles.curlNoise = heap->add(textures[4]);
+    handles.cirroNoise = heap->add(textures[5]);
+    handles.lowResCloudShape = heap->add(textures3D[0]);
+    handles.hiResCloudShape = heap->add(textures3D[1]);
+    handles.voxelBrickAtlas = heap->add(textures3D[2]);
+    handlesAllocated = true;
 
     //todo: need to resize if descriptset count changed
-    std::array<VkWriteDescriptorSet, 13> descriptorWrites = {};
+    // binding 15 is written by setupDensityClipmap, 18 by setupFarField
+    std::array<VkWriteDescriptorSet, 8> descriptorWrites = {};
 
 
     descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -909,67 +1047,27 @@ void ComputeShader::createDescriptorSet() {
 
     descriptorWrites[5].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
     descriptorWrites[5].dstSet = descriptorSet;
-    descriptorWrites[5].dstBinding = 5;
+    descriptorWrites[5].dstBinding = 13;
     descriptorWrites[5].dstArrayElement = 0;
-    descriptorWrites[5].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrites[5].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
     descriptorWrites[5].descriptorCount = 1;
-    descriptorWrites[5].pImageInfo = &imageInfo2;
+    descriptorWrites[5].pBufferInfo = &voxelCloudInfo;
 
     descriptorWrites[6].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
     descriptorWrites[6].dstSet = descriptorSet;
-    descriptorWrites[6].dstBinding = 6;
+    descriptorWrites[6].dstBinding = 16;
     descriptorWrites[6].dstArrayElement = 0;
-    descriptorWrites[6].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrites[6].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     descriptorWrites[6].descriptorCount = 1;
-    descriptorWrites[6].pImageInfo = &imageInfoNightSky;
+    descriptorWrites[6].pBufferInfo = &clipmapBufferInfo;
 
     descriptorWrites[7].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
     descriptorWrites[7].dstSet = descriptorSet;
-    descriptorWrites[7].dstBinding = 7;
+    descriptorWrites[7].dstBinding = 19;
     descriptorWrites[7].dstArrayElement = 0;
-    descriptorWrites[7].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrites[7].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     descriptorWrites[7].descriptorCount = 1;
-    descriptorWrites[7].pImageInfo = &imageInfoCurl;
-
-    descriptorWrites[8].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[8].dstSet = descriptorSet;
-    descriptorWrites[8].dstBinding = 8;
-    descriptorWrites[8].dstArrayElement = 0;
-    descriptorWrites[8].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descriptorWrites[8].descriptorCount = 1;
-    descriptorWrites[8].pImageInfo = &imageInfo3;
-
-    descriptorWrites[9].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[9].dstSet = descriptorSet;
-    descriptorWrites[9].dstBinding = 9;
-    descriptorWrites[9].dstArrayElement = 0;
-    descriptorWrites[9].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descriptorWrites[9].descriptorCount = 1;
-    descriptorWrites[9].pImageInfo = &imageInfo4;
-
-    descriptorWrites[10].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[10].dstSet = descriptorSet;
-    descriptorWrites[10].dstBinding = 10;
-    descriptorWrites[10].dstArrayElement = 0;
-    descriptorWrites[10].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descriptorWrites[10].descriptorCount = 1;
-    descriptorWrites[10].pImageInfo = &imageInfoCirro;
-
-    descriptorWrites[11].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[11].dstSet = descriptorSet;
-    descriptorWrites[11].dstBinding = 11;
-    descriptorWrites[11].dstArrayElement = 0;
-    descriptorWrites[11].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descriptorWrites[11].descriptorCount = 1;
-    descriptorWrites[11].pImageInfo = &imageInfo5;
-
-    descriptorWrites[12].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[12].dstSet = descriptorSet;
-    descriptorWrites[12].dstBinding = 12;
-    descriptorWrites[12].dstArrayElement = 0;
-    descriptorWrites[12].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descriptorWrites[12].descriptorCount = 1;
-    descriptorWrites[12].pImageInfo = &imageInfo6;
+    descriptorWrites[7].pBufferInfo = &farFieldBufferInfo;
     
     vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
 }
@@ -986,15 +1084,21 @@ void ComputeShader::createPipeline() {
     shaderStageInfo.module = computeShaderModule;
     shaderStageInfo.pName = "main";
 
-    std::vector<VkDescriptorSetLayout> descriptorSetLayouts = { storageSetLayout, storageSetLayout, descriptorSetLayout };
+    std::vector<VkDescriptorSetLayout> descriptorSetLayouts = { storageSetLayout, storageSetLayout, descriptorSetLayout, heap->getLayout() };
+
+    // FrameConstants, then CloudTextureHandles
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(FrameConstants) + sizeof(CloudTextureHandles);
 
     // Create pipeline layout
     VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
     pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
-    pipelineLayoutInfo.pushConstantRangeCount = 0;
-    pipelineLayoutInfo.pPushConstantRanges = 0;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
 
     // Create that layout
     if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
@@ -1012,7 +1116,7 @@ void ComputeShader::createPipeline() {
     pipelineInfo.basePipelineIndex = -1;
 
     // Create that pipeline
-    if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+    if (vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create compute pipeline");
     }
 
@@ -1031,49 +1135,163 @@ void ComputeShader::createUniformBuffer() {
     VulkanObject::createBuffer(skyBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformSkyBuffer, uniformSkyBufferMemory);
     VkDeviceSize cloudRendererSize = sizeof(UniformCloudRendererObject);
     VulkanObject::createBuffer(cloudRendererSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformCloudRenderBuffer, uniformCloudRenderBufferMemory);
+    VulkanObject::createBuffer(sizeof(VoxelCloudSceneObject), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, voxelCloudBuffer, voxelCloudBufferMemory);
+    VulkanObject::createBuffer(sizeof(UniformClipmapObject), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformClipmapBuffer, uniformClipmapBufferMemory);
+    VulkanObject::createBuffer(sizeof(UniformFarFieldObject), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformFarFieldBuffer, uniformFarFieldBufferMemory);
+}
+
+void ComputeShader::setCloudShapeTextures(Texture3D* lowResCloudShapeTex, Texture3D* hiResCloudShapeTex) {
+    textures3D[0] = lowResCloudShapeTex;
+    textures3D[1] = hiResCloudShapeTex;
+
+    heap->update(handles.lowResCloudShape, lowResCloudShapeTex);
+    heap->update(handles.hiResCloudShape, hiResCloudShapeTex);
+}
+
+void ComputeShader::setWeatherMaps(Texture* weatherMap, Texture* weatherMapNext) {
+    // written by weather-map.comp, they stay in GENERAL
+    heap->update(handles.cloudPlacement[0], weatherMap, VK_IMAGE_LAYOUT_GENERAL);
+    heap->update(handles.cloudPlacement[1], weatherMapNext, VK_IMAGE_LAYOUT_GENERAL);
+}
+
+void ComputeShader::createVariantPipeline(const std::string& path, VkPipeline& variantPipeline) {
+    auto computeShaderCode = readFile(path);
+    VkShaderModule computeShaderModule = createShaderModule(computeShaderCode, device);
+
+    VkPipelineShaderStageCreateInfo shaderStageInfo = {};
+    shaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    shaderStageInfo.module = computeShaderModule;
+    shaderStageInfo.pName = "main";
+
+    // shares the layout of the raymarch, it only reads sets 2 and 3
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage = shaderStageInfo;
+    pipelineInfo.layout = pipelineLayout;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = -1;
+
+    if (vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &variantPipeline) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create compute pipeline");
+    }
+
+    vkDestroyShaderModule(device, computeShaderModule, nullptr);
+}
+
+void ComputeShader::setupDensityClipmap(std::string path, const std::array<Texture3D*, DENSITY_CLIPMAP_LEVELS>& levels) {
+    createVariantPipeline(path, clipmapPipeline);
+
+    // written and sampled every frame, they stay in GENERAL
+    std::array<VkDescriptorImageInfo, DENSITY_CLIPMAP_LEVELS> storageInfos = {};
+    for (uint32_t i = 0; i < DENSITY_CLIPMAP_LEVELS; i++) {
+        handles.densityClipmap[i] = heap->add(levels[i], VK_IMAGE_LAYOUT_GENERAL);
+
+        storageInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        storageInfos[i].imageView = levels[i]->storageImageView;
+    }
+
+    VkWriteDescriptorSet descriptorWrite = {};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = descriptorSet;
+    descriptorWrite.dstBinding = 15;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    descriptorWrite.descriptorCount = static_cast<uint32_t>(storageInfos.size());
+    descriptorWrite.pImageInfo = storageInfos.data();
+
+    vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+}
+
+void ComputeShader::updateDensityClipmap(const UniformClipmapObject& clipmap) {
+    void* data;
+    vkMapMemory(device, uniformClipmapBufferMemory, 0, sizeof(clipmap), 0, &data);
+    memcpy(data, &clipmap, sizeof(clipmap));
+    vkUnmapMemory(device, uniformClipmapBufferMemory);
+}
+
+void ComputeShader::setupFarField(std::string path, Texture* panorama) {
+    createVariantPipeline(path, farFieldPipeline);
+
+    // like the clipmap, GENERAL throughout
+    handles.farFieldPanorama = heap->add(panorama, VK_IMAGE_LAYOUT_GENERAL);
+
+    VkDescriptorImageInfo storageInfo = {};
+    storageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    storageInfo.imageView = panorama->storageImageView;
+
+    VkWriteDescriptorSet descriptorWrite = {};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = descriptorSet;
+    descriptorWrite.dstBinding = 18;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pImageInfo = &storageInfo;
+
+    vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+}
+
+void ComputeShader::updateFarField(const UniformFarFieldObject& farField) {
+    void* data;
+    vkMapMemory(device, uniformFarFieldBufferMemory, 0, sizeof(farField), 0, &data);
+    memcpy(data, &farField, sizeof(farField));
+    vkUnmapMemory(device, uniformFarFieldBufferMemory);
+}
+
+// Rebuilt on the CPU every frame, small enough to go up like the uniforms
+void ComputeShader::updateVoxelClouds(const VoxelCloudSceneObject& scene) {
+    void* data;
+    vkMapMemory(device, voxelCloudBufferMemory, 0, sizeof(scene), 0, &data);
+    memcpy(data, &scene, sizeof(scene));
+    vkUnmapMemory(device, voxelCloudBufferMemory);
 }
 
 void ComputeShader::updateUniformBuffers(UniformCameraObject &cam, UniformCameraObject &camPrev, UniformSkyObject &sky, UniformSunObject &sun,UniformCloudRendererObject &cloudrenderer) {
-    UniformCameraObject a = cam;
-    UniformSunObject b = sun;
-    UniformSkyObject c = sky;
-    UniformCloudRendererObject d = cloudrenderer;
-    UniformCameraObject dc = camPrev;
-    
     void* data;
     vkMapMemory(device, uniformCameraBufferMemory, 0, sizeof(cam), 0, &data);
     memcpy(data, &cam, sizeof(cam));
     vkUnmapMemory(device, uniformCameraBufferMemory);
 
-    void* data2;
-    vkMapMemory(device, uniformSkyBufferMemory, 0, sizeof(c), 0, &data2);
-    memcpy(data2, &c, sizeof(c));
-    vkUnmapMemory(device, uniformSkyBufferMemory);
-
-    void* data3;
-    vkMapMemory(device, uniformSunBufferMemory, 0, sizeof(b), 0, &data3);
-    memcpy(data3, &b, sizeof(b));
-    vkUnmapMemory(device, uniformSunBufferMemory);
-
-    void* data5;
-    vkMapMemory(device, uniformCloudRenderBufferMemory, 0, sizeof(d), 0, &data5);
-    memcpy(data5, &d, sizeof(d));
-    vkUnmapMemory(device, uniformCloudRenderBufferMemory);
-
     void* data4;
     vkMapMemory(device, uniformCameraBufferMemoryPrev, 0, sizeof(camPrev), 0, &data4);
     memcpy(data4, &camPrev, sizeof(camPrev));
     vkUnmapMemory(device, uniformCameraBufferMemoryPrev);
 
+    // the per frame state is pushed, these only change with the sun and the parameters of the panel
+    if (!uniformsUploaded || memcmp(&sky, &uploadedSky, sizeof(sky)) != 0) {
+        void* data2;
+        vkMapMemory(device, uniformSkyBufferMemory, 0, sizeof(sky), 0, &data2);
+        memcpy(data2, &sky, sizeof(sky));
+        vkUnmapMemory(device, uniformSkyBufferMemory);
+        uploadedSky = sky;
+    }
+
+    if (!uniformsUploaded || memcmp(&sun, &uploadedSun, sizeof(sun)) != 0) {
+        void* data3;
+        vkMapMemory(device, uniformSunBufferMemory, 0, sizeof(sun), 0, &data3);
+        memcpy(data3, &sun, sizeof(sun));
+        vkUnmapMemory(device, uniformSunBufferMemory);
+        uploadedSun = sun;
+    }
+
+    if (!uniformsUploaded || memcmp(&cloudrenderer, &uploadedCloudRenderer, sizeof(cloudrenderer)) != 0) {
+        void* data5;
+        vkMapMemory(device, uniformCloudRenderBufferMemory, 0, sizeof(cloudrenderer), 0, &data5);
+        memcpy(data5, &cloudrenderer, sizeof(cloudrenderer));
+        vkUnmapMemory(device, uniformCloudRenderBufferMemory);
+        uploadedCloudRenderer = cloudrenderer;
+    }
+    uniformsUploaded = true;
 }
 
 /// Post Process Shader
 
 void PostProcessShader::cleanupUniforms() {
     vkDestroyBuffer(device, uniformCameraBuffer, nullptr);
-    vkFreeMemory(device, uniformCameraBufferMemory, nullptr);
+    FreeTrackedMemory(device, uniformCameraBufferMemory, nullptr);
     vkDestroyBuffer(device, uniformSunBuffer, nullptr);
-    vkFreeMemory(device, uniformSunBufferMemory, nullptr);
+    FreeTrackedMemory(device, uniformSunBufferMemory, nullptr);
 }
 
 void PostProcessShader::createDescriptorSetLayout() {
@@ -1313,7 +1531,7 @@ void PostProcessShader::createPipeline() {
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
     pipelineInfo.basePipelineIndex = -1; // Optional
 
-    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+    if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
         throw std::runtime_error("failed to create graphics pipeline!");
     }
 
@@ -1351,13 +1569,13 @@ void PostProcessShader::updateUniformBuffers(UniformCameraObject &cam, UniformSu
 void ReprojectShader::cleanupUniforms() {
     
     vkDestroyBuffer(device, uniformSkyBuffer, nullptr);
-    vkFreeMemory(device, uniformSkyBufferMemory, nullptr);
+    FreeTrackedMemory(device, uniformSkyBufferMemory, nullptr);
     vkDestroyBuffer(device, uniformSunBuffer, nullptr);
-    vkFreeMemory(device, uniformSunBufferMemory, nullptr);
+    FreeTrackedMemory(device, uniformSunBufferMemory, nullptr);
     vkDestroyBuffer(device, uniformCameraBuffer, nullptr);
-    vkFreeMemory(device, uniformCameraBufferMemory, nullptr);
+    FreeTrackedMemory(device, uniformCameraBufferMemory, nullptr);
     vkDestroyBuffer(device, uniformCameraBufferPrev, nullptr);
-    vkFreeMemory(device, uniformCameraBufferMemoryPrev, nullptr);
+    FreeTrackedMemory(device, uniformCameraBufferMemoryPrev, nullptr);
 
     vkDestroyDescriptorSetLayout(device, uniformSetLayout, nullptr);
 }
@@ -1365,7 +1583,10 @@ void ReprojectShader::cleanupUniforms() {
 void ReprojectShader::createDescriptorSetLayout() {
     VkDescriptorSetLayoutBinding samplerLayoutBinding = UniformStorageImageObject::getLayoutBinding(0);
 
-    std::array<VkDescriptorSetLayoutBinding, 1> bindings = { samplerLayoutBinding };
+    std::vector<VkDescriptorSetLayoutBinding> bindings = { samplerLayoutBinding };
+    if (alphaA) {
+        bindings.push_back(UniformStorageImageObject::getLayoutBinding(1));
+    }
     VkDescriptorSetLayoutCreateInfo layoutInfo = {};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
     layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
@@ -1400,15 +1621,23 @@ void ReprojectShader::updateUniformBuffers(UniformCameraObject& cam, UniformCame
     memcpy(data, &cam, sizeof(cam));
     vkUnmapMemory(device, uniformCameraBufferMemory);
 
-    void* data2;
-    vkMapMemory(device, uniformSkyBufferMemory, 0, sizeof(sky), 0, &data2);
-    memcpy(data2, &sky, sizeof(sky));
-    vkUnmapMemory(device, uniformSkyBufferMemory);
+    // as for the raymarch, only when they change
+    if (!uniformsUploaded || memcmp(&sky, &uploadedSky, sizeof(sky)) != 0) {
+        void* data2;
+        vkMapMemory(device, uniformSkyBufferMemory, 0, sizeof(sky), 0, &data2);
+        memcpy(data2, &sky, sizeof(sky));
+        vkUnmapMemory(device, uniformSkyBufferMemory);
+        uploadedSky = sky;
+    }
 
-    void* data3;
-    vkMapMemory(device, uniformSunBufferMemory, 0, sizeof(sun), 0, &data3);
-    memcpy(data3, &sun, sizeof(sun));
-    vkUnmapMemory(device, uniformSunBufferMemory);
+    if (!uniformsUploaded || memcmp(&sun, &uploadedSun, sizeof(sun)) != 0) {
+        void* data3;
+        vkMapMemory(device, uniformSunBufferMemory, 0, sizeof(sun), 0, &data3);
+        memcpy(data3, &sun, sizeof(sun));
+        vkUnmapMemory(device, uniformSunBufferMemory);
+        uploadedSun = sun;
+    }
+    uniformsUploaded = true;
 
     void* data4;
     vkMapMemory(device, uniformCameraBufferMemoryPrev, 0, sizeof(camPrev), 0, &data4);
@@ -1421,7 +1650,7 @@ void ReprojectShader::createDescriptorPool() {
     std::array<VkDescriptorPoolSize, 2> poolSizes = {};
 
     poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-    poolSizes[0].descriptorCount = 2;
+    poolSizes[0].descriptorCount = alphaA ? 4 : 2;
     poolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     poolSizes[1].descriptorCount = 4;
 
@@ -1454,7 +1683,14 @@ void ReprojectShader::createDescriptorSet() {
     imageInfo.imageView = textures[0]->textureImageView;
     imageInfo.sampler = textures[0]->textureSampler;
 
-    std::array<VkWriteDescriptorSet, 1> descriptorWrites = {};
+    VkDescriptorImageInfo alphaInfo = {};
+    alphaInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    if (alphaA) {
+        alphaInfo.imageView = alphaA->textureImageView;
+        alphaInfo.sampler = alphaA->textureSampler;
+    }
+
+    std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
 
     descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
     descriptorWrites[0].dstSet = descriptorSet;
@@ -1464,7 +1700,16 @@ void ReprojectShader::createDescriptorSet() {
     descriptorWrites[0].descriptorCount = 1;
     descriptorWrites[0].pImageInfo = &imageInfo;
 
-    vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[1].dstSet = descriptorSet;
+    descriptorWrites[1].dstBinding = 1;
+    descriptorWrites[1].dstArrayElement = 0;
+    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    descriptorWrites[1].descriptorCount = 1;
+    descriptorWrites[1].pImageInfo = &alphaInfo;
+
+    uint32_t writeCount = alphaA ? 2 : 1;
+    vkUpdateDescriptorSets(device, writeCount, descriptorWrites.data(), 0, nullptr);
 
     // B
     if (vkAllocateDescriptorSets(device, &allocInfo, &descriptorSetB) != VK_SUCCESS) {
@@ -1474,10 +1719,15 @@ void ReprojectShader::createDescriptorSet() {
     // Swapped background image
     imageInfo.imageView = textures[1]->textureImageView;
     imageInfo.sampler = textures[1]->textureSampler;
+    if (alphaB) {
+        alphaInfo.imageView = alphaB->textureImageView;
+        alphaInfo.sampler = alphaB->textureSampler;
+    }
 
     descriptorWrites[0].dstSet = descriptorSetB;
+    descriptorWrites[1].dstSet = descriptorSetB;
 
-    vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    vkUpdateDescriptorSets(device, writeCount, descriptorWrites.data(), 0, nullptr);
 
     // other uniform writes
     VkDescriptorSetLayout layoutsU[] = { uniformSetLayout };
@@ -1573,13 +1823,18 @@ void ReprojectShader::createPipeline() {
 
     std::vector<VkDescriptorSetLayout> descriptorSetLayouts = { descriptorSetLayout, descriptorSetLayout, uniformSetLayout };
 
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(FrameConstants);
+
     // Create pipeline layout
     VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
     pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
-    pipelineLayoutInfo.pushConstantRangeCount = 0;
-    pipelineLayoutInfo.pPushConstantRanges = 0;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
 
     // Create that layout
     if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
@@ -1597,10 +1852,751 @@ void ReprojectShader::createPipeline() {
     pipelineInfo.basePipelineIndex = -1;
 
     // Create that pipeline
-    if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+    if (vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create compute pipeline");
     }
 
     // No longer need shader module
     vkDestroyShaderModule(device, computeShaderModule, nullptr);
-}
\ No newline at end of file
+}
+
+/// Composite shader
+
+void CompositeShader::createDescriptorSetLayout() {
+    VkDescriptorSetLayoutBinding samplerLayoutBinding = Texture::getLayoutBinding(0);
+    VkDescriptorSetLayoutBinding camLayoutBinding = UniformCameraObject::getLayoutBinding(1);
+    VkDescriptorSetLayoutBinding sunLayoutBinding = UniformSunObject::getLayoutBinding(2);
+    VkDescriptorSetLayoutBinding shaftLayoutBinding = Texture::getLayoutBinding(3);
+
+    std::array<VkDescriptorSetLayoutBinding, 4> bindings = { samplerLayoutBinding, camLayoutBinding, sunLayoutBinding, shaftLayoutBinding };
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor set layout!");
+    }
+}
+
+void CompositeShader::createDescriptorPool() {
+    std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER; // scene, light shafts
+    poolSizes[0].descriptorCount = 2;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER; // camera, sun
+    poolSizes[1].descriptorCount = 2;
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = 1;
+
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor pool!");
+    }
+}
+
+void CompositeShader::createDescriptorSet() {
+    // Bindings 0 - 2 are the same as any other post process shader
+    PostProcessShader::createDescriptorSet();
+
+    VkDescriptorImageInfo shaftImageInfo = {};
+    shaftImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    shaftImageInfo.imageView = textures[0]->textureImageView;
+    shaftImageInfo.sampler = textures[0]->textureSampler;
+
+    VkWriteDescriptorSet descriptorWrite = {};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = descriptorSet;
+    descriptorWrite.dstBinding = 3;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pImageInfo = &shaftImageInfo;
+
+    vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+}
+
+
+/// Light shaft shader
+
+void LightShaftShader::cleanupUniforms() {
+    vkDestroyBuffer(device, uniformCameraBuffer, nullptr);
+    FreeTrackedMemory(device, uniformCameraBufferMemory, nullptr);
+    vkDestroyBuffer(device, uniformSunBuffer, nullptr);
+    FreeTrackedMemory(device, uniformSunBufferMemory, nullptr);
+}
+
+void LightShaftShader::createDescriptorSetLayout() {
+    VkDescriptorSetLayoutBinding samplerLayoutBinding = Texture::getLayoutBinding(0);
+    samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    VkDescriptorSetLayoutBinding shaftLayoutBinding = UniformStorageImageObject::getLayoutBinding(1);
+    VkDescriptorSetLayoutBinding camLayoutBinding = UniformCameraObject::getLayoutBinding(2);
+    VkDescriptorSetLayoutBinding sunLayoutBinding = UniformSunObject::getLayoutBinding(3);
+
+    std::array<VkDescriptorSetLayoutBinding, 4> bindings = { samplerLayoutBinding, shaftLayoutBinding, camLayoutBinding, sunLayoutBinding };
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor set layout!");
+    }
+}
+
+void LightShaftShader::createDescriptorPool() {
+    std::array<VkDescriptorPoolSize, 3> poolSizes = {};
+
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[0].descriptorCount = 1;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSizes[1].descriptorCount = 1;
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER; // camera, sun
+    poolSizes[2].descriptorCount = 2;
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = 1;
+
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor pool!");
+    }
+}
+
+void LightShaftShader::createDescriptorSet() {
+    VkDescriptorSetLayout layouts[] = { descriptorSetLayout };
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = layouts;
+
+    if (vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate descriptor set!");
+    }
+
+    VkDescriptorImageInfo shaftImageInfo = {};
+    shaftImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    shaftImageInfo.imageView = textures[0]->textureImageView;
+    shaftImageInfo.sampler = textures[0]->textureSampler;
+
+    VkDescriptorBufferInfo cameraBufferInfo = {};
+    cameraBufferInfo.buffer = uniformCameraBuffer;
+    cameraBufferInfo.offset = 0;
+    cameraBufferInfo.range = sizeof(UniformCameraObject);
+
+    VkDescriptorBufferInfo sunBufferInfo = {};
+    sunBufferInfo.buffer = uniformSunBuffer;
+    sunBufferInfo.offset = 0;
+    sunBufferInfo.range = sizeof(UniformSunObject);
+
+    std::array<VkWriteDescriptorSet, 4> descriptorWrites = {};
+
+    descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[0].dstSet = descriptorSet;
+    descriptorWrites[0].dstBinding = 0;
+    descriptorWrites[0].dstArrayElement = 0;
+    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrites[0].descriptorCount = 1;
+    descriptorWrites[0].pImageInfo = descriptorImageInfo;
+
+    descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[1].dstSet = descriptorSet;
+    descriptorWrites[1].dstBinding = 1;
+    descriptorWrites[1].dstArrayElement = 0;
+    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    descriptorWrites[1].descriptorCount = 1;
+    descriptorWrites[1].pImageInfo = &shaftImageInfo;
+
+    descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[2].dstSet = descriptorSet;
+    descriptorWrites[2].dstBinding = 2;
+    descriptorWrites[2].dstArrayElement = 0;
+    descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    descriptorWrites[2].descriptorCount = 1;
+    descriptorWrites[2].pBufferInfo = &cameraBufferInfo;
+
+    descriptorWrites[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[3].dstSet = descriptorSet;
+    descriptorWrites[3].dstBinding = 3;
+    descriptorWrites[3].dstArrayElement = 0;
+    descriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    descriptorWrites[3].descriptorCount = 1;
+    descriptorWrites[3].pBufferInfo = &sunBufferInfo;
+
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
+
+void LightShaftShader::createUniformBuffer() {
+    VkDeviceSize camBufferSize = sizeof(UniformCameraObject);
+    VulkanObject::createBuffer(camBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformCameraBuffer, uniformCameraBufferMemory);
+
+    VkDeviceSize sunBufferSize = sizeof(UniformSunObject);
+    VulkanObject::createBuffer(sunBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformSunBuffer, uniformSunBufferMemory);
+}
+
+void LightShaftShader::updateUniformBuffers(UniformCameraObject& cam, UniformSunObject& sun) {
+    void* data;
+    vkMapMemory(device, uniformCameraBufferMemory, 0, sizeof(cam), 0, &data);
+    memcpy(data, &cam, sizeof(cam));
+    vkUnmapMemory(device, uniformCameraBufferMemory);
+
+    void* data2;
+    vkMapMemory(device, uniformSunBufferMemory, 0, sizeof(sun), 0, &data2);
+    memcpy(data2, &sun, sizeof(sun));
+    vkUnmapMemory(device, uniformSunBufferMemory);
+}
+
+void LightShaftShader::createPipeline() {
+    auto computeShaderCode = readFile(shaderFilePaths[0]);
+    VkShaderModule computeShaderModule = createShaderModule(computeShaderCode, device);
+
+    VkPipelineShaderStageCreateInfo shaderStageInfo = {};
+    shaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    shaderStageInfo.module = computeShaderModule;
+    shaderStageInfo.pName = "main";
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 0;
+    pipelineLayoutInfo.pPushConstantRanges = 0;
+
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline layout");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage = shaderStageInfo;
+    pipelineInfo.layout = pipelineLayout;
+    pipelineInfo.pNext = nullptr;
+    pipelineInfo.flags = 0;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = -1;
+
+    if (vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create compute pipeline");
+    }
+
+    vkDestroyShaderModule(device, computeShaderModule, nullptr);
+}
+
+
+/// Noise shader
+
+void NoiseShader::cleanupUniforms() {
+    vkDestroyBuffer(device, uniformNoiseBuffer, nullptr);
+    FreeTrackedMemory(device, uniformNoiseBufferMemory, nullptr);
+    vkDestroyQueryPool(device, queryPool, nullptr);
+}
+
+void NoiseShader::createDescriptorSetLayout() {
+    VkDescriptorSetLayoutBinding noiseLayoutBinding = UniformNoiseObject::getLayoutBinding(0);
+    VkDescriptorSetLayoutBinding volumeLayoutBinding = UniformStorageImageObject::getLayoutBinding(1);
+
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings = { noiseLayoutBinding, volumeLayoutBinding };
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor set layout!");
+    }
+}
+
+void NoiseShader::createDescriptorPool() {
+    std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[0].descriptorCount = 1;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSizes[1].descriptorCount = 1;
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = 1;
+
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor pool!");
+    }
+}
+
+// The volume is only known in generate, which writes binding 1
+void NoiseShader::createDescriptorSet() {
+    VkDescriptorSetLayout layouts[] = { descriptorSetLayout };
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = layouts;
+
+    if (vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate descriptor set!");
+    }
+
+    VkDescriptorBufferInfo noiseBufferInfo = {};
+    noiseBufferInfo.buffer = uniformNoiseBuffer;
+    noiseBufferInfo.offset = 0;
+    noiseBufferInfo.range = sizeof(UniformNoiseObject);
+
+    VkWriteDescriptorSet descriptorWrite = {};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = descriptorSet;
+    descriptorWrite.dstBinding = 0;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pBufferInfo = &noiseBufferInfo;
+
+    vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+}
+
+void NoiseShader::createUniformBuffer() {
+    VkDeviceSize noiseBufferSize = sizeof(UniformNoiseObject);
+    VulkanObject::createBuffer(noiseBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformNoiseBuffer, uniformNoiseBufferMemory);
+
+    VkQueryPoolCreateInfo queryPoolInfo = {};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = 2;
+
+    if (vkCreateQueryPool(device, &queryPoolInfo, nullptr, &queryPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create query pool!");
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    timestampPeriod = properties.limits.timestampPeriod;
+}
+
+float NoiseShader::generate(Texture3D* target, const NoiseVolumeDesc& desc) {
+    UniformNoiseObject noise = {};
+    noise.size = glm::uvec4(desc.width, desc.height, desc.depth, desc.seed);
+    for (uint32_t c = 0; c < desc.channels; c++) {
+        const NoiseChannelDesc& channel = desc.channel[c];
+        if (channel.type != NoiseType::Zero && channel.type != NoiseType::Perlin && channel.type != NoiseType::Worley && channel.type != NoiseType::PerlinWorley) {
+            throw std::runtime_error("noise type not supported on the GPU!");
+        }
+        noise.types[c] = static_cast<uint32_t>(channel.type);
+        noise.octaves[c] = channel.octaves;
+        noise.frequency[c] = glm::uvec4(channel.frequency[0], channel.frequency[1], channel.frequency[2], 0);
+    }
+
+    void* data;
+    vkMapMemory(device, uniformNoiseBufferMemory, 0, sizeof(noise), 0, &data);
+    memcpy(data, &noise, sizeof(noise));
+    vkUnmapMemory(device, uniformNoiseBufferMemory);
+
+    VkDescriptorImageInfo volumeImageInfo = {};
+    volumeImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    volumeImageInfo.imageView = target->storageImageView;
+    volumeImageInfo.sampler = VK_NULL_HANDLE;
+
+    VkWriteDescriptorSet descriptorWrite = {};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = descriptorSet;
+    descriptorWrite.dstBinding = 1;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pImageInfo = &volumeImageInfo;
+
+    vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+
+    // noise-volume.comp runs 4x4x4 workgroups
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+    vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+    bindShader(commandBuffer);
+    vkCmdDispatch(commandBuffer, (desc.width + 3) / 4, (desc.height + 3) / 4, (desc.depth + 3) / 4);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+    endSingleTimeCommands(commandBuffer);
+
+    uint64_t timestamps[2] = {};
+    vkGetQueryPoolResults(device, queryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+
+    target->finishStorageWrites();
+    return static_cast<float>(timestamps[1] - timestamps[0]) * timestampPeriod / 1000000.0f;
+}
+
+void NoiseShader::createPipeline() {
+    auto computeShaderCode = readFile(shaderFilePaths[0]);
+    VkShaderModule computeShaderModule = createShaderModule(computeShaderCode, device);
+
+    VkPipelineShaderStageCreateInfo shaderStageInfo = {};
+    shaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    shaderStageInfo.module = computeShaderModule;
+    shaderStageInfo.pName = "main";
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 0;
+    pipelineLayoutInfo.pPushConstantRanges = 0;
+
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline layout");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage = shaderStageInfo;
+    pipelineInfo.layout = pipelineLayout;
+    pipelineInfo.pNext = nullptr;
+    pipelineInfo.flags = 0;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = -1;
+
+    if (vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create compute pipeline");
+    }
+
+    vkDestroyShaderModule(device, computeShaderModule, nullptr);
+}
+
+
+/// Weather shader
+
+void WeatherShader::cleanupUniforms() {
+    vkDestroyBuffer(device, uniformWeatherBuffer, nullptr);
+    FreeTrackedMemory(device, uniformWeatherBufferMemory, nullptr);
+}
+
+void WeatherShader::createDescriptorSetLayout() {
+    VkDescriptorSetLayoutBinding weatherLayoutBinding = UniformWeatherObject::getLayoutBinding(0);
+    VkDescriptorSetLayoutBinding outputLayoutBinding = UniformStorageImageObject::getLayoutBinding(1);
+    VkDescriptorSetLayoutBinding inputLayoutBinding = Texture::getLayoutBinding(2);
+    inputLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    std::array<VkDescriptorSetLayoutBinding, 3> bindings = { weatherLayoutBinding, outputLayoutBinding, inputLayoutBinding };
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor set layout!");
+    }
+}
+
+void WeatherShader::createDescriptorPool() {
+    std::array<VkDescriptorPoolSize, 3> poolSizes = {};
+
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[0].descriptorCount = 2;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSizes[1].descriptorCount = 2;
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[2].descriptorCount = 2;
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = 2;
+
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor pool!");
+    }
+}
+
+void WeatherShader::createDescriptorSet() {
+    VkDescriptorSetLayout layouts[] = { descriptorSetLayout, descriptorSetLayout };
+    VkDescriptorSet sets[2];
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = 2;
+    allocInfo.pSetLayouts = layouts;
+
+    if (vkAllocateDescriptorSets(device, &allocInfo, sets) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate descriptor set!");
+    }
+    descriptorSet = sets[0];
+    descriptorSetB = sets[1];
+
+    VkDescriptorBufferInfo weatherBufferInfo = {};
+    weatherBufferInfo.buffer = uniformWeatherBuffer;
+    weatherBufferInfo.offset = 0;
+    weatherBufferInfo.range = sizeof(UniformWeatherObject);
+
+    // set A reads textures[0] and writes textures[1], set B the other way round
+    std::array<VkDescriptorImageInfo, 2> outputImageInfos = {};
+    std::array<VkDescriptorImageInfo, 2> inputImageInfos = {};
+    std::array<VkWriteDescriptorSet, 6> descriptorWrites = {};
+    for (uint32_t i = 0; i < 2; i++) {
+        outputImageInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        outputImageInfos[i].imageView = textures[1 - i]->textureImageView;
+        outputImageInfos[i].sampler = VK_NULL_HANDLE;
+
+        inputImageInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        inputImageInfos[i].imageView = textures[i]->textureImageView;
+        inputImageInfos[i].sampler = textures[i]->textureSampler;
+
+        VkWriteDescriptorSet* writes = &descriptorWrites[3 * i];
+        writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[0].dstSet = sets[i];
+        writes[0].dstBinding = 0;
+        writes[0].dstArrayElement = 0;
+        writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        writes[0].descriptorCount = 1;
+        writes[0].pBufferInfo = &weatherBufferInfo;
+
+        writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[1].dstSet = sets[i];
+        writes[1].dstBinding = 1;
+        writes[1].dstArrayElement = 0;
+        writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        writes[1].descriptorCount = 1;
+        writes[1].pImageInfo = &outputImageInfos[i];
+
+        writes[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[2].dstSet = sets[i];
+        writes[2].dstBinding = 2;
+        writes[2].dstArrayElement = 0;
+        writes[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[2].descriptorCount = 1;
+        writes[2].pImageInfo = &inputImageInfos[i];
+    }
+
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
+
+void WeatherShader::createUniformBuffer() {
+    VkDeviceSize weatherBufferSize = sizeof(UniformWeatherObject);
+    VulkanObject::createBuffer(weatherBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformWeatherBuffer, uniformWeatherBufferMemory);
+}
+
+void WeatherShader::updateUniformBuffers(UniformWeatherObject& weather) {
+    void* data;
+    vkMapMemory(device, uniformWeatherBufferMemory, 0, sizeof(weather), 0, &data);
+    memcpy(data, &weather, sizeof(weather));
+    vkUnmapMemory(device, uniformWeatherBufferMemory);
+}
+
+// A tile evolved long enough ago just takes its target, so both maps come out the same
+void WeatherShader::initialize(float time, glm::vec2 windOffset, uint32_t tileSize) {
+    const uint32_t tilesPerRow = extent.width / tileSize;
+    const uint32_t tileCount = tilesPerRow * (extent.height / tileSize);
+
+    UniformWeatherObject weather = {};
+    weather.params = glm::vec4(time, 1.0e6f, windOffset.x, windOffset.y);
+    weather.tiles = glm::uvec4(0, tileCount, 0, tilesPerRow);
+    updateUniformBuffers(weather);
+
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+    bindShader(commandBuffer, 0);
+    vkCmdDispatch(commandBuffer, tileCount, 1, 1);
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    bindShader(commandBuffer, 1);
+    vkCmdDispatch(commandBuffer, tileCount, 1, 1);
+    endSingleTimeCommands(commandBuffer);
+}
+
+void WeatherShader::createPipeline() {
+    auto computeShaderCode = readFile(shaderFilePaths[0]);
+    VkShaderModule computeShaderModule = createShaderModule(computeShaderCode, device);
+
+    VkPipelineShaderStageCreateInfo shaderStageInfo = {};
+    shaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    shaderStageInfo.module = computeShaderModule;
+    shaderStageInfo.pName = "main";
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 0;
+    pipelineLayoutInfo.pPushConstantRanges = 0;
+
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline layout");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage = shaderStageInfo;
+    pipelineInfo.layout = pipelineLayout;
+    pipelineInfo.pNext = nullptr;
+    pipelineInfo.flags = 0;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = -1;
+
+    if (vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create compute pipeline");
+    }
+
+    vkDestroyShaderModule(device, computeShaderModule, nullptr);
+}
+
+void CullShader::cleanupUniforms() {
+    vkDestroyBuffer(device, uniformCullBuffer, nullptr);
+    FreeTrackedMemory(device, uniformCullBufferMemory, nullptr);
+}
+
+void CullShader::createDescriptorSetLayout() {
+    VkDescriptorSetLayoutBinding cullLayoutBinding = UniformCullObject::getLayoutBinding(0);
+
+    VkDescriptorSetLayoutBinding instanceLayoutBinding = {};
+    instanceLayoutBinding.binding = 1;
+    instanceLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    instanceLayoutBinding.descriptorCount = 1;
+    instanceLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    instanceLayoutBinding.pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayoutBinding drawLayoutBinding = instanceLayoutBinding;
+    drawLayoutBinding.binding = 2;
+
+    std::array<VkDescriptorSetLayoutBinding, 3> bindings = { cullLayoutBinding, instanceLayoutBinding, drawLayoutBinding };
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor set layout!");
+    }
+}
+
+void CullShader::createDescriptorPool() {
+    std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[0].descriptorCount = 1;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[1].descriptorCount = 2;
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = 1;
+
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor pool!");
+    }
+}
+
+void CullShader::createDescriptorSet() {
+    VkDescriptorSetLayout layouts[] = { descriptorSetLayout };
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = layouts;
+
+    if (vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate descriptor set!");
+    }
+
+    VkDescriptorBufferInfo cullBufferInfo = {};
+    cullBufferInfo.buffer = uniformCullBuffer;
+    cullBufferInfo.offset = 0;
+    cullBufferInfo.range = sizeof(UniformCullObject);
+
+    VkDescriptorBufferInfo instanceBufferInfo = {};
+    instanceBufferInfo.buffer = instanceBuffer;
+    instanceBufferInfo.offset = 0;
+    instanceBufferInfo.range = VK_WHOLE_SIZE;
+
+    VkDescriptorBufferInfo drawBufferInfo = {};
+    drawBufferInfo.buffer = drawBuffer;
+    drawBufferInfo.offset = 0;
+    drawBufferInfo.range = VK_WHOLE_SIZE;
+
+    std::array<VkWriteDescriptorSet, 3> descriptorWrites = {};
+
+    descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[0].dstSet = descriptorSet;
+    descriptorWrites[0].dstBinding = 0;
+    descriptorWrites[0].dstArrayElement = 0;
+    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    descriptorWrites[0].descriptorCount = 1;
+    descriptorWrites[0].pBufferInfo = &cullBufferInfo;
+
+    descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[1].dstSet = descriptorSet;
+    descriptorWrites[1].dstBinding = 1;
+    descriptorWrites[1].dstArrayElement = 0;
+    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrites[1].descriptorCount = 1;
+    descriptorWrites[1].pBufferInfo = &instanceBufferInfo;
+
+    descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[2].dstSet = descriptorSet;
+    descriptorWrites[2].dstBinding = 2;
+    descriptorWrites[2].dstArrayElement = 0;
+    descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrites[2].descriptorCount = 1;
+    descriptorWrites[2].pBufferInfo = &drawBufferInfo;
+
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
+
+void CullShader::createUniformBuffer() {
+    VkDeviceSize cullBufferSize = sizeof(UniformCullObject);
+    VulkanObject::createBuffer(cullBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformCullBuffer, uniformCullBufferMemory);
+}
+
+void CullShader::updateUniformBuffers(UniformCullObject& cull) {
+    void* data;
+    vkMapMemory(device, uniformCullBufferMemory, 0, sizeof(cull), 0, &data);
+    memcpy(data, &cull, sizeof(cull));
+    vkUnmapMemory(device, uniformCullBufferMemory);
+}
+
+void CullShader::createPipeline() {
+    auto computeShaderCode = readFile(shaderFilePaths[0]);
+    VkShaderModule computeShaderModule = createShaderModule(computeShaderCode, device);
+
+    VkPipelineShaderStageCreateInfo shaderStageInfo = {};
+    shaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    shaderStageInfo.module = computeShaderModule;
+    shaderStageInfo.pName = "main";
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 0;
+    pipelineLayoutInfo.pPushConstantRanges = 0;
+
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline layout");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage = shaderStageInfo;
+    pipelineInfo.layout = pipelineLayout;
+    pipelineInfo.pNext = nullptr;
+    pipelineInfo.flags = 0;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = -1;
+
+    if (vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create compute pipeline");
+    }
+
+    vkDestroyShaderModule(device, computeShaderModule, nullptr);
+}
@@ -1,7 +1,10 @@
 #pragma once
 #include "Texture.h"
+#include "DescriptorHeap.h"
 #include "Geometry.h"
 #include "SkyManager.h"
+#include "VoxelClouds.h"
+#include "NoiseBaker.h"
 #include <fstream>
 
 // Need to move this
@@ -40,6 +43,130 @@ struct UniformCameraObject {
     }
 };
 
+// NoiseVolumeDesc as noise-volume.comp reads it, one component per channel
+struct UniformNoiseObject {
+    glm::uvec4 size;          // xyz: extent, w: seed
+    glm::uvec4 types;         // NoiseType
+    glm::uvec4 octaves;
+    glm::uvec4 frequency[4];  // xyz
+
+    static VkDescriptorSetLayoutBinding getLayoutBinding(uint32_t bind)
+    {
+        VkDescriptorSetLayoutBinding uboLayoutBinding = {};
+        uboLayoutBinding.binding = bind;
+        uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        uboLayoutBinding.descriptorCount = 1;
+        uboLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        uboLayoutBinding.pImmutableSamplers = nullptr;
+
+        return uboLayoutBinding;
+    }
+};
+
+// Tile window of weather-map.comp for one frame
+struct UniformWeatherObject {
+    glm::vec4 params; // x: time, y: seconds since the evolved tiles were last evolved, zw: wind offset in uv
+    glm::uvec4 tiles; // x: first evolved tile, y: evolved tiles, z: first copied tile, w: tiles per row
+
+    static VkDescriptorSetLayoutBinding getLayoutBinding(uint32_t bind)
+    {
+        VkDescriptorSetLayoutBinding uboLayoutBinding = {};
+        uboLayoutBinding.binding = bind;
+        uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        uboLayoutBinding.descriptorCount = 1;
+        uboLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        uboLayoutBinding.pImmutableSamplers = nullptr;
+
+        return uboLayoutBinding;
+    }
+};
+
+// Density clipmap of compute-clouds.comp, nested windows of cells around the camera
+#define DENSITY_CLIPMAP_LEVELS 3 // set in compute-clouds shader at the same time
+#define DENSITY_CLIPMAP_SIZE 64  // cells per axis of every level, likewise
+#define DENSITY_CLIPMAP_LEVEL_SCALE 4 // each level has cells this many times larger than the one inside it
+#define DENSITY_CLIPMAP_WORKGROUP_SIZE 4
+
+struct UniformClipmapObject {
+    glm::ivec4 origin[DENSITY_CLIPMAP_LEVELS];         // xyz: first cell of the window of each level
+    glm::ivec4 previousOrigin[DENSITY_CLIPMAP_LEVELS]; // window of the update before, cells outside it are evaluated
+    glm::vec4 params; // x: cell size of level 0 in metres, y: first refreshed column, z: refreshed columns, w: 1 to sample the clipmap
+
+    static VkDescriptorSetLayoutBinding getLayoutBinding(uint32_t bind)
+    {
+        VkDescriptorSetLayoutBinding uboLayoutBinding = {};
+        uboLayoutBinding.binding = bind;
+        uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        uboLayoutBinding.descriptorCount = 1;
+        uboLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        uboLayoutBinding.pImmutableSamplers = nullptr;
+
+        return uboLayoutBinding;
+    }
+};
+
+// Window of far field tiles of compute-clouds.comp FAR_FIELD for one frame
+struct UniformFarFieldObject {
+    glm::vec4 params; // x: distance the far field starts at, y: metres both marches cross-fade over, w: 1 when the panorama is complete
+    glm::uvec4 tiles; // x: first tile of this frame, y: tiles per row
+
+    static VkDescriptorSetLayoutBinding getLayoutBinding(uint32_t bind)
+    {
+        VkDescriptorSetLayoutBinding uboLayoutBinding = {};
+        uboLayoutBinding.binding = bind;
+        uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        uboLayoutBinding.descriptorCount = 1;
+        uboLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        uboLayoutBinding.pImmutableSamplers = nullptr;
+
+        return uboLayoutBinding;
+    }
+};
+
+#define FRAME_DEBUG_VOXEL_CLOUD_BOUNDS 1 // outline the boxes of the voxel clouds, render mode 1
+
+// Push constants of the reproject and cloud kernels, at offset 0. State that changes every frame, the compute command
+// buffer of a frame is recorded again with it (VulkanApplication::recordComputeCommandBuffer).
+struct FrameConstants {
+    uint32_t frameIndex;    // frames since startup
+    float time;             // what the wind offsets scale with
+    glm::ivec2 pixelOffset; // pixel of every 4x4 block the raymarch refreshes this frame
+    glm::vec2 resolution;   // of the cloud history
+    uint32_t debugFlags;    // FRAME_DEBUG_*
+    float pad;
+};
+
+// Push constants of compute-clouds.comp after FrameConstants, where its textures are in the descriptor heap
+struct CloudTextureHandles {
+    uint32_t cloudPlacement[2]; // both weather maps
+    uint32_t nightSkyMap;
+    uint32_t curlNoise;
+    uint32_t cirroNoise;
+    uint32_t farFieldPanorama;
+    uint32_t lowResCloudShape; // volumes from here on
+    uint32_t hiResCloudShape;
+    uint32_t voxelBrickAtlas;
+    uint32_t densityClipmap[DENSITY_CLIPMAP_LEVELS];
+};
+
+// Camera cull-instances.comp culls the instances of a MeshRegistry against
+struct UniformCullObject {
+    glm::mat4 viewProj;
+    glm::uvec4 counts; // x: instances
+
+    static VkDescriptorSetLayoutBinding getLayoutBinding(uint32_t bind)
+    {
+        VkDescriptorSetLayoutBinding uboLayoutBinding = {};
+        uboLayoutBinding.binding = bind;
+        uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        uboLayoutBinding.descriptorCount = 1;
+        uboLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        uboLayoutBinding.pImmutableSamplers = nullptr;
+
+        return uboLayoutBinding;
+    }
+};
+
 struct UniformModelObject {
     glm::mat4 model;
     glm::mat4 invTranspose;
@@ -118,6 +245,10 @@ public:
         cleanup();
     }
 
+    // Every pipeline is created against it, set before the first shader. Vulkan synchronizes pipeline caches itself,
+    // shaders may be created on several threads at once as long as each is only touched by one.
+    static VkPipelineCache pipelineCache;
+
     // Must set the render pass for shaders before pipeline creation.
     void setRenderPass(VkRenderPass* renderPass) { this->renderPass = renderPass; }
     
@@ -153,6 +284,7 @@ protected:
     virtual void createUniformBuffer();
 
     virtual void createPipeline();
+    void createVariantPipeline(const std::string& vertPath, VkPipeline& variantPipeline);
 
     UniformCameraObject cameraUniforms;
     UniformModelObject modelUniforms;
@@ -168,6 +300,8 @@ protected:
     VkBuffer uniformSkyBuffer;
     VkDeviceMemory uniformSkyBufferMemory;
 
+    VkPipeline instancedPipeline = VK_NULL_HANDLE;
+
     virtual void cleanupUniforms();
 public:
     void setupShader(std::string vertPath, std::string fragPath) {
@@ -195,6 +329,14 @@ public:
 
     virtual ~MeshShader() { cleanupUniforms(); }
 
+    // Points binding 8 at a regenerated volume. The device must be idle and the command buffers re-recorded.
+    void setCloudShapeTexture(Texture3D* loResCloudShape);
+    // Points the two elements of binding 7 at the weather maps, sky.weather_map picks one
+    void setWeatherMaps(Texture* weatherMap, Texture* weatherMapNext);
+    // model.vert INSTANCED, which takes its transforms from the instances of a MeshRegistry at binding 9 instead of
+    // binding 1
+    void setupInstancing(const std::string& vertPath, VkBuffer instanceBuffer);
+
     void updateUniformBuffers(UniformCameraObject cam, UniformModelObject model, UniformSunObject sun, UniformSkyObject sky) {
         void* data;
         vkMapMemory(device, uniformCameraBufferMemory, 0, sizeof(cam), 0, &data);
@@ -218,6 +360,10 @@ public:
         vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
         vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
     }
+    // Same descriptor set, binding it again is left out
+    void bindInstanced(VkCommandBuffer& commandBuffer) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, instancedPipeline);
+    }
 };
 
 /*
@@ -241,6 +387,10 @@ protected:
 
     VkDescriptorSet descriptorSetB; // draws a different texture every other frame
     bool swappedBuffers = false;
+
+    // R8 alpha planes of a packed cloud history (HISTORY_FORMAT_R11G11B10_A8), null otherwise
+    Texture* alphaA = nullptr;
+    Texture* alphaB = nullptr;
 public:
     void setupShader(std::string vertPath, std::string fragPath) {
         shaderFilePaths.push_back(vertPath);
@@ -254,8 +404,9 @@ public:
     }
 
     BackgroundShader(VkDevice device, VkPhysicalDevice physicalDevice, VkCommandPool commandPool, VkQueue queue, VkExtent2D extent) : Shader(device, physicalDevice, commandPool, queue, extent) {}
-    BackgroundShader(VkDevice device, VkPhysicalDevice physicalDevice, VkCommandPool commandPool, VkQueue queue, VkExtent2D extent, VkRenderPass *renderPass, std::string vertPath, std::string fragPath, Texture* texA, Texture* texB) :
-        Shader(device, physicalDevice, commandPool, queue, extent) {
+    BackgroundShader(VkDevice device, VkPhysicalDevice physicalDevice, VkCommandPool commandPool, VkQueue queue, VkExtent2D extent, VkRenderPass *renderPass, std::string vertPath, std::string fragPath, Texture* texA, Texture* texB,
+                     Texture* alphaA = nullptr, Texture* alphaB = nullptr) :
+        Shader(device, physicalDevice, commandPool, queue, extent), alphaA(alphaA), alphaB(alphaB) {
         this->renderPass = renderPass;
         addTexture(texA);
         addTexture(texB);
@@ -313,6 +464,41 @@ protected:
     VkDeviceMemory uniformSkyBufferMemory;
     VkBuffer uniformCloudRenderBuffer;
     VkDeviceMemory uniformCloudRenderBufferMemory;
+    VkBuffer voxelCloudBuffer;
+    VkDeviceMemory voxelCloudBufferMemory;
+    VkBuffer uniformClipmapBuffer;
+    VkDeviceMemory uniformClipmapBufferMemory;
+    VkBuffer uniformFarFieldBuffer;
+    VkDeviceMemory uniformFarFieldBufferMemory;
+
+    // Sampled images come from the descriptor heap, bound as set 3, at the handles in the push constants. The slots
+    // are the shader's own, rewritten in place when a texture changes so the handles stay.
+    DescriptorHeap* heap;
+    CloudTextureHandles handles = {};
+    bool handlesAllocated = false; // by createDescriptorSet, not by the short constructor
+    void bindTextures(VkCommandBuffer& commandBuffer) {
+        VkDescriptorSet heapSet = heap->getSet();
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 3, 1, &heapSet, 0, nullptr);
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(frame), &frame);
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, sizeof(FrameConstants), sizeof(handles), &handles);
+    }
+    FrameConstants frame = {};
+
+    // what the kernel read last, the buffers are only written again when the value changes
+    bool uniformsUploaded = false;
+    UniformSkyObject uploadedSky;
+    UniformSunObject uploadedSun;
+    UniformCloudRendererObject uploadedCloudRenderer;
+
+    // CLIPMAP_UPDATE and FAR_FIELD variants of the same shader, same layout, sets 2 and 3 only
+    VkPipeline clipmapPipeline = VK_NULL_HANDLE;
+    VkPipeline farFieldPipeline = VK_NULL_HANDLE;
+    void createVariantPipeline(const std::string& path, VkPipeline& variantPipeline);
+    void bindVariant(VkCommandBuffer& commandBuffer, VkPipeline variantPipeline) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, variantPipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 2, 1, &descriptorSet, 0, nullptr);
+        bindTextures(commandBuffer);
+    }
 
     // need sets to ping-pong image buffers
     VkDescriptorSetLayout storageSetLayout;
@@ -322,6 +508,10 @@ protected:
     void createStorageSetLayout();
     void createStorageDescriptorSets();
 
+    // R8 alpha planes of a packed cloud history, bound next to the colour image in the storage sets
+    Texture* storageAlpha = nullptr;
+    Texture* storageAlphaPrev = nullptr;
+
     bool swappedBuffers = false;
 public:
     void setupShader(std::string path) {
@@ -336,11 +526,12 @@ public:
         createStorageDescriptorSets();
     }
 
-    ComputeShader(VkDevice device, VkPhysicalDevice physicalDevice, VkCommandPool commandPool, VkQueue queue, VkExtent2D extent) : Shader(device, physicalDevice, commandPool, queue, extent) {}
-    ComputeShader(VkDevice device, VkPhysicalDevice physicalDevice, VkCommandPool commandPool, VkQueue queue, VkExtent2D extent,
-                  VkRenderPass *renderPass, std::string path, Texture* storageTex, Texture* storageTexPrev, Texture* placementTex, Texture* nightSkyTex, Texture* curlTexture,Texture* cirroTexture, Texture3D* lowResCloudShapeTex, Texture3D* hiResCloudShapeTex, Texture3D* sdfCloudShapeTex_01, Texture3D* sdfCloudShapeTex_02) :
+    ComputeShader(VkDevice device, VkPhysicalDevice physicalDevice, VkCommandPool commandPool, VkQueue queue, VkExtent2D extent, DescriptorHeap* heap) : Shader(device, physicalDevice, commandPool, queue, extent), heap(heap) {}
+    ComputeShader(VkDevice device, VkPhysicalDevice physicalDevice, VkCommandPool commandPool, VkQueue queue, VkExtent2D extent, DescriptorHeap* heap,
+                  VkRenderPass *renderPass, std::string path, Texture* storageTex, Texture* storageTexPrev, Texture* placementTex, Texture* nightSkyTex, Texture* curlTexture,Texture* cirroTexture, Texture3D* lowResCloudShapeTex, Texture3D* hiResCloudShapeTex, Texture3D* voxelBrickAtlasTex,
+                  Texture* storageAlpha = nullptr, Texture* storageAlphaPrev = nullptr) :
 
-        Shader(device, physicalDevice, commandPool, queue, extent) {
+        Shader(device, physicalDevice, commandPool, queue, extent), heap(heap), storageAlpha(storageAlpha), storageAlphaPrev(storageAlphaPrev) {
         this->renderPass = renderPass;
         // Note: This texture is intended to be written to. In this application, it is set to be the sampled texture of a separate BackgroundShader.
         addTexture(storageTex);
@@ -351,8 +542,7 @@ public:
         addTexture(cirroTexture);
         addTexture3D(lowResCloudShapeTex);
         addTexture3D(hiResCloudShapeTex);
-        addTexture3D(sdfCloudShapeTex_01);
-        addTexture3D(sdfCloudShapeTex_02);
+        addTexture3D(voxelBrickAtlasTex);
         setupShader(path);
         swappedBuffers = false;
     }
@@ -360,11 +550,32 @@ public:
     virtual ~ComputeShader() { cleanupUniforms(); }
 
     void updateUniformBuffers(UniformCameraObject& cam, UniformCameraObject& camPrev, UniformSkyObject& sky, UniformSunObject& sun, UniformCloudRendererObject& cloudrenderer);
+    void updateVoxelClouds(const VoxelCloudSceneObject& scene);
+    // Points the cloud shape slots at regenerated volumes. The device must be idle, recorded command buffers stay valid.
+    void setCloudShapeTextures(Texture3D* lowResCloudShapeTex, Texture3D* hiResCloudShapeTex);
+    // Points the two cloud placement slots at the weather maps, sky.weather_map picks one
+    void setWeatherMaps(Texture* weatherMap, Texture* weatherMapNext);
+    // Creates the pipeline of the clipmap update, adds the levels to the heap and points binding 15 at them. Before
+    // any recording.
+    void setupDensityClipmap(std::string path, const std::array<Texture3D*, DENSITY_CLIPMAP_LEVELS>& levels);
+    void updateDensityClipmap(const UniformClipmapObject& clipmap);
+    void bindClipmapUpdate(VkCommandBuffer& commandBuffer) { bindVariant(commandBuffer, clipmapPipeline); }
+    // Likewise for the far field panorama, binding 18
+    void setupFarField(std::string path, Texture* panorama);
+    void updateFarField(const UniformFarFieldObject& farField);
+    void bindFarField(VkCommandBuffer& commandBuffer) { bindVariant(commandBuffer, farFieldPipeline); }
+    // Pushed by the bind calls of the next recording
+    void setFrameConstants(const FrameConstants& constants) { frame = constants; }
     void bindShader(VkCommandBuffer& commandBuffer) override {
+        bindShader(commandBuffer, swappedBuffers ? 1 : 0);
+        swappedBuffers = !swappedBuffers;
+    }
+    // variant: compute command buffer 0 writes the first image of the ping-pong pair, 1 the second
+    void bindShader(VkCommandBuffer& commandBuffer, uint32_t variant) {
 
         vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
         
-        if (swappedBuffers) {
+        if (variant == 1) {
             vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &storageBufferSetB, 0, nullptr);
             vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 1, 1, &storageBufferSetA, 0, nullptr);
 
@@ -376,8 +587,7 @@ public:
         }
 
         vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 2, 1, &descriptorSet, 0, nullptr);
-
-        swappedBuffers = !swappedBuffers;
+        bindTextures(commandBuffer);
     }
 };
 
@@ -400,6 +610,10 @@ protected:
     VkDescriptorSet descriptorSetB; // draws to a different texture every other frame
     bool swappedBuffers = false;
 
+    // R8 alpha planes of a packed cloud history, null otherwise
+    Texture* alphaA = nullptr;
+    Texture* alphaB = nullptr;
+
     VkDescriptorSetLayout uniformSetLayout;
     VkDescriptorSet uniformSet;
 
@@ -413,6 +627,11 @@ protected:
 
     VkBuffer uniformSunBuffer;
     VkDeviceMemory uniformSunBufferMemory;
+
+    FrameConstants frame = {};
+    bool uniformsUploaded = false;
+    UniformSkyObject uploadedSky;
+    UniformSunObject uploadedSun;
 public:
     void setupShader(std::string path) {
         shaderFilePaths.push_back(path);
@@ -425,8 +644,9 @@ public:
     }
 
     ReprojectShader(VkDevice device, VkPhysicalDevice physicalDevice, VkCommandPool commandPool, VkQueue queue, VkExtent2D extent) : Shader(device, physicalDevice, commandPool, queue, extent) {}
-    ReprojectShader(VkDevice device, VkPhysicalDevice physicalDevice, VkCommandPool commandPool, VkQueue queue, VkExtent2D extent, VkRenderPass *renderPass, std::string shaderPath, Texture* texA, Texture* texB) :
-        Shader(device, physicalDevice, commandPool, queue, extent) {
+    ReprojectShader(VkDevice device, VkPhysicalDevice physicalDevice, VkCommandPool commandPool, VkQueue queue, VkExtent2D extent, VkRenderPass *renderPass, std::string shaderPath, Texture* texA, Texture* texB,
+                    Texture* alphaA = nullptr, Texture* alphaB = nullptr) :
+        Shader(device, physicalDevice, commandPool, queue, extent), alphaA(alphaA), alphaB(alphaB) {
         this->renderPass = renderPass;
         addTexture(texA);
         addTexture(texB);
@@ -437,11 +657,18 @@ public:
     virtual ~ReprojectShader() { cleanupUniforms(); }
 
     void updateUniformBuffers(UniformCameraObject& cam, UniformCameraObject& camPrev, UniformSkyObject& sky, UniformSunObject& sun);
+    // Pushed by the next recording, like ComputeShader::setFrameConstants
+    void setFrameConstants(const FrameConstants& constants) { frame = constants; }
 
     void bindShader(VkCommandBuffer& commandBuffer) override {
+        bindShader(commandBuffer, swappedBuffers ? 1 : 0);
+        swappedBuffers = !swappedBuffers;
+    }
+    // variant: same as the raymarch, see ComputeShader::bindShader
+    void bindShader(VkCommandBuffer& commandBuffer, uint32_t variant) {
         vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
 
-        if (swappedBuffers) {
+        if (variant == 1) {
             vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSetB, 0, nullptr);
             vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 1, 1, &descriptorSet, 0, nullptr);
         }
@@ -451,8 +678,7 @@ public:
         }
 
         vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 2, 1, &uniformSet, 0, nullptr);
-
-        swappedBuffers = !swappedBuffers;
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(frame), &frame);
     }
 };
 
@@ -518,4 +744,231 @@ public:
         vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
         vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
     }
-};
\ No newline at end of file
+};
+
+// Final pass of the fused post path: radial blur of the half res light shafts, combine with the scene and tonemap.
+// Same uniforms as the other post shaders, plus the light shaft texture at binding 3.
+class CompositeShader : public PostProcessShader
+{
+protected:
+    virtual void createDescriptorSetLayout();
+    virtual void createDescriptorPool();
+    virtual void createDescriptorSet();
+
+public:
+    CompositeShader(VkDevice device, VkPhysicalDevice physicalDevice, VkCommandPool commandPool, VkQueue queue, VkExtent2D extent,
+                    VkRenderPass *renderPass, std::string vertPath, std::string fragPath, VkDescriptorImageInfo* tex, Texture* shaftTex) :
+        PostProcessShader(device, physicalDevice, commandPool, queue, extent) {
+        this->renderPass = renderPass;
+        descriptorImageInfo = tex;
+        addTexture(shaftTex);
+        setupShader(vertPath, fragPath);
+    }
+};
+
+// Compute half of the fused post path: god rays at half resolution into a single channel storage image.
+class LightShaftShader : public Shader
+{
+private:
+
+protected:
+    virtual void createDescriptorSetLayout();
+    virtual void createDescriptorPool();
+    virtual void createDescriptorSet();
+
+    virtual void createUniformBuffer();
+
+    virtual void createPipeline();
+
+    virtual void cleanupUniforms();
+
+    VkDescriptorImageInfo* descriptorImageInfo;
+
+    VkBuffer uniformCameraBuffer;
+    VkDeviceMemory uniformCameraBufferMemory;
+    VkBuffer uniformSunBuffer;
+    VkDeviceMemory uniformSunBufferMemory;
+
+public:
+    void setupShader(std::string path) {
+        shaderFilePaths.push_back(path);
+
+        createDescriptorSetLayout();
+        createPipeline();
+        createUniformBuffer();
+        createDescriptorPool();
+        createDescriptorSet();
+    }
+
+    LightShaftShader(VkDevice device, VkPhysicalDevice physicalDevice, VkCommandPool commandPool, VkQueue queue, VkExtent2D extent,
+                     std::string path, VkDescriptorImageInfo* sceneTex, Texture* shaftTex) :
+        Shader(device, physicalDevice, commandPool, queue, extent), descriptorImageInfo(sceneTex) {
+        addTexture(shaftTex);
+        setupShader(path);
+    }
+
+    virtual ~LightShaftShader() { cleanupUniforms(); }
+
+    void updateUniformBuffers(UniformCameraObject& cam, UniformSunObject& sun);
+    void bindShader(VkCommandBuffer& commandBuffer) override {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+    }
+};
+
+// Fills the cloud noise volumes on the device, the GPU counterpart of BakeNoiseVolume for the 3D presets. Runs outside
+// the frame, so it records its own command buffer and times the dispatch with a pair of timestamps.
+class NoiseShader : public Shader
+{
+private:
+
+protected:
+    virtual void createDescriptorSetLayout();
+    virtual void createDescriptorPool();
+    virtual void createDescriptorSet();
+
+    virtual void createUniformBuffer();
+
+    virtual void createPipeline();
+
+    virtual void cleanupUniforms();
+
+    VkBuffer uniformNoiseBuffer;
+    VkDeviceMemory uniformNoiseBufferMemory;
+
+    VkQueryPool queryPool;
+    float timestampPeriod; // ns per tick
+
+public:
+    void setupShader(std::string path) {
+        shaderFilePaths.push_back(path);
+
+        createDescriptorSetLayout();
+        createPipeline();
+        createUniformBuffer();
+        createDescriptorPool();
+        createDescriptorSet();
+    }
+
+    NoiseShader(VkDevice device, VkPhysicalDevice physicalDevice, VkCommandPool commandPool, VkQueue queue, std::string path) :
+        Shader(device, physicalDevice, commandPool, queue, { 0, 0 }) {
+        setupShader(path);
+    }
+
+    virtual ~NoiseShader() { cleanupUniforms(); }
+
+    // Writes level 0 of target (from Texture3D::initForStorage) and its mips. Returns the time of the dispatch on the
+    // GPU in milliseconds.
+    float generate(Texture3D* target, const NoiseVolumeDesc& desc);
+    void bindShader(VkCommandBuffer& commandBuffer) override {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+    }
+};
+
+// Evolves the weather map the clouds are placed by. The two maps ping-pong: command buffer 0 reads the first and
+// writes the second, 1 the other way round. Each frame only evolves a window of tiles, and copies over the window the
+// frame before evolved, so whichever map was written last is whole.
+class WeatherShader : public Shader
+{
+private:
+
+protected:
+    virtual void createDescriptorSetLayout();
+    virtual void createDescriptorPool();
+    virtual void createDescriptorSet();
+
+    virtual void createUniformBuffer();
+
+    virtual void createPipeline();
+
+    virtual void cleanupUniforms();
+
+    VkBuffer uniformWeatherBuffer;
+    VkDeviceMemory uniformWeatherBufferMemory;
+
+    VkDescriptorSet descriptorSetB; // reads the second map, writes the first
+
+public:
+    void setupShader(std::string path) {
+        shaderFilePaths.push_back(path);
+
+        createDescriptorSetLayout();
+        createPipeline();
+        createUniformBuffer();
+        createDescriptorPool();
+        createDescriptorSet();
+    }
+
+    WeatherShader(VkDevice device, VkPhysicalDevice physicalDevice, VkCommandPool commandPool, VkQueue queue, VkExtent2D extent,
+                  std::string path, Texture* weatherMap, Texture* weatherMapNext) :
+        Shader(device, physicalDevice, commandPool, queue, extent) {
+        addTexture(weatherMap);
+        addTexture(weatherMapNext);
+        setupShader(path);
+    }
+
+    virtual ~WeatherShader() { cleanupUniforms(); }
+
+    void updateUniformBuffers(UniformWeatherObject& weather);
+    // Evolves every tile of both maps from nothing, before the first frame
+    void initialize(float time, glm::vec2 windOffset, uint32_t tileSize);
+
+    void bindShader(VkCommandBuffer& commandBuffer) override {
+        bindShader(commandBuffer, 0);
+    }
+    void bindShader(VkCommandBuffer& commandBuffer, uint32_t variant) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, variant == 0 ? &descriptorSet : &descriptorSetB, 0, nullptr);
+    }
+};
+
+// Frustum culls the instances of a MeshRegistry into its indirect draws, see MeshRegistry::recordCulling
+class CullShader : public Shader
+{
+private:
+
+protected:
+    virtual void createDescriptorSetLayout();
+    virtual void createDescriptorPool();
+    virtual void createDescriptorSet();
+
+    virtual void createUniformBuffer();
+
+    virtual void createPipeline();
+
+    virtual void cleanupUniforms();
+
+    VkBuffer uniformCullBuffer;
+    VkDeviceMemory uniformCullBufferMemory;
+
+    VkBuffer instanceBuffer;
+    VkBuffer drawBuffer;
+
+public:
+    void setupShader(std::string path) {
+        shaderFilePaths.push_back(path);
+
+        createDescriptorSetLayout();
+        createPipeline();
+        createUniformBuffer();
+        createDescriptorPool();
+        createDescriptorSet();
+    }
+
+    CullShader(VkDevice device, VkPhysicalDevice physicalDevice, VkCommandPool commandPool, VkQueue queue, std::string path, VkBuffer instanceBuffer, VkBuffer drawBuffer) :
+        Shader(device, physicalDevice, commandPool, queue, { 0, 0 }) {
+        this->instanceBuffer = instanceBuffer;
+        this->drawBuffer = drawBuffer;
+        setupShader(path);
+    }
+
+    virtual ~CullShader() { cleanupUniforms(); }
+
+    void updateUniformBuffers(UniformCullObject& cull);
+
+    void bindShader(VkCommandBuffer& commandBuffer) override {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+    }
+};
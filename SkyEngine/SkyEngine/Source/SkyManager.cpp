@@ -94,6 +94,7 @@ SkyManager::SkyManager()
     calcSunIntensity();
     mie = 0.005f;
     sky.mie_directional = 0.8;
+    sky.weather_map = 0.0f;
     rayleigh = 2.f;
     calcSkyBetaR();
     calcSkyBetaV();
@@ -34,6 +34,7 @@ struct UniformSkyObject{
     glm::vec4 betaV;
     glm::vec4 wind;
     float mie_directional;
+    float weather_map; // which of the two weather maps is current, see WeatherShader
 
     static VkDescriptorSetLayoutBinding getLayoutBinding(uint32_t bind)
     {
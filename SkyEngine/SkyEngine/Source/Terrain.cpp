@@ -0,0 +1,269 @@
+#include "Terrain.h"
+#include <stb_image.h>
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+
+void Terrain::cleanup() {
+    vkDestroyBuffer(device, vertexBuffer, nullptr);
+    FreeTrackedMemory(device, vertexDeviceMemory, nullptr);
+    vkDestroyBuffer(device, indexBuffer, nullptr);
+    FreeTrackedMemory(device, indexDeviceMemory, nullptr);
+    vkDestroyBuffer(device, drawBuffer, nullptr);
+    FreeTrackedMemory(device, drawDeviceMemory, nullptr);
+}
+
+void Terrain::createDeviceLocalBuffer(const void* data, VkDeviceSize bufferSize, VkBufferUsageFlags usage, VkBuffer& buffer, VkDeviceMemory& memory) {
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+    void* mapped;
+    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &mapped);
+    memcpy(mapped, data, (size_t)bufferSize);
+    vkUnmapMemory(device, stagingBufferMemory);
+
+    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, memory);
+    copyBuffer(stagingBuffer, buffer, bufferSize);
+
+    vkDestroyBuffer(device, stagingBuffer, nullptr);
+    FreeTrackedMemory(device, stagingBufferMemory, nullptr);
+}
+
+void Terrain::setupFromHeightmap(const std::string& path, float size, float height, float base, JobSystem& jobs) {
+    int width, depth, channels;
+    stbi_us* texels = stbi_load_16(path.c_str(), &width, &depth, &channels, 1);
+    if (!texels) {
+        throw std::runtime_error("failed to load heightmap!");
+    }
+    // the root takes the least power of two spacing that covers the heightmap, texels past its edge repeat the edge
+    int rootStep = 1;
+    while (rootStep * TERRAIN_PATCH_QUADS < std::max(width, depth) - 1) {
+        rootStep *= 2;
+    }
+    const int span = rootStep * TERRAIN_PATCH_QUADS;
+    heights.assign(static_cast<size_t>(width) * depth, 0.0f);
+    heightmapWidth = width;
+    heightmapDepth = depth;
+    for (size_t i = 0; i < heights.size(); i++) {
+        heights[i] = base + height * texels[i] / 65535.0f;
+    }
+    stbi_image_free(texels);
+
+    auto heightAt = [&](int x, int z) {
+        return heights[static_cast<size_t>(std::min(std::max(z, 0), depth - 1)) * width + std::min(std::max(x, 0), width - 1)];
+    };
+    const float texelSize = size / span;
+    heightmapTexelSize = texelSize;
+    halfSize = 0.5f * size;
+
+    // Every node quantizes against the bounds of the whole terrain, so neighbours agree on their shared edges. The
+    // bounds reach down to the bottom of the deepest skirt, see skirtDepth.
+    const float lowest = base - height - texelSize * rootStep;
+    const glm::vec3 centre(0.0f, 0.5f * (lowest + base + height), 0.0f);
+    const glm::vec3 extent(0.5f * size, 0.5f * (base + height - lowest), 0.5f * size);
+    positionDecode = glm::scale(glm::translate(glm::mat4(1.0f), centre), extent);
+
+    // one patch of indices for every node, then a skirt down from each of its four edges
+    const uint32_t side = TERRAIN_PATCH_QUADS + 1;
+    std::vector<uint32_t> indices;
+    for (uint32_t j = 0; j < TERRAIN_PATCH_QUADS; j++) {
+        for (uint32_t i = 0; i < TERRAIN_PATCH_QUADS; i++) {
+            const uint32_t v = j * side + i;
+            // counterclockwise seen from above, like the obj
+            const uint32_t quad[6] = { v, v + side, v + 1, v + 1, v + side, v + side + 1 };
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    }
+    // edges walked in the order their skirt vertices follow the grid
+    const uint32_t edgeStart[4] = { 0, TERRAIN_PATCH_QUADS * side, 0, TERRAIN_PATCH_QUADS };
+    const uint32_t edgeStep[4] = { 1, 1, side, side };
+    for (uint32_t edge = 0; edge < 4; edge++) {
+        const uint32_t skirt = side * side + edge * side;
+        for (uint32_t k = 0; k < TERRAIN_PATCH_QUADS; k++) {
+            const uint32_t top0 = edgeStart[edge] + k * edgeStep[edge];
+            const uint32_t top1 = top0 + edgeStep[edge];
+            // both windings, the skirt is seen from whichever side the neighbour leaves open
+            const uint32_t quad[12] = { top0, skirt + k, top1, top1, skirt + k, skirt + k + 1,
+                                        top0, top1, skirt + k, top1, skirt + k + 1, skirt + k };
+            indices.insert(indices.end(), quad, quad + 12);
+        }
+    }
+    patchIndexCount = static_cast<uint32_t>(indices.size());
+
+    // nodes level by level, the root covers the whole heightmap and a leaf TERRAIN_PATCH_QUADS texels
+    struct Pending { int x, z, step; };
+    std::vector<Pending> pending = { { 0, 0, rootStep } };
+    nodes.assign(1, TerrainNode());
+    for (size_t n = 0; n < pending.size(); n++) {
+        const Pending p = pending[n];
+        if (p.step > 1) {
+            nodes[n].firstChild = static_cast<uint32_t>(pending.size());
+            const int half = p.step * TERRAIN_PATCH_QUADS / 2;
+            pending.push_back({ p.x, p.z, p.step / 2 });
+            pending.push_back({ p.x + half, p.z, p.step / 2 });
+            pending.push_back({ p.x, p.z + half, p.step / 2 });
+            pending.push_back({ p.x + half, p.z + half, p.step / 2 });
+            nodes.resize(pending.size());
+        }
+    }
+
+    // every node has the same number of vertices, so they are filled in on the workers independently
+    const uint32_t nodeVertices = side * side + 4 * side;
+    std::vector<PackedVertex> vertices(nodes.size() * nodeVertices);
+    JobHandle filled = jobs.parallelFor(static_cast<uint32_t>(nodes.size()), 16, [&](uint32_t first, uint32_t last) {
+        for (uint32_t n = first; n < last; n++) {
+            const Pending p = pending[n];
+            TerrainNode& node = nodes[n];
+            node.firstVertex = n * nodeVertices;
+
+            float lo = FLT_MAX, hi = -FLT_MAX;
+            const int texels = p.step * TERRAIN_PATCH_QUADS;
+            for (int z = p.z; z <= p.z + texels; z++) {
+                for (int x = p.x; x <= p.x + texels; x++) {
+                    lo = std::min(lo, heightAt(x, z));
+                    hi = std::max(hi, heightAt(x, z));
+                }
+            }
+            // deep enough to cover the error of any coarser neighbour over this node
+            const float skirtDepth = hi - lo + texelSize * p.step;
+
+            auto vertexAt = [&](int x, int z, float drop) {
+                const glm::vec3 world((x * texelSize) - 0.5f * size, heightAt(x, z) - drop, (z * texelSize) - 0.5f * size);
+                // central differences at full resolution, the shading doesn't change with the level
+                const glm::vec3 normal = glm::normalize(glm::vec3(heightAt(x - 1, z) - heightAt(x + 1, z), 2.0f * texelSize, heightAt(x, z - 1) - heightAt(x, z + 1)));
+                const glm::vec2 uv = glm::vec2(x, z) * (static_cast<float>(TERRAIN_UV_REPEATS) / span);
+                return PackedVertex::pack((world - centre) / extent, normal, uv);
+            };
+            PackedVertex* out = &vertices[node.firstVertex];
+            for (uint32_t j = 0; j < side; j++) {
+                for (uint32_t i = 0; i < side; i++) {
+                    *out++ = vertexAt(p.x + i * p.step, p.z + j * p.step, 0.0f);
+                }
+            }
+            for (uint32_t edge = 0; edge < 4; edge++) {
+                for (uint32_t k = 0; k < side; k++) {
+                    const uint32_t top = edgeStart[edge] + k * edgeStep[edge];
+                    *out++ = vertexAt(p.x + (top % side) * p.step, p.z + (top / side) * p.step, skirtDepth);
+                }
+            }
+
+            node.boundsMin = glm::vec3(p.x * texelSize - 0.5f * size, lo - skirtDepth, p.z * texelSize - 0.5f * size);
+            node.boundsMax = glm::vec3((p.x + texels) * texelSize - 0.5f * size, hi, (p.z + texels) * texelSize - 0.5f * size);
+        }
+    });
+    jobs.wait(filled);
+
+    createDeviceLocalBuffer(vertices.data(), sizeof(PackedVertex) * vertices.size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertexBuffer, vertexDeviceMemory);
+    createDeviceLocalBuffer(indices.data(), sizeof(uint32_t) * indices.size(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indexBuffer, indexDeviceMemory);
+    createBuffer(sizeof(VkDrawIndexedIndirectCommand) * TERRAIN_MAX_DRAWS, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, drawBuffer, drawDeviceMemory);
+}
+
+// Planes of the clip volume, xyz pointing inwards. The near plane is the one of a -w..w depth range, which holds the
+// 0..w one of Vulkan too.
+static void frustumPlanes(const glm::mat4& viewProj, glm::vec4 planes[6]) {
+    const glm::vec4 row[4] = {
+        glm::vec4(viewProj[0][0], viewProj[1][0], viewProj[2][0], viewProj[3][0]),
+        glm::vec4(viewProj[0][1], viewProj[1][1], viewProj[2][1], viewProj[3][1]),
+        glm::vec4(viewProj[0][2], viewProj[1][2], viewProj[2][2], viewProj[3][2]),
+        glm::vec4(viewProj[0][3], viewProj[1][3], viewProj[2][3], viewProj[3][3])
+    };
+    planes[0] = row[3] + row[0];
+    planes[1] = row[3] - row[0];
+    planes[2] = row[3] + row[1];
+    planes[3] = row[3] - row[1];
+    planes[4] = row[3] + row[2];
+    planes[5] = row[3] - row[2];
+}
+
+static bool boxVisible(const glm::vec4 planes[6], const TerrainNode& node) {
+    for (int p = 0; p < 6; p++) {
+        // the corner furthest along the plane normal
+        const glm::vec3 corner(planes[p].x >= 0.0f ? node.boundsMax.x : node.boundsMin.x,
+                               planes[p].y >= 0.0f ? node.boundsMax.y : node.boundsMin.y,
+                               planes[p].z >= 0.0f ? node.boundsMax.z : node.boundsMin.z);
+        if (glm::dot(glm::vec3(planes[p]), corner) + planes[p].w < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Terrain::select(const glm::mat4& viewProj, const glm::vec3& cameraPos) {
+    glm::vec4 planes[6];
+    frustumPlanes(viewProj, planes);
+    auto distanceTo = [&](uint32_t n) {
+        return glm::length(cameraPos - glm::clamp(cameraPos, nodes[n].boundsMin, nodes[n].boundsMax));
+    };
+
+    // Refines a level at a time, nearest nodes first, and only while the four children of a node would still fit. The
+    // selection then always covers everything visible, however close to TERRAIN_MAX_DRAWS it gets.
+    std::vector<uint32_t> selected;
+    std::vector<uint32_t> refined;
+    if (!nodes.empty() && boxVisible(planes, nodes[0])) {
+        selected.push_back(0);
+    }
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        std::sort(selected.begin(), selected.end(), [&](uint32_t a, uint32_t b) { return distanceTo(a) < distanceTo(b); });
+        size_t count = selected.size();
+        refined.clear();
+        for (uint32_t n : selected) {
+            const TerrainNode& node = nodes[n];
+            const bool split = node.firstChild != 0 && count + 3 <= TERRAIN_MAX_DRAWS
+                && distanceTo(n) < (node.boundsMax.x - node.boundsMin.x) * TERRAIN_LOD_DISTANCE;
+            if (!split) {
+                refined.push_back(n);
+                continue;
+            }
+            count--;
+            for (uint32_t c = node.firstChild; c < node.firstChild + 4; c++) {
+                if (boxVisible(planes, nodes[c])) {
+                    refined.push_back(c);
+                    count++;
+                }
+            }
+            changed = true;
+        }
+        selected.swap(refined);
+    }
+
+    // the recorded command buffers always draw TERRAIN_MAX_DRAWS, the rest are empty
+    draws.assign(TERRAIN_MAX_DRAWS, VkDrawIndexedIndirectCommand());
+    for (size_t d = 0; d < selected.size(); d++) {
+        draws[d].indexCount = patchIndexCount;
+        draws[d].instanceCount = 1;
+        draws[d].vertexOffset = static_cast<int32_t>(nodes[selected[d]].firstVertex);
+    }
+    drawCount = static_cast<uint32_t>(selected.size());
+}
+
+void Terrain::upload() {
+    void* data;
+    vkMapMemory(device, drawDeviceMemory, 0, sizeof(VkDrawIndexedIndirectCommand) * TERRAIN_MAX_DRAWS, 0, &data);
+    memcpy(data, draws.data(), sizeof(VkDrawIndexedIndirectCommand) * TERRAIN_MAX_DRAWS);
+    vkUnmapMemory(device, drawDeviceMemory);
+}
+
+float Terrain::getHeight(float x, float z) const {
+    const float u = glm::clamp((x + halfSize) / heightmapTexelSize, 0.0f, static_cast<float>(heightmapWidth - 1));
+    const float v = glm::clamp((z + halfSize) / heightmapTexelSize, 0.0f, static_cast<float>(heightmapDepth - 1));
+    const int x0 = static_cast<int>(u);
+    const int z0 = static_cast<int>(v);
+    const int x1 = std::min(x0 + 1, heightmapWidth - 1);
+    const int z1 = std::min(z0 + 1, heightmapDepth - 1);
+    auto at = [&](int i, int j) { return heights[static_cast<size_t>(j) * heightmapWidth + i]; };
+    const float row0 = glm::mix(at(x0, z0), at(x1, z0), u - x0);
+    const float row1 = glm::mix(at(x0, z1), at(x1, z1), u - x0);
+    return glm::mix(row0, row1, v - z0);
+}
+
+void Terrain::enqueueDrawCommands(VkCommandBuffer& commandBuffer) {
+    VkBuffer vertexBuffers[] = { vertexBuffer };
+    VkDeviceSize offsets[] = { 0 };
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+    vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer, 0, TERRAIN_MAX_DRAWS, sizeof(VkDrawIndexedIndirectCommand));
+}
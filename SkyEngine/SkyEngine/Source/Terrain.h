@@ -0,0 +1,68 @@
+#pragma once
+#include "Geometry.h"
+#include "JobSystem.h"
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+#define TERRAIN_PATCH_QUADS 32   // quads along the edge of every node, whatever its size
+#define TERRAIN_MAX_DRAWS 256    // nodes drawn per frame at most, the refinement stops short of it
+#define TERRAIN_LOD_DISTANCE 2.0f // a node splits while the camera is closer to it than this many times its width
+#define TERRAIN_UV_REPEATS 64    // of the ground texture across the terrain, keeps the half float uvs exact
+
+// Chunked LOD terrain from a 16 bit heightmap. Every node of a quadtree over the heightmap holds a patch of
+// TERRAIN_PATCH_QUADS^2 quads sampled at its own spacing, all of them in one vertex buffer in PackedVertex layout and
+// all drawn with the same index buffer. Each frame select frustum culls the tree and refines it near the camera, and
+// upload writes the chosen nodes as indirect draws for the recorded command buffers. Patches hang a skirt as deep as
+// their own height range off their edges, which hides the cracks between neighbours of different levels.
+struct TerrainNode {
+    glm::vec3 boundsMin, boundsMax; // skirt included
+    uint32_t firstVertex;
+    uint32_t firstChild; // 0 for a leaf, the root is never a child
+};
+
+class Terrain : VulkanObject
+{
+private:
+    virtual void cleanup();
+
+    std::vector<TerrainNode> nodes;
+    uint32_t patchIndexCount = 0;
+    glm::mat4 positionDecode = glm::mat4(1.0f);
+    uint32_t drawCount = 0;
+    std::vector<VkDrawIndexedIndirectCommand> draws; // of the last select
+
+    // metres, kept for getHeight
+    std::vector<float> heights;
+    int heightmapWidth = 0, heightmapDepth = 0;
+    float heightmapTexelSize = 1.0f;
+    float halfSize = 0.0f;
+
+    VkBuffer vertexBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory vertexDeviceMemory = VK_NULL_HANDLE;
+    VkBuffer indexBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory indexDeviceMemory = VK_NULL_HANDLE;
+    // host visible, rewritten by update
+    VkBuffer drawBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory drawDeviceMemory = VK_NULL_HANDLE;
+
+    void createDeviceLocalBuffer(const void* data, VkDeviceSize bufferSize, VkBufferUsageFlags usage, VkBuffer& buffer, VkDeviceMemory& memory);
+
+public:
+    Terrain(VkDevice device, VkPhysicalDevice physicalDevice, VkCommandPool commandPool, VkQueue queue) : VulkanObject(device, physicalDevice, commandPool, queue) {}
+    ~Terrain() { cleanup(); }
+
+    // size: metres across, the heightmap spans [base, base + height]. Centred on the origin. The patches are built on
+    // the workers of jobs.
+    void setupFromHeightmap(const std::string& path, float size, float height, float base, JobSystem& jobs);
+    // Culls and refines the tree on the CPU only, fine on a worker while the GPU still draws the frame before
+    void select(const glm::mat4& viewProj, const glm::vec3& cameraPos);
+    // Writes the draws of select, once the graphics queue is done with the ones of the frame before
+    void upload();
+    void enqueueDrawCommands(VkCommandBuffer& commandBuffer);
+
+    // Like Geometry::getPositionDecode, the terrain is in world space otherwise
+    const glm::mat4& getPositionDecode() const { return positionDecode; }
+    uint32_t getDrawCount() const { return drawCount; }
+    // Of the full resolution heightmap, bilinear. Past the edge it repeats the edge.
+    float getHeight(float x, float z) const;
+};
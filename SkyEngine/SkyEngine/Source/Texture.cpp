@@ -1,4 +1,6 @@
 #include "Texture.h"
+#include "ImageUtils.h"
+#include <algorithm>
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
@@ -7,7 +9,7 @@ void Texture::cleanup() {
 	vkDestroySampler(device, textureSampler, nullptr);
 	vkDestroyImageView(device, textureImageView, nullptr);
 	vkDestroyImage(device, textureImage, nullptr);
-	vkFreeMemory(device, textureImageMemory, nullptr);
+	FreeTrackedMemory(device, textureImageMemory, nullptr);
 }
 
 VkFormat Texture::findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features) {
@@ -212,35 +214,58 @@ void Texture::createImage(uint32_t width, uint32_t height, VkImageUsageFlags usa
 	VkMemoryAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
 	allocInfo.allocationSize = memRequirements.size;
+	memorySize = memRequirements.size;
 	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
 
-	if (vkAllocateMemory(device, &allocInfo, nullptr, &textureImageMemory) != VK_SUCCESS) {
+	std::string detail = std::to_string(width) + "x" + std::to_string(height) + " " + FormatName(format);
+	if (name.empty()) {
+		name = (usage & VK_IMAGE_USAGE_STORAGE_BIT) ? "storage image" : ((usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) ? "depth attachment" : "image");
+	}
+	if (AllocateTrackedMemory(device, allocInfo, textureImageMemory, MemoryCategory::Texture, name, detail) != VK_SUCCESS) {
 		throw std::runtime_error("failed to allocate image memory!");
 	}
 
 	vkBindImageMemory(device, textureImage, textureImageMemory, 0);
 }
 
-void Texture::initFromFile(std::string path) {
-	if (initialized) return;
-
+void Texture::decodeFile(std::string path) {
 	stbi_uc* pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
-	VkDeviceSize imageSize = width * height * 4;
 
 	if (!pixels) {
 		throw std::runtime_error("failed to load texture image!");
 	}
 
+	// R8 and R8G8 formats keep the first channels only, the rest is never read
+	const uint32_t texelSize = FormatChannelCount(imageFormat);
+	decodedPixels.resize(static_cast<size_t>(width) * height * texelSize);
+	for (int p = 0; p < width * height; p++) {
+		memcpy(decodedPixels.data() + p * texelSize, pixels + p * 4, texelSize);
+	}
+	stbi_image_free(pixels);
+	decodedPath = path;
+}
+
+void Texture::initFromFile(std::string path) {
+	if (initialized) return;
+
+	if (decodedPath != path) {
+		decodeFile(path);
+	}
+	name = path;
+	VkDeviceSize imageSize = decodedPixels.size();
+
 	VkBuffer stagingBuffer;
 	VkDeviceMemory stagingBufferMemory;
 	createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
 
 	void* data;
 	vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
-	memcpy(data, pixels, static_cast<size_t>(imageSize));
+	memcpy(data, decodedPixels.data(), static_cast<size_t>(imageSize));
 	vkUnmapMemory(device, stagingBufferMemory);
 
-	stbi_image_free(pixels);
+	decodedPixels.clear();
+	decodedPixels.shrink_to_fit();
+	decodedPath.clear();
 
 	createImage(width, height, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, imageFormat, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
@@ -249,7 +274,7 @@ void Texture::initFromFile(std::string path) {
 	transitionImageLayout(textureImage, imageFormat, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
 	vkDestroyBuffer(device, stagingBuffer, nullptr);
-	vkFreeMemory(device, stagingBufferMemory, nullptr);
+	FreeTrackedMemory(device, stagingBufferMemory, nullptr);
 
 	createImageView();
 	createSampler();
@@ -266,7 +291,7 @@ void Texture::initForStorage(VkExtent2D extent) {
 	VkDeviceSize imageSize = width * height * 4;
 
 	/*for writing in compute shader*/
-	createImage(width, height, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, imageFormat, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	createImage(width, height, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, imageFormat, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 	transitionImageLayout(textureImage, imageFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL); // VK_IMAGE_LAYOUT_GENERAL anything better than general? prob not
 
 	createImageView();
@@ -275,6 +300,60 @@ void Texture::initForStorage(VkExtent2D extent) {
 	initialized = true;
 }
 
+void Texture::readStorage(std::vector<char>& pixels, uint32_t texelSize) {
+	VkDeviceSize imageSize = static_cast<VkDeviceSize>(width) * height * texelSize;
+
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingBufferMemory;
+	createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+
+	// make the last compute writes visible to the copy, the image stays in GENERAL
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = textureImage;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	VkBufferImageCopy region = {};
+	region.bufferOffset = 0;
+	region.bufferRowLength = 0;
+	region.bufferImageHeight = 0;
+
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.mipLevel = 0;
+	region.imageSubresource.baseArrayLayer = 0;
+	region.imageSubresource.layerCount = 1;
+
+	region.imageOffset = { 0, 0, 0 };
+	region.imageExtent = { static_cast<uint32_t>(width), static_cast<uint32_t>(height), 1 };
+
+	vkCmdCopyImageToBuffer(commandBuffer, textureImage, VK_IMAGE_LAYOUT_GENERAL, stagingBuffer, 1, &region);
+
+	endSingleTimeCommands(commandBuffer);
+
+	pixels.resize(static_cast<size_t>(imageSize));
+	void* data;
+	vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
+	memcpy(pixels.data(), data, static_cast<size_t>(imageSize));
+	vkUnmapMemory(device, stagingBufferMemory);
+
+	vkDestroyBuffer(device, stagingBuffer, nullptr);
+	FreeTrackedMemory(device, stagingBufferMemory, nullptr);
+}
+
 // TODO: give a usage bit as argument and switch from there for other attachments
 void Texture::initForDepthAttachment(VkExtent2D extent) {
 	if (initialized) return;
@@ -304,8 +383,11 @@ void Texture::initForDepthAttachment(VkExtent2D extent) {
 void Texture3D::cleanup() {
 	vkDestroySampler(device, textureSampler, nullptr);
 	vkDestroyImageView(device, textureImageView, nullptr);
+	if (storageImageView != VK_NULL_HANDLE) {
+		vkDestroyImageView(device, storageImageView, nullptr);
+	}
 	vkDestroyImage(device, textureImage, nullptr);
-	vkFreeMemory(device, textureImageMemory, nullptr);
+	FreeTrackedMemory(device, textureImageMemory, nullptr);
 }
 
 VkFormat Texture3D::findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features) {
@@ -327,8 +409,10 @@ VkFormat Texture3D::findSupportedFormat(const std::vector<VkFormat>& candidates,
 void Texture3D::createSampler() {
 	VkSamplerCreateInfo samplerInfo = {};
 	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-	samplerInfo.magFilter = VK_FILTER_LINEAR;
-	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	// integer formats (the brick indirection) can't be filtered
+	const VkFilter filter = imageFormat == VK_FORMAT_R8G8B8A8_UINT ? VK_FILTER_NEAREST : VK_FILTER_LINEAR;
+	samplerInfo.magFilter = filter;
+	samplerInfo.minFilter = filter;
 	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
 	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
 	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
@@ -342,7 +426,7 @@ void Texture3D::createSampler() {
 	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
 	samplerInfo.mipLodBias = 0.0f;
 	samplerInfo.minLod = 0.0f;
-	samplerInfo.maxLod = 0.0f;
+	samplerInfo.maxLod = static_cast<float>(mipLevels);
 
 	if (vkCreateSampler(device, &samplerInfo, nullptr, &textureSampler) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create texture sampler!");
@@ -364,7 +448,7 @@ void Texture3D::transitionImageLayout(VkImage image, VkFormat format, VkImageLay
 	barrier.image = image;
 	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	barrier.subresourceRange.baseMipLevel = 0;
-	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.levelCount = mipLevels;
 	barrier.subresourceRange.baseArrayLayer = 0;
 	barrier.subresourceRange.layerCount = 1;
 
@@ -398,10 +482,18 @@ void Texture3D::transitionImageLayout(VkImage image, VkFormat format, VkImageLay
 	}
 	else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_GENERAL) {
 		barrier.srcAccessMask = 0;
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
 
 		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	}
+	else if (oldLayout == VK_IMAGE_LAYOUT_GENERAL && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
+		// level 0 written by a compute shader, the mips are blitted from it next
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+		sourceStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
 	}
 	else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
 		//add new VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL case
@@ -462,6 +554,70 @@ void Texture3D::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width
 	endSingleTimeCommands(commandBuffer);
 }
 
+// Each level is a linear blit of the one above, which averages 2x2x2 texels. Expects all levels in
+// VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL with level 0 filled.
+void Texture3D::generateMipmaps() {
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(physicalDevice, imageFormat, &formatProperties);
+	if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
+		throw std::runtime_error("texture image format does not support linear blitting!");
+	}
+
+	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.image = textureImage;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.subresourceRange.levelCount = 1;
+
+	const VkPipelineStageFlags shaderStages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	int32_t mipWidth = width, mipHeight = height, mipDepth = depth;
+	for (uint32_t i = 1; i < mipLevels; i++) {
+		barrier.subresourceRange.baseMipLevel = i - 1;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr, 0, nullptr, 1, &barrier);
+
+		VkImageBlit blit = {};
+		blit.srcOffsets[0] = { 0, 0, 0 };
+		blit.srcOffsets[1] = { mipWidth, mipHeight, mipDepth };
+		blit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i - 1, 0, 1 };
+		mipWidth = std::max(mipWidth / 2, 1);
+		mipHeight = std::max(mipHeight / 2, 1);
+		mipDepth = std::max(mipDepth / 2, 1);
+		blit.dstOffsets[0] = { 0, 0, 0 };
+		blit.dstOffsets[1] = { mipWidth, mipHeight, mipDepth };
+		blit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1 };
+		vkCmdBlitImage(commandBuffer, textureImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, textureImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			1, &blit, VK_FILTER_LINEAR);
+
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, shaderStages, 0,
+			0, nullptr, 0, nullptr, 1, &barrier);
+	}
+
+	barrier.subresourceRange.baseMipLevel = mipLevels - 1;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, shaderStages, 0,
+		0, nullptr, 0, nullptr, 1, &barrier);
+
+	endSingleTimeCommands(commandBuffer);
+}
+
 void Texture3D::createImageView() {
 	VkImageViewCreateInfo viewInfo = {};
 	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -470,7 +626,7 @@ void Texture3D::createImageView() {
 	viewInfo.format = imageFormat;
 	viewInfo.subresourceRange.aspectMask = usageBit;
 	viewInfo.subresourceRange.baseMipLevel = 0;
-	viewInfo.subresourceRange.levelCount = 1;
+	viewInfo.subresourceRange.levelCount = mipLevels;
 	viewInfo.subresourceRange.baseArrayLayer = 0;
 	viewInfo.subresourceRange.layerCount = 1;
 
@@ -491,7 +647,7 @@ void Texture3D::createImage(uint32_t width, uint32_t height, uint32_t depth, VkI
 	imageInfo.extent.width = width;
 	imageInfo.extent.height = height;
 	imageInfo.extent.depth = depth;
-	imageInfo.mipLevels = 1; // this might become something
+	imageInfo.mipLevels = mipLevels;
 	imageInfo.arrayLayers = 1;
 	imageInfo.format = format;
 	imageInfo.tiling = tiling;
@@ -510,73 +666,147 @@ void Texture3D::createImage(uint32_t width, uint32_t height, uint32_t depth, VkI
 	VkMemoryAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
 	allocInfo.allocationSize = memRequirements.size;
+	memorySize = memRequirements.size;
 	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
 
-	if (vkAllocateMemory(device, &allocInfo, nullptr, &textureImageMemory) != VK_SUCCESS) {
+	std::string detail = std::to_string(width) + "x" + std::to_string(height) + "x" + std::to_string(depth) + " " + FormatName(format) + ", " + std::to_string(mipLevels) + " mips";
+	if (name.empty()) {
+		name = (usage & VK_IMAGE_USAGE_STORAGE_BIT) ? "storage volume" : ((usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) ? "depth attachment" : "volume");
+	}
+	if (AllocateTrackedMemory(device, allocInfo, textureImageMemory, MemoryCategory::Volume, name, detail) != VK_SUCCESS) {
 		throw std::runtime_error("failed to allocate image memory!");
 	}
 
 	vkBindImageMemory(device, textureImage, textureImageMemory, 0);
 }
 
+static uint32_t fullMipChain(int width, int height, int depth) {
+	uint32_t levels = 1;
+	for (int size = std::max(width, std::max(height, depth)); size > 1; size /= 2) {
+		levels++;
+	}
+	return levels;
+}
+
+// Loads the packed volume written by the asset build step (PackVolume) or the noise baker, packing the tga slices on
+// the first run. The format given to the constructor decides how many channels are kept, the packed file the size.
+void Texture3D::decodeFile(std::string path) {
+	const uint32_t texelSize = FormatChannelCount(imageFormat);
+	PackedVolumeHeader header;
+	if (!LoadPackedVolume(path, texelSize, header, decodedTexels)) {
+		PackVolume(path, static_cast<uint32_t>(depth), texelSize, header, decodedTexels);
+	}
+	width = header.width;
+	height = header.height;
+	depth = header.depth;
+	channels = texelSize;
+	decodedPath = path;
+}
+
 void Texture3D::initFromFile(std::string path) {
 	if (initialized) return;
 
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	VkDeviceSize imageSize = width * height * 4;
-	createBuffer(imageSize * depth, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+	if (decodedPath != path) {
+		decodeFile(path);
+	}
+	name = path;
 
-	for (uint32_t i = 0; i < static_cast<uint32_t>(depth); ++i) {
-		stbi_uc* pixels = stbi_load((path + "(" + std::to_string(i) + ").tga").c_str(), &width, &height, &channels, STBI_rgb_alpha);
+	// down to 1x1x1, the raymarcher picks the level from the length of its steps
+	mipLevels = fullMipChain(width, height, depth);
+	upload(decodedTexels);
+	decodedTexels.clear();
+	decodedTexels.shrink_to_fit();
+	decodedPath.clear();
 
-		if (!pixels) {
-			throw std::runtime_error("failed to load texture image!");
-		}
+	initialized = true;
+}
 
-		void* data;
-		vkMapMemory(device, stagingBufferMemory, static_cast<uint64_t>(i) * imageSize, imageSize, 0, &data);
-		memcpy(data, pixels, static_cast<size_t>(imageSize));
-		vkUnmapMemory(device, stagingBufferMemory);
+void Texture3D::initFromData(const std::vector<unsigned char>& texels) {
+	if (initialized) return;
 
-		stbi_image_free(pixels);
-	}
+	channels = FormatChannelCount(imageFormat);
+	mipLevels = 1;
+	upload(texels);
 
-	createImage(width, height, depth, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, imageFormat, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	initialized = true;
+}
+
+// Creates the image with mipLevels levels from the texels of level 0, along with its view and sampler
+void Texture3D::upload(const std::vector<unsigned char>& texels) {
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingBufferMemory;
+	VkDeviceSize imageSize = texels.size();
+	createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+	void* data;
+	vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
+	memcpy(data, texels.data(), static_cast<size_t>(imageSize));
+	vkUnmapMemory(device, stagingBufferMemory);
+
+	createImage(width, height, depth, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, imageFormat, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
 	transitionImageLayout(textureImage, imageFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 	copyBufferToImage(stagingBuffer, textureImage, static_cast<uint32_t>(width), static_cast<uint32_t>(height), static_cast<uint32_t>(depth));
-	transitionImageLayout(textureImage, imageFormat, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	if (mipLevels > 1) {
+		generateMipmaps(); // leaves every level in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+	}
+	else {
+		transitionImageLayout(textureImage, imageFormat, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	}
 
 	vkDestroyBuffer(device, stagingBuffer, nullptr);
-	vkFreeMemory(device, stagingBufferMemory, nullptr);
+	FreeTrackedMemory(device, stagingBufferMemory, nullptr);
 
 	createImageView();
 	createSampler();
-
-	initialized = true;
 }
 
-void Texture3D::initForStorage(VkExtent3D extent) {
+// Level 0 is written through storageImageView by a compute shader (NoiseShader), finishStorageWrites then fills the
+// rest of the mip chain.
+void Texture3D::initForStorage(VkExtent3D extent, bool mipmapped) {
 	if (initialized) return;
 
 	width = extent.width;
 	height = extent.height;
 	depth = extent.depth;
-	channels = 4; // RGBA
-	VkDeviceSize imageSize = width * height * depth * 4;
+	channels = FormatChannelCount(imageFormat);
+	mipLevels = mipmapped ? fullMipChain(width, height, depth) : 1;
 
-	/* for writing in compute shader or elsewhere: add this to the third parameter: | VK_IMAGE_USAGE_STORAGE_BIT */
-	createImage(width, height, depth, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, imageFormat, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	transitionImageLayout(textureImage, imageFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL); // anything better than general? prob not  
-	//actually maybe it should be VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL rather than  VK_IMAGE_LAYOUT_GENERAL
+	createImage(width, height, depth, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, imageFormat, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	transitionImageLayout(textureImage, imageFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
 
 	createImageView();
 	createSampler();
 
+	// storage images are bound one level at a time
+	VkImageViewCreateInfo viewInfo = {};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = textureImage;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_3D;
+	viewInfo.format = imageFormat;
+	viewInfo.subresourceRange.aspectMask = usageBit;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.levelCount = 1;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = 1;
+
+	if (vkCreateImageView(device, &viewInfo, nullptr, &storageImageView) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create storage image view!");
+	}
+
 	initialized = true;
 }
 
+void Texture3D::finishStorageWrites() {
+	transitionImageLayout(textureImage, imageFormat, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	if (mipLevels > 1) {
+		generateMipmaps(); // leaves every level in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+	}
+	else {
+		transitionImageLayout(textureImage, imageFormat, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	}
+}
+
 // TODO: give a usage bit as argument and switch from there for other attachments
 void Texture3D::initForDepthAttachment(VkExtent3D extent) {
 	if (initialized) return;
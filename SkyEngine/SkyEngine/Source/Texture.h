@@ -10,6 +10,8 @@ private:
 
     VkImage textureImage;
     VkDeviceMemory textureImageMemory;
+    VkDeviceSize memorySize = 0;
+    std::string name; // file the image was loaded from, listed in the memory report
 
     VkFormat imageFormat;
 
@@ -25,6 +27,10 @@ private:
     VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 
     VkImageAspectFlagBits usageBit = VK_IMAGE_ASPECT_COLOR_BIT;
+
+    // from decodeFile, until initFromFile uploads them
+    std::vector<unsigned char> decodedPixels;
+    std::string decodedPath;
 public:
     Texture(VkDevice device, VkPhysicalDevice physicalDevice, VkCommandPool commandPool, VkQueue queue, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM)
         : VulkanObject(device, physicalDevice, commandPool, queue) {
@@ -36,13 +42,23 @@ public:
     }
 
     VkFormat getFormat() { return imageFormat; }
+    VkImage getImage() { return textureImage; }
+    // device memory of the image, 0 until it is created
+    VkDeviceSize getMemorySize() const { return memorySize; }
     VkImageView textureImageView;
     VkSampler textureSampler;
 
+    // The CPU half of initFromFile, reads and converts the image without touching Vulkan. Fine on a worker thread,
+    // initFromFile with the same path then only uploads.
+    void decodeFile(std::string path);
     void initFromFile(std::string path);
     void initForStorage(VkExtent2D extent);
     void initForDepthAttachment(VkExtent2D extent);
 
+    // Copies a storage texture (left in VK_IMAGE_LAYOUT_GENERAL) back to the host. Blocks on the queue, debug use only.
+    void readStorage(std::vector<char>& pixels, uint32_t texelSize);
+    VkExtent2D getExtent() { return { static_cast<uint32_t>(width), static_cast<uint32_t>(height) }; }
+
     static VkDescriptorSetLayoutBinding getLayoutBinding(uint32_t bind)
     {
         VkDescriptorSetLayoutBinding samplerLayoutBinding = {};
@@ -64,12 +80,17 @@ private:
 
     VkImage textureImage;
     VkDeviceMemory textureImageMemory;
+    VkDeviceSize memorySize = 0;
+    std::string name; // file the image was loaded from, listed in the memory report
 
     VkFormat imageFormat;
+    uint32_t mipLevels = 1; // full chain for volumes loaded from file, see generateMipmaps
 
     virtual void cleanup();
     void createSampler();
     void createImageView();
+    void generateMipmaps();
+    void upload(const std::vector<unsigned char>& texels);
 
     void createImage(uint32_t width, uint32_t height, uint32_t depth, VkImageUsageFlags usage, VkFormat format, VkMemoryPropertyFlags properties, VkImageTiling tiling);
     void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
@@ -79,6 +100,10 @@ private:
     VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 
     VkImageAspectFlagBits usageBit = VK_IMAGE_ASPECT_COLOR_BIT;
+
+    // from decodeFile, until initFromFile uploads them
+    std::vector<unsigned char> decodedTexels;
+    std::string decodedPath;
 public:
     Texture3D(VkDevice device, VkPhysicalDevice physicalDevice, VkCommandPool commandPool, VkQueue queue,
         const uint32_t width, const uint32_t height, const uint32_t depth,
@@ -92,12 +117,25 @@ public:
     }
 
     VkFormat getFormat() { return imageFormat; }
+    VkImage getImage() { return textureImage; }
+    // device memory of the image, 0 until it is created
+    VkDeviceSize getMemorySize() const { return memorySize; }
     VkImageView textureImageView;
     VkSampler textureSampler;
+    VkImageView storageImageView = VK_NULL_HANDLE; // level 0 only, set by initForStorage
 
+    // Like Texture::decodeFile, loads the packed volume or packs it from its slices
+    void decodeFile(std::string path);
     // This function should supply the "base" name of each texture slice file.
     void initFromFile(std::string path);
-    void initForStorage(VkExtent3D extent);
+    // Texels in the constructor's format and extent, a single level. Used for the voxel brick atlas and its
+    // indirection, mips would blend neighbouring bricks.
+    void initFromData(const std::vector<unsigned char>& texels);
+    // Full mip chain, level 0 left in VK_IMAGE_LAYOUT_GENERAL for a compute shader to write. Without mips the
+    // volume can stay in GENERAL and be written and sampled frame after frame.
+    void initForStorage(VkExtent3D extent, bool mipmapped = true);
+    // After the compute writes: blits the mips and moves every level to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+    void finishStorageWrites();
     void initForDepthAttachment(VkExtent3D extent);
 
     static VkDescriptorSetLayoutBinding getLayoutBinding(uint32_t bind)
@@ -0,0 +1,126 @@
+#include "TextureCache.h"
+
+TextureCache::~TextureCache() {
+    for (auto& entry : entries) {
+        delete entry.second.texture;
+        delete entry.second.volume;
+    }
+}
+
+std::string TextureCache::fileKey(const std::string& path, VkFormat format) {
+    // one file may be loaded into several formats, R8G8 keeps fewer channels than RGBA8
+    return path + "#" + std::to_string(static_cast<int>(format));
+}
+
+TextureCache::Entry* TextureCache::acquireEntry(const std::string& key) {
+    auto found = entries.find(key);
+    if (found == entries.end()) {
+        misses++;
+        return nullptr;
+    }
+    hits++;
+    found->second.users++;
+    found->second.lastUse = ++tick;
+    return &found->second;
+}
+
+void TextureCache::releaseEntry(Entry& entry) {
+    if (entry.users == 0) {
+        throw std::runtime_error("failed to release texture, it is not in use!");
+    }
+    entry.users--;
+    entry.lastUse = ++tick;
+}
+
+Texture* TextureCache::acquire(const std::string& path, VkFormat format) {
+    Entry* entry = acquireEntry(fileKey(path, format));
+    return entry != nullptr ? entry->texture : nullptr;
+}
+
+Texture* TextureCache::insert(const std::string& path, VkFormat format, Texture* texture) {
+    Entry& entry = entries[fileKey(path, format)];
+    if (entry.texture != nullptr || entry.volume != nullptr) {
+        throw std::runtime_error("failed to insert texture, " + path + " is already cached!");
+    }
+    entry.texture = texture;
+    entry.users = 1;
+    entry.lastUse = ++tick;
+    return texture;
+}
+
+Texture3D* TextureCache::acquireVolume(const std::string& key) {
+    Entry* entry = acquireEntry(key);
+    return entry != nullptr ? entry->volume : nullptr;
+}
+
+Texture3D* TextureCache::insertVolume(const std::string& key, Texture3D* volume) {
+    Entry& entry = entries[key];
+    if (entry.texture != nullptr || entry.volume != nullptr) {
+        throw std::runtime_error("failed to insert volume, " + key + " is already cached!");
+    }
+    entry.volume = volume;
+    entry.users = 1;
+    entry.lastUse = ++tick;
+    return volume;
+}
+
+void TextureCache::release(Texture* texture) {
+    if (texture == nullptr) {
+        return;
+    }
+    for (auto& entry : entries) {
+        if (entry.second.texture == texture) {
+            releaseEntry(entry.second);
+            return;
+        }
+    }
+}
+
+void TextureCache::release(Texture3D* volume) {
+    if (volume == nullptr) {
+        return;
+    }
+    for (auto& entry : entries) {
+        if (entry.second.volume == volume) {
+            releaseEntry(entry.second);
+            return;
+        }
+    }
+}
+
+void TextureCache::trim() {
+    VkDeviceSize resident = getStats().residentBytes;
+    while (resident > budget) {
+        auto oldest = entries.end();
+        for (auto entry = entries.begin(); entry != entries.end(); ++entry) {
+            if (entry->second.users == 0 && (oldest == entries.end() || entry->second.lastUse < oldest->second.lastUse)) {
+                oldest = entry;
+            }
+        }
+        if (oldest == entries.end()) {
+            return;
+        }
+        resident -= oldest->second.bytes();
+        delete oldest->second.texture;
+        delete oldest->second.volume;
+        entries.erase(oldest);
+        evictions++;
+    }
+}
+
+TextureCacheStats TextureCache::getStats() const {
+    TextureCacheStats stats = {};
+    for (const auto& entry : entries) {
+        const VkDeviceSize bytes = entry.second.bytes();
+        stats.textures++;
+        stats.residentBytes += bytes;
+        if (entry.second.users == 0) {
+            stats.unused++;
+            stats.unusedBytes += bytes;
+        }
+    }
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.evictions = evictions;
+    return stats;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "Texture.h"
+#include <map>
+#include <string>
+
+struct TextureCacheStats {
+    uint32_t textures;         // cached, used or not
+    uint32_t unused;           // released and waiting to be reused or evicted
+    VkDeviceSize residentBytes; // device memory of every cached texture
+    VkDeviceSize unusedBytes;
+    uint64_t hits, misses, evictions;
+};
+
+// Shares the textures read from files and the volumes generated on the GPU by key: the path and format of a file, a
+// hash of what generated a volume. Loading the same key twice hands out the texture already there. A released texture
+// stays cached, acquiring it again costs nothing, until trim evicts the least recently used to keep the cache within
+// its VRAM budget. Main thread only.
+class TextureCache
+{
+private:
+    struct Entry {
+        Texture* texture = nullptr;
+        Texture3D* volume = nullptr;
+        uint32_t users = 0;
+        uint64_t lastUse = 0; // tick of the last acquire or release
+        VkDeviceSize bytes() const { return texture != nullptr ? texture->getMemorySize() : volume->getMemorySize(); }
+    };
+
+    std::map<std::string, Entry> entries;
+    VkDeviceSize budget;
+    uint64_t tick = 0;
+    uint64_t hits = 0, misses = 0, evictions = 0;
+
+    static std::string fileKey(const std::string& path, VkFormat format);
+    Entry* acquireEntry(const std::string& key);
+    void releaseEntry(Entry& entry);
+
+public:
+    explicit TextureCache(VkDeviceSize budget) : budget(budget) {}
+    ~TextureCache();
+
+    // nullptr the first time, create the texture and insert it then. Either way it is in use until released.
+    Texture* acquire(const std::string& path, VkFormat format);
+    Texture* insert(const std::string& path, VkFormat format, Texture* texture);
+    // key: the path for a volume file, or a hash of what generates it (see NoiseVolumeKey)
+    Texture3D* acquireVolume(const std::string& key);
+    Texture3D* insertVolume(const std::string& key, Texture3D* volume);
+    // Once no recorded command buffer samples it anymore, trim may delete it from then on. nullptr is ignored.
+    void release(Texture* texture);
+    void release(Texture3D* volume);
+
+    // Deletes unused textures, least recently used first, until the cache fits its budget. Textures in use are never
+    // evicted, they alone may still take it over.
+    void trim();
+    void setBudget(VkDeviceSize budget) { this->budget = budget; }
+    VkDeviceSize getBudget() const { return budget; }
+    TextureCacheStats getStats() const;
+};
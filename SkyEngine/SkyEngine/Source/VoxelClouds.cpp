@@ -0,0 +1,72 @@
+#include "VoxelClouds.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+void VoxelCloudScene::add(const VoxelCloudInstance& instance) {
+    if (instances.size() < VOXEL_CLOUD_MAX_INSTANCES) {
+        instances.push_back(instance);
+    }
+}
+
+void VoxelCloudScene::build(const glm::vec3& cameraPosition, VoxelCloudSceneObject& scene) const {
+    const int dim = VOXEL_CLOUD_GRID_DIM;
+    const float cell = VOXEL_CLOUD_GRID_CELL;
+    const glm::vec2 origin = (glm::floor(glm::vec2(cameraPosition.x, cameraPosition.z) / cell) - float(dim / 2)) * cell;
+
+    // cells overlapped by the xz bounds of each instance, first counted and then filled in order
+    std::vector<glm::ivec4> spans(instances.size());
+    std::vector<uint32_t> counts(dim * dim, 0);
+    float nearest = FLT_MAX;
+    for (size_t i = 0; i < instances.size(); i++) {
+        const VoxelCloudInstance& instance = instances[i];
+        const float halfExtent = 0.5f * instance.size * (std::abs(std::cos(instance.yaw)) + std::abs(std::sin(instance.yaw)));
+        const glm::vec2 centre = glm::vec2(instance.position.x, instance.position.z) - origin;
+        const glm::ivec2 lo = glm::clamp(glm::ivec2(glm::floor((centre - halfExtent) / cell)), glm::ivec2(0), glm::ivec2(dim));
+        const glm::ivec2 hi = glm::clamp(glm::ivec2(glm::floor((centre + halfExtent) / cell)) + 1, glm::ivec2(0), glm::ivec2(dim));
+        spans[i] = glm::ivec4(lo, hi);
+        for (int y = lo.y; y < hi.y; y++) {
+            for (int x = lo.x; x < hi.x; x++) {
+                counts[y * dim + x]++;
+            }
+        }
+
+        // unit cube of the volume, the shader flips y for the Vulkan uvw convention itself
+        glm::mat4 worldToVolume = glm::translate(glm::mat4(1.0f), glm::vec3(0.5f));
+        worldToVolume = glm::scale(worldToVolume, glm::vec3(1.0f / instance.size));
+        worldToVolume = glm::rotate(worldToVolume, -instance.yaw, glm::vec3(0.0f, 1.0f, 0.0f));
+        worldToVolume = glm::translate(worldToVolume, -instance.position);
+        scene.instances[i].worldToVolume = worldToVolume;
+        scene.instances[i].volume = instance.volume;
+        scene.instances[i].densityScale = instance.densityScale;
+        scene.instances[i].size = instance.size;
+        scene.instances[i].pad = 0.0f;
+
+        // box distance in the instance's frame
+        const glm::vec3 local = glm::abs(glm::vec3(worldToVolume * glm::vec4(cameraPosition, 1.0f)) - 0.5f) * instance.size - 0.5f * instance.size;
+        const float distance = glm::length(glm::max(local, 0.0f)) + std::min(std::max(local.x, std::max(local.y, local.z)), 0.0f);
+        nearest = std::min(nearest, distance);
+    }
+
+    uint32_t offset = 0;
+    for (int c = 0; c < dim * dim; c++) {
+        const uint32_t count = std::min(counts[c], VOXEL_CLOUD_MAX_REFERENCES - offset);
+        scene.cells[c] = glm::uvec2(offset, 0);
+        counts[c] = count;
+        offset += count;
+    }
+    for (size_t i = 0; i < instances.size(); i++) {
+        for (int y = spans[i].y; y < spans[i].w; y++) {
+            for (int x = spans[i].x; x < spans[i].z; x++) {
+                glm::uvec2& range = scene.cells[y * dim + x];
+                if (range.y < counts[y * dim + x]) {
+                    scene.references[range.x + range.y++] = static_cast<uint32_t>(i);
+                }
+            }
+        }
+    }
+
+    scene.gridOrigin = glm::vec4(origin.x, cell, origin.y, nearest);
+    scene.gridInfo = glm::uvec4(dim, static_cast<uint32_t>(instances.size()), offset, 0);
+}
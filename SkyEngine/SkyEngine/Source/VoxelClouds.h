@@ -0,0 +1,67 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+#include <vector>
+
+// compute-clouds.comp mirrors these
+#define VOXEL_CLOUD_MAX_INSTANCES 256
+#define VOXEL_CLOUD_GRID_DIM 32          // cells per axis, the grid follows the camera
+#define VOXEL_CLOUD_GRID_CELL 10000.0f   // metres, about the size of one authored cloud
+#define VOXEL_CLOUD_MAX_REFERENCES 2048  // instance references over all cells
+
+// An authored voxel cloud placed in the world
+struct VoxelCloudInstance {
+    glm::vec3 position;   // centre of the box
+    float size;           // edge length in metres, the volumes are cubes
+    float yaw;            // radians about the up axis
+    uint32_t volume;      // handle of the indirection grid of the cloud in the descriptor heap
+    float densityScale;
+};
+
+// std430, one per instance
+struct VoxelCloudGPUInstance {
+    glm::mat4 worldToVolume; // world position to the unit cube of the volume
+    uint32_t volume;
+    float densityScale;
+    float size;
+    float pad;
+};
+
+// Storage buffer read by the raymarcher. The instances are binned into a uniform grid on the xz plane, a step only
+// tests the instances of its own cell.
+struct VoxelCloudSceneObject {
+    glm::vec4 gridOrigin;  // xz: corner of cell (0, 0), y: cell size, w: distance from the camera to the nearest cloud
+    glm::uvec4 gridInfo;   // x: cells per axis, y: instances, z: references
+    VoxelCloudGPUInstance instances[VOXEL_CLOUD_MAX_INSTANCES];
+    glm::uvec2 cells[VOXEL_CLOUD_GRID_DIM * VOXEL_CLOUD_GRID_DIM]; // x: first reference, y: count
+    uint32_t references[VOXEL_CLOUD_MAX_REFERENCES];
+
+    static VkDescriptorSetLayoutBinding getLayoutBinding(uint32_t bind)
+    {
+        VkDescriptorSetLayoutBinding layoutBinding = {};
+        layoutBinding.binding = bind;
+        layoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        layoutBinding.descriptorCount = 1;
+        layoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        layoutBinding.pImmutableSamplers = nullptr;
+
+        return layoutBinding;
+    }
+};
+
+class VoxelCloudScene
+{
+private:
+    std::vector<VoxelCloudInstance> instances;
+
+public:
+    void clear() { instances.clear(); }
+    void add(const VoxelCloudInstance& instance);
+    size_t size() const { return instances.size(); }
+
+    // Rebuilds the grid around the camera. Instances outside the grid and references past the budget are dropped.
+    void build(const glm::vec3& cameraPosition, VoxelCloudSceneObject& scene) const;
+};
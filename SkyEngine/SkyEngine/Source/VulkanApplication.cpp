@@ -1,8 +1,12 @@
 #include "VulkanApplication.h"
 #include <sstream>
+#include <glm/gtc/packing.hpp>
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_vulkan.h"
+#include "ImageUtils.h"
+#include "NoiseBaker.h"
+#include "stb_image_write.h"
 
 static void check_vk_result(VkResult err)
 {
@@ -13,6 +17,57 @@ static void check_vk_result(VkResult err)
 		abort();
 }
 
+// Cloud volumes, each in the format that holds just the channels the shaders read
+struct CloudVolumeAsset {
+	const char* path; // base name of the tga slices, note: no .png
+	uint32_t width, height, depth;
+	VkFormat format;
+};
+
+enum CloudVolume { LowResCloudShape, NubisCloudShape, SDFCloudShape01, SDFCloudShape02, HiResCloudShape, CloudVolumeCount };
+
+static const CloudVolumeAsset cloudVolumeAssets[CloudVolumeCount] = {
+	{ "Textures/3DTextures/lowResCloudShape/lowResCloud", 128, 128, 128, VK_FORMAT_R8G8B8A8_UNORM }, // base shape + three erosion octaves
+	{ "Textures/3DTextures/Curly_AlligatorCloudShape/NubisVoxelCloudNoise", 128, 128, 128, VK_FORMAT_R8G8B8A8_UNORM }, // wispy and billowy pairs
+	{ "Textures/3DTextures/SDFCloudShape_01/SDFCloudShape", 128, 128, 128, VK_FORMAT_R8G8_UNORM }, // r: density, g: distance, bricked
+	{ "Textures/3DTextures/SDFCloudShape_02/Cloud_Bake_pighead", 128, 128, 128, VK_FORMAT_R8G8_UNORM }, // into the voxel cloud pool
+	{ "Textures/3DTextures/hiResCloudShape/hiResClouds ", 32, 32, 32, VK_FORMAT_R8G8B8A8_UNORM }, // rgb, there is no sampleable rgb8
+};
+
+// Voxel clouds in the order compute-clouds.comp indexes them, all sharing one sparse brick pool
+static const CloudVolume voxelClouds[] = { SDFCloudShape01, SDFCloudShape02 };
+static const char* voxelCloudPoolPath = "Textures/3DTextures/voxelClouds.brk";
+
+// The low res noise volume when ENABLE_GPU_NOISE is off, the Nubis volume has no noise preset and is always loaded
+static CloudVolume lowResCloudVolume() {
+	return (ENABLE_NEW_NOISE) ? NubisCloudShape : LowResCloudShape;
+}
+
+// Pipelines compiled by the runs before, next to the executable
+static const char* pipelineCachePath = "pipeline.cache";
+static const char* memoryReportPath = "memory-report.json";
+
+// startupPhases is appended to from the workers
+static std::mutex startupPhaseMutex;
+
+// Noise bakes are cached here under a hash of their parameters
+static const char* noiseCacheDir = "Textures/3DTextures";
+
+// Noise volume sizes per quality tier (ENABLE_GPU_NOISE), medium matches the shipped volumes
+struct NoiseQualityTier {
+	uint32_t lowResSize, hiResSize;
+};
+
+static const NoiseQualityTier noiseQualityTiers[] = { { 64, 16 }, { 128, 32 }, { 256, 64 } };
+
+static std::vector<std::string> voxelCloudPaths() {
+	std::vector<std::string> paths;
+	for (CloudVolume volume : voxelClouds) {
+		paths.push_back(cloudVolumeAssets[volume].path);
+	}
+	return paths;
+}
+
 /// --- callback proxy functions
 VkResult CreateDebugReportCallbackEXT(VkInstance instance, const VkDebugReportCallbackCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugReportCallbackEXT* pCallback) {
 	auto func = (PFN_vkCreateDebugReportCallbackEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugReportCallbackEXT");
@@ -59,41 +114,134 @@ void VulkanApplication::initWindow() {
 void VulkanApplication::initVulkan() {
 
 	rendererSystem = RendererManager();
+	jobs = new JobSystem();
+	textureCache = new TextureCache(static_cast<VkDeviceSize>(TEXTURE_CACHE_BUDGET_MB) << 20);
 
-	createInstance();
+	timeStartupPhase("device", [this]() {
+		createInstance();
 #ifdef _DEBUG
-	setupDebugCallback();
+		setupDebugCallback();
 #endif
-	createSurface();
-	pickPhysicalDevice();
-	createLogicalDevice();
-	createSwapChain();
-	createImageViews();
+		createSurface();
+		pickPhysicalDevice();
+		createLogicalDevice();
+		createSwapChain();
+		createImageViews();
 
-	createRenderPass();
+		createRenderPass();
+
+		createCommandPool();
+		createPipelineCache();
+		descriptorHeap = new DescriptorHeap(device);
+	});
 
-	createCommandPool();
+	// The files are read and decoded on the workers from here, each step below waits for the ones it uploads
+	decodeAssets();
 
-	initializeTextures();
+	timeStartupPhase("textures", [this]() { initializeTextures(); });
 
 	createFramebuffers(); // must come after so depth texture is initialized
 
 	setupOffscreenPass();
 
-	initializeGeometry();
+	CreateQueryPool();
 
-	initializeShaders();
+	// Nothing else uses the queue until the shaders are done, so the geometry uploads on a worker meanwhile
+	JobHandle geometry = submitStartupPhase("geometry", [this]() { initializeGeometry(); });
+	timeStartupPhase("shaders", [this, geometry]() { initializeShaders(geometry); });
 
-	init_imgui(window, VK_FORMAT_B8G8R8A8_UNORM);
+	// recorded once everything they bind is loaded
+	timeStartupPhase("command buffers", [this]() {
+		init_imgui(window, VK_FORMAT_B8G8R8A8_UNORM);
 
-	createCommandBuffers();
-	createPostProcessCommandBuffer();
-	createComputeCommandBuffer();
-	createSemaphores();
+		createCommandBuffers();
+		createPostProcessCommandBuffer();
+		createComputeCommandBuffer();
+		createSemaphores();
+	});
 
 	mainCamera = Camera(glm::vec3(0.f, 1.f, 1.f), glm::vec3(-1.f, 1.f, 0.f), 0.1f, 1000.0f, 45.0f);
 	mainCamera.setAspect((float)swapChainExtent.width, (float)swapChainExtent.height);
 	skySystem = SkyManager();
+
+	printStartupTimeline();
+}
+
+float VulkanApplication::millisecondsSinceStartup() const {
+	return std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - startupBegin).count();
+}
+
+void VulkanApplication::timeStartupPhase(const std::string& name, const std::function<void()>& phase) {
+	const float begin = millisecondsSinceStartup();
+	phase();
+	const float end = millisecondsSinceStartup();
+	std::lock_guard<std::mutex> lock(startupPhaseMutex);
+	startupPhases.push_back({ name, JobSystem::currentThread(), begin, end });
+}
+
+JobHandle VulkanApplication::submitStartupPhase(const std::string& name, std::function<void()> phase, const std::vector<JobHandle>& dependencies) {
+	return jobs->submit([this, name, phase]() { timeStartupPhase(name, phase); }, dependencies);
+}
+
+// Every phase of initVulkan in the order they began, on the thread that ran it
+void VulkanApplication::printStartupTimeline() {
+	std::sort(startupPhases.begin(), startupPhases.end(), [](const StartupPhase& a, const StartupPhase& b) { return a.begin < b.begin; });
+	std::cout << "startup timeline, ms since launch:" << std::endl;
+	for (const StartupPhase& phase : startupPhases) {
+		char thread[16];
+		if (phase.thread == 0) {
+			snprintf(thread, sizeof(thread), "main");
+		}
+		else {
+			snprintf(thread, sizeof(thread), "worker %u", phase.thread);
+		}
+		printf("  %8.1f - %8.1f  %-9s %s\n", phase.begin, phase.end, thread, phase.name.c_str());
+	}
+	std::cout << "initialised in " << millisecondsSinceStartup() << " ms on " << jobs->getThreadCount() << " threads" << std::endl;
+}
+
+// Loads the cache of the last run unless another driver or device wrote it, Vulkan would just ignore it then but not
+// every driver is that careful.
+void VulkanApplication::createPipelineCache() {
+	std::vector<char> data;
+	std::ifstream file(pipelineCachePath, std::ios::ate | std::ios::binary);
+	if (file.is_open()) {
+		data.resize(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		file.read(data.data(), data.size());
+	}
+
+	// VkPipelineCacheHeaderVersionOne: header size, header version, vendor, device, cache UUID
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	bool valid = data.size() >= 16 + VK_UUID_SIZE;
+	if (valid) {
+		uint32_t header[4];
+		memcpy(header, data.data(), sizeof(header));
+		valid = header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE && header[2] == properties.vendorID && header[3] == properties.deviceID
+			&& memcmp(data.data() + 16, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+	}
+	std::cout << "pipeline cache: " << (valid ? std::to_string(data.size() / 1024) + " KB from the last run" : std::string("empty")) << std::endl;
+
+	VkPipelineCacheCreateInfo cacheInfo = {};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheInfo.initialDataSize = valid ? data.size() : 0;
+	cacheInfo.pInitialData = valid ? data.data() : nullptr;
+	if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &Shader::pipelineCache) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create pipeline cache!");
+	}
+}
+
+void VulkanApplication::savePipelineCache() {
+	size_t size = 0;
+	std::vector<char> data;
+	if (vkGetPipelineCacheData(device, Shader::pipelineCache, &size, nullptr) == VK_SUCCESS && size > 0) {
+		data.resize(size);
+		vkGetPipelineCacheData(device, Shader::pipelineCache, &size, data.data());
+		std::ofstream file(pipelineCachePath, std::ios::binary);
+		file.write(data.data(), size);
+	}
+	vkDestroyPipelineCache(device, Shader::pipelineCache, nullptr);
 }
 void VulkanApplication::init_imgui(GLFWwindow* window, VkFormat format)
 {
@@ -223,7 +371,7 @@ void VulkanApplication::init_imgui(GLFWwindow* window, VkFormat format)
 	init_info.Device = device;
 	init_info.QueueFamily = g_QueueFamily;
 	init_info.Queue = graphicsQueue;
-	init_info.PipelineCache = VK_NULL_HANDLE;
+	init_info.PipelineCache = Shader::pipelineCache;
 	init_info.DescriptorPool = imgui_DescriptorPool;
 	init_info.Subpass = 0;
 	init_info.MinImageCount = 3;
@@ -245,12 +393,12 @@ void VulkanApplication::init_imgui(GLFWwindow* window, VkFormat format)
 	}
 }
 
-void VulkanApplication::draw_imgui()
+void VulkanApplication::draw_imgui(uint32_t imageIndex)
 {
 	VkResult err = vkResetCommandPool(device, imgui_CommandPool, 0);
 	check_vk_result(err);
 
-	uint32_t id = swapBackgroundImages ? 1 : 0;
+	uint32_t id = imageIndex;
 
 	VkCommandBufferBeginInfo commandbufferinfo = {};
 	commandbufferinfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -423,6 +571,9 @@ void VulkanApplication::ShowModelingPanel(bool* enable)
 		ImGui::SliderFloat("Local Wind Strength", &cloudinfo1[3], 0.0f, 10.0f);
 
 
+		ImGui::SeparatorText("Voxel Cloud Setting");
+		ImGui::SliderFloat("voxel cloud instances", &rendererSystem.GetFloatParams("voxel_cloud_count"), 0.0f, VOXEL_CLOUD_MAX_INSTANCES, "%.0f");
+
 		ImGui::SeparatorText("Cirrus Layer Setting");
 		ImGui::SliderFloat("cirrusCloudType", &cirrusWindDir[3], 0.0f, 1.0f);
 		ImGui::SetNextItemWidth(800);
@@ -510,6 +661,43 @@ void VulkanApplication::ShowRenderingPanel(bool* enable)
 		ImGui::SliderFloat("sdfboundBoxScaleMax", &cloudinfo4[2], 0.001f, 1000.f);
 		ImGui::SliderFloat("sdf_scale", &cloudinfo4[1], 0.0f, 2.0f);
 
+		ImGui::SeparatorText("Cloud History");
+		if (ImGui::Button("Measure history precision")) {
+			measureHistoryPrecision();
+		}
+		if (!historyPrecisionReport.empty()) {
+			ImGui::TextUnformatted(historyPrecisionReport.c_str());
+		}
+
+		if ((ENABLE_GPU_NOISE))
+		{
+			ImGui::SeparatorText("Cloud Noise");
+			ImGui::Combo("noise quality", &pendingNoiseQuality, "Low (64 / 16)\0Medium (128 / 32)\0High (256 / 64)\0\0");
+			ImGui::Text("generated in %.1f ms, %.1f ms on the GPU", noiseMilliseconds, noiseGpuMilliseconds);
+		}
+
+		ImGui::SeparatorText("Texture Cache");
+		const TextureCacheStats cacheStats = textureCache->getStats();
+		ImGui::Text("%u textures, %.1f MB resident, %u unused (%.1f MB)", cacheStats.textures, cacheStats.residentBytes / 1048576.0f,
+			cacheStats.unused, cacheStats.unusedBytes / 1048576.0f);
+		ImGui::Text("%llu hits, %llu misses, %llu evicted", static_cast<unsigned long long>(cacheStats.hits), static_cast<unsigned long long>(cacheStats.misses),
+			static_cast<unsigned long long>(cacheStats.evictions));
+		int budgetMB = static_cast<int>(textureCache->getBudget() >> 20);
+		if (ImGui::SliderInt("budget MB", &budgetMB, 0, 1024)) {
+			// only released textures are evicted, no recorded command buffer samples those
+			textureCache->setBudget(static_cast<VkDeviceSize>(budgetMB) << 20);
+			textureCache->trim();
+		}
+
+		ImGui::SeparatorText("Memory");
+		ShowMemoryReport();
+
+		ImGui::SeparatorText("GPU Timeline");
+		ShowGpuTimeline();
+
+		ImGui::SeparatorText("CPU Jobs");
+		ShowJobStats();
+
 		ImGui::TreePop();
 	}
 
@@ -517,7 +705,151 @@ void VulkanApplication::ShowRenderingPanel(bool* enable)
 
 }
 
+// One row per queue. The compute of a frame is drawn against the graphics of the frame before, that is what it runs
+// alongside. Assumes all queues count on the same timestamp clock, true on desktop GPUs but not promised by Vulkan.
+void VulkanApplication::ShowGpuTimeline()
+{
+	if (timelineResults.empty()) {
+		ImGui::Text("timestamps are not supported");
+		return;
+	}
+
+	const int queueCount = static_cast<int>(RenderGraphQueue::Count);
+	uint64_t queueBegin[queueCount], queueEnd[queueCount];
+	for (int q = 0; q < queueCount; q++) {
+		queueBegin[q] = UINT64_MAX;
+		queueEnd[q] = 0;
+	}
+	uint64_t frameBegin = UINT64_MAX, frameEnd = 0;
+	for (uint32_t p = 0; p < renderGraph.getPassCount(); p++) {
+		const uint64_t begin = timelineResults[2 * p], end = timelineResults[2 * p + 1];
+		if (begin == 0 || end < begin) {
+			continue;
+		}
+		const int q = static_cast<int>(renderGraph.getPassQueue(p));
+		queueBegin[q] = std::min(queueBegin[q], begin);
+		queueEnd[q] = std::max(queueEnd[q], end);
+		frameBegin = std::min(frameBegin, begin);
+		frameEnd = std::max(frameEnd, end);
+	}
+	if (frameEnd <= frameBegin) {
+		ImGui::Text("waiting for timestamps");
+		return;
+	}
+
+	const float toMs = timestampPeriod * 1e-6f;
+	const float span = static_cast<float>(frameEnd - frameBegin);
+	const char* rowNames[] = { "compute", "offscreen", "present" };
+	const ImU32 rowColors[] = { IM_COL32(230, 150, 60, 255), IM_COL32(80, 160, 230, 255), IM_COL32(120, 200, 120, 255) };
+	const float labelWidth = 80.0f;
+	const float rowHeight = ImGui::GetTextLineHeight();
+	const float barWidth = std::max(ImGui::GetContentRegionAvail().x - labelWidth, 100.0f);
+	ImDrawList* drawList = ImGui::GetWindowDrawList();
+	for (int q = 0; q < queueCount; q++) {
+		ImGui::TextUnformatted(rowNames[q]);
+		ImGui::SameLine(labelWidth);
+		const ImVec2 origin = ImGui::GetCursorScreenPos();
+		drawList->AddRectFilled(origin, ImVec2(origin.x + barWidth, origin.y + rowHeight), IM_COL32(40, 40, 40, 255));
+		for (uint32_t p = 0; p < renderGraph.getPassCount(); p++) {
+			const uint64_t begin = timelineResults[2 * p], end = timelineResults[2 * p + 1];
+			if (static_cast<int>(renderGraph.getPassQueue(p)) != q || begin == 0 || end < begin) {
+				continue;
+			}
+			const float x0 = origin.x + barWidth * (begin - frameBegin) / span;
+			const float x1 = origin.x + barWidth * (end - frameBegin) / span;
+			drawList->AddRectFilled(ImVec2(x0, origin.y + 1), ImVec2(std::max(x1, x0 + 1.0f), origin.y + rowHeight - 1), rowColors[q]);
+		}
+		ImGui::Dummy(ImVec2(barWidth, rowHeight));
+	}
+
+	for (uint32_t p = 0; p < renderGraph.getPassCount(); p++) {
+		const uint64_t begin = timelineResults[2 * p], end = timelineResults[2 * p + 1];
+		if (begin != 0 && end >= begin) {
+			ImGui::Text("%s [%s] %.3f ms", renderGraph.getPassName(p).c_str(), rowNames[static_cast<int>(renderGraph.getPassQueue(p))], (end - begin) * toMs);
+		}
+	}
+
+	const int compute = static_cast<int>(RenderGraphQueue::Compute);
+	const uint64_t graphicsBegin = std::min(queueBegin[static_cast<int>(RenderGraphQueue::Offscreen)], queueBegin[static_cast<int>(RenderGraphQueue::Present)]);
+	const uint64_t graphicsEnd = std::max(queueEnd[static_cast<int>(RenderGraphQueue::Offscreen)], queueEnd[static_cast<int>(RenderGraphQueue::Present)]);
+	if (queueEnd[compute] != 0 && graphicsEnd != 0) {
+		const uint64_t overlapBegin = std::max(queueBegin[compute], graphicsBegin);
+		const uint64_t overlapEnd = std::min(queueEnd[compute], graphicsEnd);
+		const float overlap = overlapEnd > overlapBegin ? (overlapEnd - overlapBegin) * toMs : 0.0f;
+		ImGui::Text("compute %.3f ms, %.3f ms of it under the graphics of the frame before", (queueEnd[compute] - queueBegin[compute]) * toMs, overlap);
+	}
+	if (!asyncCompute) {
+		ImGui::Text("no separate compute queue, the queues run back to back");
+	}
+}
+
+// One row per thread of the job system, averaged over a second so the bars don't flicker with every frame
+void VulkanApplication::ShowJobStats()
+{
+	if (jobStats.empty() || prevTime - jobStatsTime >= 1.0f) {
+		jobStats = jobs->getStats();
+		jobs->resetStats();
+		jobStatsTime = prevTime;
+	}
+
+	for (size_t t = 0; t < jobStats.size(); t++) {
+		char label[64];
+		snprintf(label, sizeof(label), "%llu jobs, %llu stolen", static_cast<unsigned long long>(jobStats[t].jobs), static_cast<unsigned long long>(jobStats[t].steals));
+		if (t == 0) {
+			ImGui::TextUnformatted("main");
+		}
+		else {
+			ImGui::Text("worker %zu", t);
+		}
+		ImGui::SameLine(80.0f);
+		ImGui::ProgressBar(jobStats[t].utilisation, ImVec2(-1.0f, 0.0f), label);
+	}
+}
+
+
+// Usage against budget of every heap, the tracked allocations by category and, folded, one by one largest first.
+// Queried again once a second, like the job stats, rather than every frame the panel is open.
+void VulkanApplication::ShowMemoryReport()
+{
+	if (memoryReport.heaps.empty() || prevTime - memoryReportTime >= 1.0f) {
+		memoryReport = QueryMemoryReport(instance, physicalDevice, memoryBudget);
+		memoryReportTime = prevTime;
+	}
+	const MemoryReport& report = memoryReport;
+
+	for (size_t h = 0; h < report.heaps.size(); h++) {
+		const MemoryHeapReport& heap = report.heaps[h];
+		char label[96];
+		snprintf(label, sizeof(label), "%.0f / %.0f MB, %.0f MB tracked", heap.usage / 1048576.0, heap.budget / 1048576.0, heap.tracked / 1048576.0);
+		ImGui::Text("heap %zu %s", h, heap.deviceLocal ? "(VRAM)" : "(host)");
+		ImGui::SameLine(120.0f);
+		ImGui::ProgressBar(heap.budget > 0 ? static_cast<float>(static_cast<double>(heap.usage) / heap.budget) : 0.0f, ImVec2(-1.0f, 0.0f), label);
+	}
+	if (!report.budgetExtension) {
+		ImGui::TextUnformatted("no VK_EXT_memory_budget, usage counts the tracked allocations against the heap size");
+	}
+
+	for (int c = 0; c < static_cast<int>(MemoryCategory::Count); c++) {
+		ImGui::Text("%-16s %8.1f MB", MemoryCategoryName(static_cast<MemoryCategory>(c)), report.categoryBytes[c] / 1048576.0);
+	}
+
+	if (ImGui::TreeNode("allocations", "%zu allocations", report.allocations.size())) {
+		for (const TrackedAllocation& allocation : report.allocations) {
+			ImGui::Text("%8.2f MB  %-14s heap %u  %s  %s", allocation.size / 1048576.0, MemoryCategoryName(allocation.category), allocation.heap,
+				allocation.name.c_str(), allocation.detail.c_str());
+		}
+		ImGui::TreePop();
+	}
 
+	if (ImGui::Button("Write memory report")) {
+		// as of now, not of the last refresh
+		memoryReport = QueryMemoryReport(instance, physicalDevice, memoryBudget);
+		memoryReportTime = prevTime;
+		std::ofstream file(memoryReportPath);
+		WriteMemoryReport(memoryReport, file);
+		std::cout << "memory report written to " << memoryReportPath << std::endl;
+	}
+}
 
 void VulkanApplication::initImguiFrameBuffer()
 {
@@ -559,10 +891,10 @@ void VulkanApplication::DestroyImguiFrameBuffer()
 
 }
 
-VkSubmitInfo VulkanApplication::ImguiQueueSubmit(VkSemaphore* waitSemaphore)
+VkSubmitInfo VulkanApplication::ImguiQueueSubmit(VkSemaphore* waitSemaphore, uint32_t imageIndex)
 {
-	draw_imgui();
-	uint32_t id = swapBackgroundImages ? 1 : 0;
+	draw_imgui(imageIndex);
+	uint32_t id = imageIndex;
 	static VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -631,8 +963,15 @@ void VulkanApplication::mainLoop() {
 
 		glfwPollEvents();
 		processInputs();
-		updateUniformBuffer();
+		if (pendingNoiseQuality != noiseQuality) {
+			noiseQuality = pendingNoiseQuality;
+			regenerateCloudNoise();
+		}
 		drawFrame();
+		if (!firstFrameDrawn) {
+			firstFrameDrawn = true;
+			std::cout << "first frame after " << millisecondsSinceStartup() << " ms" << std::endl;
+		}
 
 		prevTime = time;
 	}
@@ -652,6 +991,12 @@ void VulkanApplication::cleanup() {
 	vkDestroyCommandPool(device, computeCommandPool, nullptr);
 	vkDestroySemaphore(device, renderFinishedSemaphore, nullptr);
 	vkDestroySemaphore(device, imageAvailableSemaphore, nullptr);
+	for (VkSemaphore semaphore : queueEdgeSemaphores) {
+		vkDestroySemaphore(device, semaphore, nullptr);
+	}
+	vkDestroyFence(device, computeFence, nullptr);
+	vkDestroyFence(device, graphicsFence, nullptr);
+	vkDestroyQueryPool(device, mTimeQueryPool, nullptr);
 
 	//imgui 
 	Cleanup_imgui();
@@ -663,6 +1008,8 @@ void VulkanApplication::cleanup() {
 
 	cleanupTextures();
 	cleanupShaders();
+	delete descriptorHeap;
+	savePipelineCache();
 
 	vkDestroyDevice(device, nullptr);
 
@@ -675,6 +1022,8 @@ void VulkanApplication::cleanup() {
 
 	glfwDestroyWindow(window);
 	glfwTerminate();
+
+	delete jobs;
 }
 
 void VulkanApplication::processInputs() {
@@ -708,19 +1057,6 @@ void VulkanApplication::processInputs() {
 
 void VulkanApplication::drawFrame() {
 
-	// submit compute queue
-	// Compute queue submit
-	VkSubmitInfo computeSubmitInfo = {};
-	computeSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-	computeSubmitInfo.commandBufferCount = 1;
-	computeSubmitInfo.pCommandBuffers = &computeCommandBuffers[(swapBackgroundImages ? 1 : 0)];
-	swapBackgroundImages = !swapBackgroundImages;
-
-	if (vkQueueSubmit(computeQueue, 1, &computeSubmitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to submit compute command buffer");
-	}
-
 	// acquire image from swap chain
 	// execute corresponding command buffer
 	// return the image to the swap chain, presentation mode
@@ -736,18 +1072,73 @@ void VulkanApplication::drawFrame() {
 		throw std::runtime_error("failed to acquire swap chain image!");
 	}
 
+	// Semaphores for the dependencies between the queues, see RenderGraph::getQueueEdges. Edges to the frame before
+	// have nothing signalled yet in the first frame.
+	const std::vector<RenderGraph::QueueEdge>& queueEdges = renderGraph.getQueueEdges();
+	auto collectQueueEdges = [&](RenderGraphQueue queue, std::vector<VkSemaphore>& waits, std::vector<VkPipelineStageFlags>& waitStages, std::vector<VkSemaphore>& signals) {
+		for (size_t e = 0; e < queueEdges.size(); e++) {
+			if (queueEdges[e].consumer == queue && !(queueEdges[e].previousFrame && frameCount == 0)) {
+				waits.push_back(queueEdgeSemaphores[e]);
+				waitStages.push_back(queueEdges[e].waitStage);
+			}
+			if (queueEdges[e].producer == queue) {
+				signals.push_back(queueEdgeSemaphores[e]);
+			}
+		}
+	};
+
+	// Compute queue submit
+	// Only waits for the compute of the frame before. With a separate compute queue the clouds of this frame then
+	// overlap the graphics of the frame before, only the copy to the display texture waits for its scene pass.
+	vkWaitForFences(device, 1, &computeFence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+	vkResetFences(device, 1, &computeFence);
+	FetchRenderTimeResults(RenderGraphQueue::Compute);
+	timelineResults = mTimeQueryResults; // graphics results are still those of the frame before
+	updateUniformBuffer();
+	// the push constants of this frame
+	recordComputeCommandBuffer(swapBackgroundImages ? 1 : 0);
+
+	std::vector<VkSemaphore> computeWaits, computeSignals;
+	std::vector<VkPipelineStageFlags> computeWaitStages;
+	collectQueueEdges(RenderGraphQueue::Compute, computeWaits, computeWaitStages, computeSignals);
+
+	VkSubmitInfo computeSubmitInfo = {};
+	computeSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	computeSubmitInfo.waitSemaphoreCount = static_cast<uint32_t>(computeWaits.size());
+	computeSubmitInfo.pWaitSemaphores = computeWaits.data();
+	computeSubmitInfo.pWaitDstStageMask = computeWaitStages.data();
+	computeSubmitInfo.signalSemaphoreCount = static_cast<uint32_t>(computeSignals.size());
+	computeSubmitInfo.pSignalSemaphores = computeSignals.data();
+
+	computeSubmitInfo.commandBufferCount = 1;
+	computeSubmitInfo.pCommandBuffers = &computeCommandBuffers[(swapBackgroundImages ? 1 : 0)];
+	swapBackgroundImages = !swapBackgroundImages;
+
+	if (vkQueueSubmit(computeQueue, 1, &computeSubmitInfo, computeFence) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to submit compute command buffer");
+	}
+
+	// the graphics uniforms and the imgui command buffer are still in use until the graphics of the frame before are done
+	vkWaitForFences(device, 1, &graphicsFence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+	vkResetFences(device, 1, &graphicsFence);
+	FetchRenderTimeResults(RenderGraphQueue::Offscreen);
+	FetchRenderTimeResults(RenderGraphQueue::Present);
+	updateGraphicsUniformBuffers();
+
+	std::vector<VkSemaphore> waitSemaphores = { imageAvailableSemaphore };
+	std::vector<VkPipelineStageFlags> waitStages = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+	std::vector<VkSemaphore> offscreenSignals = { offscreenPass.semaphore };
+	collectQueueEdges(RenderGraphQueue::Offscreen, waitSemaphores, waitStages, offscreenSignals);
+
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-	VkSemaphore waitSemaphores[] = { imageAvailableSemaphore };
-	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = waitSemaphores;
-	submitInfo.pWaitDstStageMask = waitStages; // what part of the pipeline is blocked by semaphore; vertex processing can still continue
+	submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+	submitInfo.pWaitSemaphores = waitSemaphores.data();
+	submitInfo.pWaitDstStageMask = waitStages.data(); // what part of the pipeline is blocked by semaphore; vertex processing can still continue
 
 	// Do all offscreen rendering
-	submitInfo.pSignalSemaphores = { &offscreenPass.semaphore };
-	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = offscreenSignals.data();
+	submitInfo.signalSemaphoreCount = static_cast<uint32_t>(offscreenSignals.size());
 	submitInfo.commandBufferCount = 1;
 	submitInfo.pCommandBuffers = &offscreenPass.commandBuffers[(swapBackgroundImages ? 1 : 0)];
 
@@ -758,16 +1149,18 @@ void VulkanApplication::drawFrame() {
 	VkSemaphore signalSemaphores[] = { renderFinishedSemaphore };
 
 	// Draw the scene onto the screen
+	submitInfo.waitSemaphoreCount = 1;
 	submitInfo.pWaitSemaphores = &offscreenPass.semaphore;
+	submitInfo.signalSemaphoreCount = 1;
 	submitInfo.pSignalSemaphores = signalSemaphores;
 	submitInfo.commandBufferCount = 1;
 	submitInfo.pCommandBuffers = &commandBuffers[imageIndex]; // what is executed
 
 	//UI_PASS
-	VkSubmitInfo submit_imgui_info = ImguiQueueSubmit(signalSemaphores);
+	VkSubmitInfo submit_imgui_info = ImguiQueueSubmit(signalSemaphores, imageIndex);
 	VkSubmitInfo submit_infos[] = { submitInfo,submit_imgui_info };
 
-	if (vkQueueSubmit(graphicsQueue, _countof(submit_infos), submit_infos, VK_NULL_HANDLE) != VK_SUCCESS) {
+	if (vkQueueSubmit(graphicsQueue, _countof(submit_infos), submit_infos, graphicsFence) != VK_SUCCESS) {
 		throw std::runtime_error("failed to submit draw command buffer!");
 	}
 
@@ -785,105 +1178,528 @@ void VulkanApplication::drawFrame() {
 
 	vkQueuePresentKHR(presentQueue, &presentInfo); // present the image
 
-	vkQueueWaitIdle(presentQueue); // sync to avoid mem leaks
+	frameCount++;
+}
+
+// Creates the objects of every texture, volume and mesh read from a file and decodes them on the workers, the
+// initialize steps upload them once textureDecodes and meshDecodes have finished. Textures come from textureCache,
+// a file loaded twice is decoded once.
+void VulkanApplication::decodeAssets() {
+	std::vector<JobHandle> decodes;
+	auto decodeTexture = [&](const std::string& path, VkFormat format) {
+		Texture* texture = textureCache->acquire(path, format);
+		if (texture == nullptr) {
+			texture = textureCache->insert(path, format, new Texture(device, physicalDevice, commandPool, graphicsQueue, format));
+			decodes.push_back(submitStartupPhase("decode " + path, [texture, path]() { texture->decodeFile(path); }));
+		}
+		return texture;
+	};
+	auto decodeCloudVolume = [&](CloudVolume volume) {
+		const CloudVolumeAsset& asset = cloudVolumeAssets[volume];
+		const std::string path = asset.path;
+		Texture3D* texture = textureCache->acquireVolume(path);
+		if (texture == nullptr) {
+			texture = textureCache->insertVolume(path, new Texture3D(device, physicalDevice, commandPool, graphicsQueue, asset.width, asset.height, asset.depth, asset.format));
+			decodes.push_back(submitStartupPhase("decode " + path, [texture, path]() { texture->decodeFile(path); }));
+		}
+		return texture;
+	};
+
+	meshTexture = decodeTexture("Textures/grassGround.png", VK_FORMAT_R8G8B8A8_UNORM);
+	meshPBRInfo = decodeTexture("Textures/rockPBRinfo.png", VK_FORMAT_R8G8B8A8_UNORM);
+	meshNormals = decodeTexture("Textures/grassGround_Normal.png", VK_FORMAT_R8G8B8A8_UNORM);
+	cloudPlacementTexture = decodeTexture("Textures/CloudPlacement.png", VK_FORMAT_R8G8B8A8_UNORM);
+	nightSkyTexture = decodeTexture("Textures/NightSky/nightSky_noOrange.png", VK_FORMAT_R8G8B8A8_UNORM);
+	cloudCurlNoise = decodeTexture("Textures/CurlNoiseFBM.png", VK_FORMAT_R8G8_UNORM); // only the xy offset is read
+	cloudCirroNoise = decodeTexture("Textures/CirroNoise.png", VK_FORMAT_R8G8B8A8_UNORM);
+	if (!(ENABLE_GPU_NOISE) || (ENABLE_NEW_NOISE))
+	{
+		lowResCloudShapeTexture3D = decodeCloudVolume(lowResCloudVolume());
+	}
+	if (!(ENABLE_GPU_NOISE))
+	{
+		hiResCloudShapeTexture3D = decodeCloudVolume(HiResCloudShape);
+	}
+	// bricked on the first run when the asset build step (--pack-assets) hasn't done it
+	decodes.push_back(submitStartupPhase(std::string("decode ") + voxelCloudPoolPath, [this]() {
+		if (!LoadBrickPool(voxelCloudPoolPath, static_cast<uint32_t>(voxelCloudPaths().size()), voxelCloudPool)) {
+			PackBrickPool(voxelCloudPoolPath, voxelCloudPaths(), cloudVolumeAssets[voxelClouds[0]].depth, voxelCloudPool);
+		}
+	}));
+	textureDecodes = jobs->submit([]() {}, decodes);
+
+	sceneGeometry = new Geometry(device, physicalDevice, commandPool, graphicsQueue);
+	meshDecodes = submitStartupPhase("decode Models/terrain.obj", [this]() { sceneGeometry->decodeMesh("Models/terrain.obj"); });
 }
 
 void VulkanApplication::initializeTextures() {
-	meshTexture = new Texture(device, physicalDevice, commandPool, graphicsQueue);
-	meshTexture->initFromFile("Textures/grassGround.png");
-	meshPBRInfo = new Texture(device, physicalDevice, commandPool, graphicsQueue);
-	meshPBRInfo->initFromFile("Textures/rockPBRinfo.png");
-	meshNormals = new Texture(device, physicalDevice, commandPool, graphicsQueue);
-	meshNormals->initFromFile("Textures/grassGround_Normal.png");
-	backgroundTexture = new Texture(device, physicalDevice, commandPool, graphicsQueue, VK_FORMAT_R32G32B32A32_SFLOAT);
+	VkFormat historyFormat = VK_FORMAT_R32G32B32A32_SFLOAT;
+	if ((CLOUD_HISTORY_FORMAT == HISTORY_FORMAT_RGBA16F))
+	{
+		historyFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+	}
+	else if ((CLOUD_HISTORY_FORMAT == HISTORY_FORMAT_R11G11B10_A8))
+	{
+		historyFormat = VK_FORMAT_B10G11R11_UFLOAT_PACK32;
+	}
+	VkFormatProperties historyFormatProperties;
+	vkGetPhysicalDeviceFormatProperties(physicalDevice, historyFormat, &historyFormatProperties);
+	if (!(historyFormatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT)) {
+		throw std::runtime_error("failed to find storage image support for the cloud history format!");
+	}
+	backgroundTexture = new Texture(device, physicalDevice, commandPool, graphicsQueue, historyFormat);
 	backgroundTexture->initForStorage(swapChainExtent);
-	backgroundTexturePrev = new Texture(device, physicalDevice, commandPool, graphicsQueue, VK_FORMAT_R32G32B32A32_SFLOAT);
+	backgroundTexturePrev = new Texture(device, physicalDevice, commandPool, graphicsQueue, historyFormat);
 	backgroundTexturePrev->initForStorage(swapChainExtent);
+	if ((CLOUD_HISTORY_FORMAT == HISTORY_FORMAT_R11G11B10_A8))
+	{
+		// B10G11R11 has no alpha, the sun visibility that the light shafts need goes here
+		backgroundAlpha = new Texture(device, physicalDevice, commandPool, graphicsQueue, VK_FORMAT_R8_UNORM);
+		backgroundAlpha->initForStorage(swapChainExtent);
+		backgroundAlphaPrev = new Texture(device, physicalDevice, commandPool, graphicsQueue, VK_FORMAT_R8_UNORM);
+		backgroundAlphaPrev->initForStorage(swapChainExtent);
+	}
+	if (asyncCompute)
+	{
+		// The compute queue keeps the history to itself and copies the finished frame here for the background pass,
+		// so the next frame's clouds don't have to wait for the graphics queue to let go of the history.
+		cloudDisplayTexture = new Texture(device, physicalDevice, commandPool, graphicsQueue, historyFormat);
+		cloudDisplayTexture->initForStorage(swapChainExtent);
+		if (backgroundAlpha != nullptr)
+		{
+			cloudDisplayAlpha = new Texture(device, physicalDevice, commandPool, graphicsQueue, VK_FORMAT_R8_UNORM);
+			cloudDisplayAlpha->initForStorage(swapChainExtent);
+		}
+	}
 	depthTexture = new Texture(device, physicalDevice, commandPool, graphicsQueue);
 	depthTexture->initForDepthAttachment(swapChainExtent);
-	cloudPlacementTexture = new Texture(device, physicalDevice, commandPool, graphicsQueue);
+	if ((ENABLE_DYNAMIC_WEATHER))
+	{
+		for (Texture*& weatherMap : weatherMaps) {
+			weatherMap = new Texture(device, physicalDevice, commandPool, graphicsQueue, VK_FORMAT_R8G8B8A8_UNORM);
+			weatherMap->initForStorage({ WEATHER_MAP_SIZE, WEATHER_MAP_SIZE });
+		}
+		if (asyncCompute)
+		{
+			// like cloudDisplayTexture, keeps the maps on the compute queue
+			weatherDisplay = new Texture(device, physicalDevice, commandPool, graphicsQueue, VK_FORMAT_R8G8B8A8_UNORM);
+			weatherDisplay->initForStorage({ WEATHER_MAP_SIZE, WEATHER_MAP_SIZE });
+		}
+	}
+	// created either way, the clouds bind them whether or not they read them
+	for (Texture3D*& level : densityClipmap) {
+		// rgba16f rather than rg16f since it is a guaranteed storage image format, without mips so it never leaves GENERAL
+		level = new Texture3D(device, physicalDevice, commandPool, graphicsQueue, DENSITY_CLIPMAP_SIZE, DENSITY_CLIPMAP_SIZE, DENSITY_CLIPMAP_SIZE, VK_FORMAT_R16G16B16A16_SFLOAT);
+		level->initForStorage({ DENSITY_CLIPMAP_SIZE, DENSITY_CLIPMAP_SIZE, DENSITY_CLIPMAP_SIZE }, false);
+	}
+	farFieldPanorama = new Texture(device, physicalDevice, commandPool, graphicsQueue, VK_FORMAT_R16G16B16A16_SFLOAT);
+	farFieldPanorama->initForStorage({ FAR_FIELD_SIZE, FAR_FIELD_SIZE });
+
+	// only images were created above, the files have been decoding meanwhile
+	jobs->wait(textureDecodes);
+	meshTexture->initFromFile("Textures/grassGround.png");
+	meshPBRInfo->initFromFile("Textures/rockPBRinfo.png");
+	meshNormals->initFromFile("Textures/grassGround_Normal.png");
 	cloudPlacementTexture->initFromFile("Textures/CloudPlacement.png");
-	nightSkyTexture = new Texture(device, physicalDevice, commandPool, graphicsQueue);
 	nightSkyTexture->initFromFile("Textures/NightSky/nightSky_noOrange.png");
-	cloudCurlNoise = new Texture(device, physicalDevice, commandPool, graphicsQueue);
 	cloudCurlNoise->initFromFile("Textures/CurlNoiseFBM.png");
-	cloudCirroNoise = new Texture(device, physicalDevice, commandPool, graphicsQueue);
 	cloudCirroNoise->initFromFile("Textures/CirroNoise.png");
-	lowResCloudShapeTexture3D = new Texture3D(device, physicalDevice, commandPool, graphicsQueue, 128, 128, 128); // 128, 128, 128
-	if ((ENABLE_NEW_NOISE))
+	if ((ENABLE_GPU_NOISE))
 	{
-		lowResCloudShapeTexture3D->initFromFile("Textures/3DTextures/Curly_AlligatorCloudShape/NubisVoxelCloudNoise"); // note: no .png
+		if ((ENABLE_NEW_NOISE)) {
+			lowResCloudShapeTexture3D->initFromFile(cloudVolumeAssets[lowResCloudVolume()].path);
+		}
+		noiseShader = new NoiseShader(device, physicalDevice, commandPool, graphicsQueue, std::string("Shaders/noise-volume.comp.spv"));
+		generateCloudNoise();
 	}
 	else
 	{
-		lowResCloudShapeTexture3D->initFromFile("Textures/3DTextures/lowResCloudShape/lowResCloud"); // note: no .png
+		// timed to compare with ENABLE_GPU_NOISE, the upload only since the files are read on the workers
+		auto noiseStart = std::chrono::high_resolution_clock::now();
+		lowResCloudShapeTexture3D->initFromFile(cloudVolumeAssets[lowResCloudVolume()].path);
+		hiResCloudShapeTexture3D->initFromFile(cloudVolumeAssets[HiResCloudShape].path);
+		noiseMilliseconds = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - noiseStart).count();
+		std::cout << "cloud noise volumes: uploaded in " << noiseMilliseconds << " ms" << std::endl;
+	}
+
+	const uint32_t voxelCloudCount = static_cast<uint32_t>(voxelCloudPaths().size());
+	const uint32_t atlasSize = voxelCloudPool.header.atlasBricks * (BRICK_SIZE + 2 * BRICK_APRON);
+	const uint32_t gridSize = voxelCloudPool.header.gridSize;
+	voxelBrickAtlas = new Texture3D(device, physicalDevice, commandPool, graphicsQueue, atlasSize, atlasSize, atlasSize, VK_FORMAT_R8G8_UNORM);
+	voxelBrickAtlas->initFromData(voxelCloudPool.atlas);
+	// one volume per cloud, the raymarch picks the grid of each instance by its handle in the heap
+	const size_t gridBytes = static_cast<size_t>(gridSize) * gridSize * gridSize * 4;
+	for (uint32_t c = 0; c < voxelCloudCount; c++) {
+		Texture3D* indirection = new Texture3D(device, physicalDevice, commandPool, graphicsQueue, gridSize, gridSize, gridSize, VK_FORMAT_R8G8B8A8_UINT);
+		indirection->initFromData(std::vector<unsigned char>(voxelCloudPool.indirection.begin() + c * gridBytes, voxelCloudPool.indirection.begin() + (c + 1) * gridBytes));
+		voxelBrickIndirections.push_back(indirection);
+		voxelCloudHandles.push_back(descriptorHeap->add(indirection));
+	}
+	voxelCloudPool = BrickPool();
+	textureCache->trim();
+
+	if ((ENABLE_FUSED_POST))
+	{
+		// single channel, half res. r32f rather than r16f since it is a guaranteed storage image format
+		lightShaftTexture = new Texture(device, physicalDevice, commandPool, graphicsQueue, VK_FORMAT_R32_SFLOAT);
+		lightShaftTexture->initForStorage({ swapChainExtent.width / 2, swapChainExtent.height / 2 });
+	}
+}
+
+// Fills the noise volumes on the device at the sizes of noiseQuality, replacing the ones there were. Each waits for
+// its dispatch and mips, so the time includes the submits. The volumes of a tier stay in textureCache after it is
+// left, going back to it only generates what has been evicted since.
+void VulkanApplication::generateCloudNoise() {
+	auto start = std::chrono::high_resolution_clock::now();
+	const NoiseQualityTier& tier = noiseQualityTiers[noiseQuality];
+	noiseGpuMilliseconds = 0.0f;
+	auto generateVolume = [this](uint32_t size, const NoiseVolumeDesc& desc) {
+		const std::string key = NoiseVolumeKey(desc);
+		Texture3D* texture = textureCache->acquireVolume(key);
+		if (texture == nullptr) {
+			texture = textureCache->insertVolume(key, new Texture3D(device, physicalDevice, commandPool, graphicsQueue, size, size, size, VK_FORMAT_R8G8B8A8_UNORM));
+			texture->initForStorage({ size, size, size });
+			noiseGpuMilliseconds += noiseShader->generate(texture, desc);
+		}
+		return texture;
+	};
+
+	if (!(ENABLE_NEW_NOISE)) {
+		textureCache->release(lowResCloudShapeTexture3D);
+		lowResCloudShapeTexture3D = generateVolume(tier.lowResSize, LowResCloudNoise(tier.lowResSize, 0));
 	}
-	SDFCloudShapeTexture3D_01 = new Texture3D(device, physicalDevice, commandPool, graphicsQueue, 128, 128, 128); // 128, 128, 128
-	SDFCloudShapeTexture3D_01->initFromFile("Textures/3DTextures/SDFCloudShape_01/SDFCloudShape"); // note: no .png
+	textureCache->release(hiResCloudShapeTexture3D);
+	hiResCloudShapeTexture3D = generateVolume(tier.hiResSize, HiResCloudNoise(tier.hiResSize, 0));
+	textureCache->trim();
 
-	SDFCloudShapeTexture3D_02 = new Texture3D(device, physicalDevice, commandPool, graphicsQueue, 128, 128, 128); // 128, 128, 128
-	SDFCloudShapeTexture3D_02->initFromFile("Textures/3DTextures/SDFCloudShape_02/Cloud_Bake_pighead"); // note: no .png
+	noiseMilliseconds = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+	std::cout << "cloud noise volumes: " << tier.lowResSize << "^3 and " << tier.hiResSize << "^3 generated in " << noiseMilliseconds
+		<< " ms, " << noiseGpuMilliseconds << " ms of it on the GPU" << std::endl;
+}
 
-	hiResCloudShapeTexture3D = new Texture3D(device, physicalDevice, commandPool, graphicsQueue, 32, 32, 32); // 128, 128, 128
-	hiResCloudShapeTexture3D->initFromFile("Textures/3DTextures/hiResCloudShape/hiResClouds "); // note: no .png
+// Quality tier change from the rendering panel, between frames. The cloud kernel reads the volumes through the
+// descriptor heap, its slots are rewritten in place, but the recorded command buffers of the mesh shader hold the
+// descriptors of the old volumes, so they are recorded again.
+void VulkanApplication::regenerateCloudNoise() {
+	vkDeviceWaitIdle(device);
+	generateCloudNoise();
+	computeShader->setCloudShapeTextures(lowResCloudShapeTexture3D, hiResCloudShapeTexture3D);
+	meshShader->setCloudShapeTexture(lowResCloudShapeTexture3D);
+	densityClipmapValid = false;
+	farFieldTile = 0;
+	farFieldComplete = false;
+
+	vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(offscreenPass.commandBuffers.size()), offscreenPass.commandBuffers.data());
+	offscreenPass.commandBuffers.clear();
+	vkFreeCommandBuffers(device, computeCommandPool, static_cast<uint32_t>(computeCommandBuffers.size()), computeCommandBuffers.data());
+	createCommandBuffers();
+	createComputeCommandBuffer();
+}
 
+// Asset build step, run with --pack-assets. Repacks every cloud volume from its tga slices, initializeTextures then
+// only reads the packed files. Needs no Vulkan device.
+void VulkanApplication::packAssets() {
+	// every volume on its own worker, the report is printed in order once all of them are done
+	std::vector<size_t> assetRgbaBytes(CloudVolumeCount), assetPackedBytes(CloudVolumeCount);
+	JobSystem packJobs;
+	packJobs.wait(packJobs.parallelFor(CloudVolumeCount, 1, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t a = begin; a < end; a++) {
+			const CloudVolumeAsset& asset = cloudVolumeAssets[a];
+			PackedVolumeHeader header;
+			std::vector<unsigned char> texels;
+			PackVolume(asset.path, asset.depth, FormatChannelCount(asset.format), header, texels);
+			assetRgbaBytes[a] = static_cast<size_t>(header.width) * header.height * header.depth * 4;
+			assetPackedBytes[a] = texels.size();
+		}
+	}));
+
+	size_t rgbaBytes = 0, packedBytes = 0;
+	for (uint32_t a = 0; a < CloudVolumeCount; a++) {
+		const CloudVolumeAsset& asset = cloudVolumeAssets[a];
+		rgbaBytes += assetRgbaBytes[a];
+		packedBytes += assetPackedBytes[a];
+		std::cout << PackedVolumePath(asset.path, FormatChannelCount(asset.format)) << ": " << assetRgbaBytes[a] / 1024 << " KB as rgba8, " << assetPackedBytes[a] / 1024 << " KB packed" << std::endl;
+	}
+	std::cout << "cloud volumes: " << rgbaBytes / 1024 << " KB as rgba8, " << packedBytes / 1024 << " KB packed (level 0 only, mips add 1/7)" << std::endl;
+
+	BrickPool pool;
+	const uint32_t size = cloudVolumeAssets[voxelClouds[0]].depth;
+	PackBrickPool(voxelCloudPoolPath, voxelCloudPaths(), size, pool);
+	const size_t dense = static_cast<size_t>(size) * size * size * 2 * pool.header.cloudCount;
+	const uint32_t bricks = pool.header.gridSize * pool.header.gridSize * pool.header.gridSize * pool.header.cloudCount;
+	std::cout << voxelCloudPoolPath << ": " << pool.header.residentBricks << " of " << bricks << " bricks resident, "
+		<< (pool.atlas.size() + pool.indirection.size()) / 1024 << " KB against " << dense / 1024 << " KB dense" << std::endl;
+}
+
+// Tool mode, run with --bake-sdf <volume> <depth> [threshold]. Rebakes the distance channel of a voxel cloud from its
+// density and rebricks the pool when the volume is one of the voxel clouds.
+void VulkanApplication::bakeVolumeSDF(const std::string& path, uint32_t depth, float threshold) {
+	auto start = std::chrono::high_resolution_clock::now();
+	PackedVolumeHeader header;
+	std::vector<unsigned char> texels;
+	JobSystem bakeJobs;
+	BakeVolumeSDF(bakeJobs, path, depth, threshold, header, texels);
+	float seconds = std::chrono::duration<float, std::chrono::seconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+	std::cout << PackedVolumePath(path, 2) << ": " << header.width << "x" << header.height << "x" << header.depth << " baked in " << seconds << " s" << std::endl;
+
+	const std::vector<std::string> paths = voxelCloudPaths();
+	if (std::find(paths.begin(), paths.end(), path) != paths.end()) {
+		BrickPool pool;
+		PackBrickPool(voxelCloudPoolPath, paths, cloudVolumeAssets[voxelClouds[0]].depth, pool);
+		std::cout << voxelCloudPoolPath << ": rebricked" << std::endl;
+	}
+}
+
+// Tool mode, run with --bake-noise <lowres|hires|curl|cirrus> <size> [seed]. Regenerates one of the noise textures
+// at any resolution, the volumes replace the packed file initializeTextures reads and the 2D maps their png.
+void VulkanApplication::bakeNoise(const std::string& name, uint32_t size, uint32_t seed) {
+	NoiseVolumeDesc desc;
+	std::string output;
+	if (name == "lowres") {
+		desc = LowResCloudNoise(size, seed);
+		output = cloudVolumeAssets[LowResCloudShape].path;
+	}
+	else if (name == "hires") {
+		desc = HiResCloudNoise(size, seed);
+		output = cloudVolumeAssets[HiResCloudShape].path;
+	}
+	else if (name == "curl") {
+		desc = CurlNoise(size, seed);
+		output = "Textures/CurlNoiseFBM.png";
+	}
+	else if (name == "cirrus") {
+		desc = CirrusNoise(size, seed);
+		output = "Textures/CirroNoise.png";
+	}
+	else {
+		throw std::runtime_error("unknown noise texture!");
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	PackedVolumeHeader header;
+	std::vector<unsigned char> texels;
+	JobSystem bakeJobs;
+	BakeNoiseVolume(bakeJobs, desc, noiseCacheDir, header, texels);
+	float seconds = std::chrono::duration<float, std::chrono::seconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+
+	if (desc.depth > 1) {
+		WritePackedVolume(output, header, texels);
+		output = PackedVolumePath(output, header.channels);
+	}
+	else {
+		// rgb, the 2D maps never use a
+		std::vector<unsigned char> rgb;
+		for (size_t i = 0; i < texels.size(); i += 4) {
+			rgb.insert(rgb.end(), texels.begin() + i, texels.begin() + i + 3);
+		}
+		if (!stbi_write_png(output.c_str(), header.width, header.height, 3, rgb.data(), header.width * 3)) {
+			throw std::runtime_error("failed to write noise texture!");
+		}
+	}
+	std::cout << output << ": " << header.width << "x" << header.height << "x" << header.depth << " baked in " << seconds << " s" << std::endl;
 }
 
 // TODO: management
 void VulkanApplication::cleanupTextures() {
-	delete meshTexture;
-	delete meshPBRInfo;
-	delete meshNormals;
+	// the textures and volumes from files and the noise volumes
+	delete textureCache;
 	delete backgroundTexture;
 	delete backgroundTexturePrev;
+	delete backgroundAlpha;
+	delete backgroundAlphaPrev;
+	delete cloudDisplayTexture;
+	delete cloudDisplayAlpha;
 	delete depthTexture;
-	delete cloudPlacementTexture;
-	delete nightSkyTexture;
-	delete cloudCurlNoise;
-	delete cloudCirroNoise;
-	delete lowResCloudShapeTexture3D;
-	delete SDFCloudShapeTexture3D_01;
-	delete SDFCloudShapeTexture3D_02;
-	delete hiResCloudShapeTexture3D;
+	delete weatherMaps[0];
+	delete weatherMaps[1];
+	delete weatherDisplay;
+	for (Texture3D* level : densityClipmap) {
+		delete level;
+	}
+	delete farFieldPanorama;
+	delete voxelBrickAtlas;
+	for (size_t c = 0; c < voxelBrickIndirections.size(); c++) {
+		descriptorHeap->removeVolume(voxelCloudHandles[c]);
+		delete voxelBrickIndirections[c];
+	}
+	delete lightShaftTexture;
+	delete noiseShader;
 }
 
 void VulkanApplication::initializeGeometry() {
-	sceneGeometry = new Geometry(device, physicalDevice, commandPool, graphicsQueue);
+	jobs->wait(meshDecodes);
 	sceneGeometry->setupFromMesh("Models/terrain.obj");
 	backgroundGeometry = new Geometry(device, physicalDevice, commandPool, graphicsQueue);
 	backgroundGeometry->setupAsBackgroundQuad();
+	if ((ENABLE_HEIGHTMAP_TERRAIN))
+	{
+		terrain = new Terrain(device, physicalDevice, commandPool, graphicsQueue);
+		terrain->setupFromHeightmap("Textures/tilesHeight.png", TERRAIN_SIZE, TERRAIN_HEIGHT, TERRAIN_BASE, *jobs);
+	}
+	if ((ENABLE_SCENE_PROPS))
+	{
+		sceneProps = new MeshRegistry(device, physicalDevice, commandPool, graphicsQueue);
+		const uint32_t block = sceneProps->addMesh("Models/DisplayCube.obj");
+
+		// the same field every run
+		uint32_t seed = 1;
+		auto nextRandom = [&seed]() {
+			seed = seed * 1664525u + 1013904223u;
+			return (seed >> 8) / 16777216.0f;
+		};
+		const float half = 0.5f * (SCENE_PROP_GRID - 1) * SCENE_PROP_SPACING;
+		for (int j = 0; j < SCENE_PROP_GRID; j++) {
+			for (int i = 0; i < SCENE_PROP_GRID; i++) {
+				const float x = i * SCENE_PROP_SPACING - half + (nextRandom() - 0.5f) * SCENE_PROP_SPACING;
+				const float z = j * SCENE_PROP_SPACING - half + (nextRandom() - 0.5f) * SCENE_PROP_SPACING;
+				const float height = SCENE_PROP_SIZE * (1.0f + 3.0f * nextRandom());
+				// sunk in by half its width, which covers any slope under it
+				const float ground = ((ENABLE_HEIGHTMAP_TERRAIN) ? terrain->getHeight(x, z) : 0.0f) - 0.5f * SCENE_PROP_SIZE;
+
+				glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(x, ground + 0.5f * height, z));
+				model = glm::rotate(model, nextRandom() * 3.14159265f, glm::vec3(0.0f, 1.0f, 0.0f));
+				model = glm::scale(model, glm::vec3(SCENE_PROP_SIZE, height, SCENE_PROP_SIZE));
+				sceneProps->addInstance(block, model);
+			}
+		}
+		sceneProps->build();
+	}
 }
 
 void VulkanApplication::cleanupGeometry() {
 	delete sceneGeometry;
 	delete backgroundGeometry;
+	delete terrain;
+	delete sceneProps;
 }
 
-void VulkanApplication::initializeShaders() {
-	meshShader = new MeshShader(device, physicalDevice, commandPool, graphicsQueue, swapChainExtent,
-		&offscreenPass.renderPass, std::string("Shaders/model.vert.spv"), std::string("Shaders/model.frag.spv"), meshTexture, meshPBRInfo, meshNormals, cloudPlacementTexture, lowResCloudShapeTexture3D);
+// The ground and the props, with the mesh shader bound
+void VulkanApplication::drawScene(VkCommandBuffer commandBuffer) {
+	if ((ENABLE_HEIGHTMAP_TERRAIN))
+	{
+		terrain->enqueueDrawCommands(commandBuffer);
+	}
+	else
+	{
+		sceneGeometry->enqueueDrawCommands(commandBuffer);
+	}
+	if ((ENABLE_SCENE_PROPS))
+	{
+		meshShader->bindInstanced(commandBuffer);
+		sceneProps->enqueueDrawCommands(commandBuffer);
+	}
+}
 
-	backgroundShader = new BackgroundShader(device, physicalDevice, commandPool, graphicsQueue, swapChainExtent,
-		&offscreenPass.renderPass, std::string("Shaders/background.vert.spv"), std::string("Shaders/background.frag.spv"), backgroundTexture, backgroundTexturePrev);
+// Every shader compiles its pipelines on a worker. A shader only creates objects of its own and the pipeline cache is
+// synchronized by Vulkan, what touches two of them or submits to a queue waits until all are done.
+void VulkanApplication::initializeShaders(const JobHandle& geometry) {
+	std::vector<JobHandle> shaders = { geometry };
+	JobHandle mesh = submitStartupPhase("mesh shader", [this]() {
+		meshShader = new MeshShader(device, physicalDevice, commandPool, graphicsQueue, swapChainExtent,
+			&offscreenPass.renderPass, std::string("Shaders/model.vert.spv"), std::string("Shaders/model.frag.spv"), meshTexture, meshPBRInfo, meshNormals, cloudPlacementTexture, lowResCloudShapeTexture3D);
+	});
+	shaders.push_back(mesh);
 
-	// Note: we pass the background shader's texture with the intention of writing to it with the compute shader
-	reprojectShader = new ReprojectShader(device, physicalDevice, commandPool, computeQueue, swapChainExtent, &offscreenPass.renderPass,
-		std::string("Shaders/reproject.comp.spv"), backgroundTexture, backgroundTexturePrev);
+	shaders.push_back(submitStartupPhase("background shader", [this]() {
+		if (asyncCompute)
+		{
+			// both ping-pong slots sample the one display copy, see buildRenderGraph
+			backgroundShader = new BackgroundShader(device, physicalDevice, commandPool, graphicsQueue, swapChainExtent,
+				&offscreenPass.renderPass, std::string("Shaders/background.vert.spv"), historyShaderPath("Shaders/background.frag"), cloudDisplayTexture, cloudDisplayTexture,
+				cloudDisplayAlpha, cloudDisplayAlpha);
+		}
+		else
+		{
+			backgroundShader = new BackgroundShader(device, physicalDevice, commandPool, graphicsQueue, swapChainExtent,
+				&offscreenPass.renderPass, std::string("Shaders/background.vert.spv"), historyShaderPath("Shaders/background.frag"), backgroundTexture, backgroundTexturePrev,
+				backgroundAlpha, backgroundAlphaPrev);
+		}
+	}));
 
-	computeShader = new ComputeShader(device, physicalDevice, commandPool, computeQueue, swapChainExtent,
-		&offscreenPass.renderPass, std::string("Shaders/compute-clouds.comp.spv"), backgroundTexture, backgroundTexturePrev, cloudPlacementTexture, nightSkyTexture, cloudCurlNoise, cloudCirroNoise,
-		lowResCloudShapeTexture3D, hiResCloudShapeTexture3D,SDFCloudShapeTexture3D_01,SDFCloudShapeTexture3D_02);
+	// Note: we pass the background shader's texture with the intention of writing to it with the compute shader
+	shaders.push_back(submitStartupPhase("reproject shader", [this]() {
+		reprojectShader = new ReprojectShader(device, physicalDevice, commandPool, computeQueue, swapChainExtent, &offscreenPass.renderPass,
+			historyShaderPath("Shaders/reproject.comp"), backgroundTexture, backgroundTexturePrev, backgroundAlpha, backgroundAlphaPrev);
+	}));
+
+	shaders.push_back(submitStartupPhase("cloud shader", [this]() {
+		computeShader = new ComputeShader(device, physicalDevice, commandPool, computeQueue, swapChainExtent, descriptorHeap,
+			&offscreenPass.renderPass, historyShaderPath("Shaders/compute-clouds.comp"), backgroundTexture, backgroundTexturePrev, cloudPlacementTexture, nightSkyTexture, cloudCurlNoise, cloudCirroNoise,
+			lowResCloudShapeTexture3D, hiResCloudShapeTexture3D,voxelBrickAtlas, backgroundAlpha, backgroundAlphaPrev);
+		computeShader->setupDensityClipmap(std::string("Shaders/compute-clouds.comp.clipmap.spv"), densityClipmap);
+		computeShader->setupFarField(std::string("Shaders/compute-clouds.comp.farfield.spv"), farFieldPanorama);
+	}));
+
+	if ((ENABLE_SCENE_PROPS))
+	{
+		shaders.push_back(submitStartupPhase("instanced mesh shader", [this]() {
+			meshShader->setupInstancing(std::string("Shaders/model.vert.instanced.spv"), sceneProps->getInstanceBuffer());
+		}, { mesh, geometry }));
+		shaders.push_back(submitStartupPhase("cull shader", [this]() {
+			cullShader = new CullShader(device, physicalDevice, commandPool, graphicsQueue, std::string("Shaders/cull-instances.comp.spv"),
+				sceneProps->getInstanceBuffer(), sceneProps->getDrawBuffer());
+		}, { geometry }));
+	}
 
-	// Post shaders: there will be many
-	// This is still offscreen, so the render pass is the offscreen render pass
-	godRayShader = new PostProcessShader(device, physicalDevice, commandPool, graphicsQueue, swapChainExtent,
-		&offscreenPass.renderPass, std::string("Shaders/post-pass.vert.spv"), std::string("Shaders/god-ray.frag.spv"), &offscreenPass.framebuffers[0].descriptor);
+	if ((ENABLE_DYNAMIC_WEATHER))
+	{
+		// on the compute queue family, which the maps then never leave
+		shaders.push_back(submitStartupPhase("weather shader", [this]() {
+			weatherShader = new WeatherShader(device, physicalDevice, computeCommandPool, computeQueue, { WEATHER_MAP_SIZE, WEATHER_MAP_SIZE },
+				std::string("Shaders/weather-map.comp.spv"), weatherMaps[0], weatherMaps[1]);
+		}));
+	}
 
-	radialBlurShader = new PostProcessShader(device, physicalDevice, commandPool, graphicsQueue, swapChainExtent,
-		&offscreenPass.renderPass, std::string("Shaders/post-pass.vert.spv"), std::string("Shaders/radialBlur.frag.spv"), &offscreenPass.framebuffers[1].descriptor);
+	if ((ENABLE_FUSED_POST))
+	{
+		// God rays go to a half res compute pass, radial blur and tonemap are folded into the final pass to the swapchain
+		shaders.push_back(submitStartupPhase("light shaft shader", [this]() {
+			lightShaftShader = new LightShaftShader(device, physicalDevice, commandPool, graphicsQueue, swapChainExtent,
+				std::string("Shaders/light-shafts.comp.spv"), &offscreenPass.framebuffers.at("scene").descriptor, lightShaftTexture);
+		}));
+		shaders.push_back(submitStartupPhase("composite shader", [this]() {
+			compositeShader = new CompositeShader(device, physicalDevice, commandPool, graphicsQueue, swapChainExtent,
+				&renderPass, std::string("Shaders/post-pass.vert.spv"), std::string("Shaders/post-composite.frag.spv"), &offscreenPass.framebuffers.at("scene").descriptor, lightShaftTexture);
+		}));
+
+		godRayShader = nullptr;
+		radialBlurShader = nullptr;
+		toneMapShader = nullptr;
+	}
+	else
+	{
+		// Post shaders: there will be many
+		// This is still offscreen, so the render pass is the offscreen render pass
+		shaders.push_back(submitStartupPhase("god ray shader", [this]() {
+			godRayShader = new PostProcessShader(device, physicalDevice, commandPool, graphicsQueue, swapChainExtent,
+				&offscreenPass.renderPass, std::string("Shaders/post-pass.vert.spv"), std::string("Shaders/god-ray.frag.spv"), &offscreenPass.framebuffers.at("scene").descriptor);
+		}));
+		shaders.push_back(submitStartupPhase("radial blur shader", [this]() {
+			radialBlurShader = new PostProcessShader(device, physicalDevice, commandPool, graphicsQueue, swapChainExtent,
+				&offscreenPass.renderPass, std::string("Shaders/post-pass.vert.spv"), std::string("Shaders/radialBlur.frag.spv"), &offscreenPass.framebuffers.at("godRays").descriptor);
+		}));
+		shaders.push_back(submitStartupPhase("tonemap shader", [this]() {
+			toneMapShader = new PostProcessShader(device, physicalDevice, commandPool, graphicsQueue, swapChainExtent,
+				&renderPass, std::string("Shaders/post-pass.vert.spv"), std::string("Shaders/tonemap.frag.spv"), &offscreenPass.framebuffers.at("blurred").descriptor);
+		}));
+	}
+
+	jobs->wait(jobs->submit([]() {}, shaders));
+
+	if ((ENABLE_DYNAMIC_WEATHER))
+	{
+		weatherShader->initialize(0.0f, weatherWindOffset, WEATHER_TILE_SIZE);
+		const uint32_t tilesPerRow = WEATHER_MAP_SIZE / WEATHER_TILE_SIZE;
+		weatherWindowTimes.assign(tilesPerRow * tilesPerRow / WEATHER_TILES_PER_FRAME, 0.0f);
 
-	toneMapShader = new PostProcessShader(device, physicalDevice, commandPool, graphicsQueue, swapChainExtent,
-		&renderPass, std::string("Shaders/post-pass.vert.spv"), std::string("Shaders/tonemap.frag.spv"), &offscreenPass.framebuffers[2].descriptor);
+		computeShader->setWeatherMaps(weatherMaps[0], weatherMaps[1]);
+		if (asyncCompute) {
+			meshShader->setWeatherMaps(weatherDisplay, weatherDisplay);
+		}
+		else {
+			meshShader->setWeatherMaps(weatherMaps[0], weatherMaps[1]);
+		}
+	}
 }
 
 void VulkanApplication::cleanupShaders() {
@@ -894,6 +1710,10 @@ void VulkanApplication::cleanupShaders() {
 	delete toneMapShader;
 	delete godRayShader;
 	delete radialBlurShader;
+	delete lightShaftShader;
+	delete compositeShader;
+	delete weatherShader;
+	delete cullShader;
 }
 
 void VulkanApplication::cleanupOffscreenPass() {
@@ -901,16 +1721,21 @@ void VulkanApplication::cleanupOffscreenPass() {
 
 	for (auto& framebuffer : offscreenPass.framebuffers)
 	{
-		// Attachments
-		vkDestroyImageView(device, framebuffer.color.view, nullptr);
-		vkDestroyImage(device, framebuffer.color.image, nullptr);
-		vkFreeMemory(device, framebuffer.color.mem, nullptr);
-		vkDestroyImageView(device, framebuffer.depth.view, nullptr);
-		vkDestroyImage(device, framebuffer.depth.image, nullptr);
-		vkFreeMemory(device, framebuffer.depth.mem, nullptr);
+		vkDestroyImageView(device, framebuffer.second.color.view, nullptr);
+		vkDestroyImage(device, framebuffer.second.color.image, nullptr);
 
-		vkDestroyFramebuffer(device, framebuffer.framebuffer, nullptr);
+		vkDestroyFramebuffer(device, framebuffer.second.framebuffer, nullptr);
 	}
+	offscreenPass.framebuffers.clear();
+	for (auto& memory : offscreenPass.colorMemory)
+	{
+		FreeTrackedMemory(device, memory, nullptr);
+	}
+	offscreenPass.colorMemory.clear();
+
+	vkDestroyImageView(device, offscreenPass.depth.view, nullptr);
+	vkDestroyImage(device, offscreenPass.depth.image, nullptr);
+	FreeTrackedMemory(device, offscreenPass.depth.mem, nullptr);
 
 	vkDestroyRenderPass(device, offscreenPass.renderPass, nullptr);
 	vkFreeCommandBuffers(device, commandPool, offscreenPass.commandBuffers.size(), offscreenPass.commandBuffers.data());
@@ -934,25 +1759,39 @@ void VulkanApplication::updateUniformBuffer() {
 	uco.cameraParams.x = mainCamera.getAspect();
 	uco.cameraParams.y = mainCamera.getHTanFov();
 
+	if ((ENABLE_HEIGHTMAP_TERRAIN))
+	{
+		// picked on a worker while this thread goes on, updateGraphicsUniformBuffers waits for it
+		const glm::mat4 viewProj = uco.proj * uco.view;
+		const glm::vec3 cameraPos = mainCamera.getPosition();
+		terrainJob = jobs->submit([this, viewProj, cameraPos]() { terrain->select(viewProj, cameraPos); });
+	}
+
 	UniformModelObject umo = {};
-	umo.model = glm::mat4(1.0f);
-	umo.model[0][0] = 100.0f;
-	umo.model[2][2] = 100.0f;
-	umo.invTranspose = glm::inverse(glm::transpose(umo.model));
+	if ((ENABLE_HEIGHTMAP_TERRAIN))
+	{
+		// already in world space
+		umo.model = terrain->getPositionDecode();
+		umo.invTranspose = glm::mat4(1.0f);
+	}
+	else
+	{
+		umo.model = glm::mat4(1.0f);
+		umo.model[0][0] = 100.0f;
+		umo.model[2][2] = 100.0f;
+		umo.invTranspose = glm::inverse(glm::transpose(umo.model));
+		// normals are unquantized, only the positions need the decode of the mesh
+		umo.model = umo.model * sceneGeometry->getPositionDecode();
+	}
 	float interp = sin(time * 0.025f);
 
 	skySystem.rebuildSkyFromNewSun(interp * 0.5f, 0.25f);
 	skySystem.setTime(time * 10.f);
 
 	UniformSkyObject sky = skySystem.getSky();
-	UniformSunObject& sun = skySystem.getSun(); // by reference so we can update the pixel counter in sun.color.a below
+	UniformSunObject sun = skySystem.getSun();
 	UniformCloudRendererObject& cloudrenderer = skySystem.getCloudRenderer();
 
-	// Pass a uniform value in sun.color.a indicating which of the 16 pixels should be updated.
-	// Yes, this should have its own uniform but you would have to pad to sizeof(vec4) and we are not even using 
-	// this channel already. Will probably change later.
-	sun.color.a = ((int)sun.color.a + 1) % 16; // update every 16th pixel
-
 	//update cloud renderer Parameters for UI Panel
 	cloudrenderer.coverage_rate = rendererSystem.GetFloatParams("coverage_rate");
 	cloudrenderer.erosion_rate = rendererSystem.GetFloatParams("erosion_rate");
@@ -965,21 +1804,182 @@ void VulkanApplication::updateUniformBuffer() {
 	cloudrenderer.cloudinfo5 = rendererSystem.GetVectorParams("cloudinfo5");
 	cloudrenderer.wind_direction = rendererSystem.GetVectorParams("cirrusWind_direction");
 	cloudrenderer.tempVector = rendererSystem.GetVectorParams("tempVector");
+	placeVoxelClouds(glm::vec3(cloudrenderer.tempVector));
+	const glm::vec3 voxelCloudOrigin = mainCamera.getPosition();
+	voxelCloudJob = jobs->submit([this, voxelCloudOrigin]() { voxelCloudScene.build(voxelCloudOrigin, voxelCloudSceneObject); });
 	glm::vec4 wind = rendererSystem.GetVectorParams("wind_direction");
 	sky.wind = glm::vec4(wind.x, wind.y, wind.z, sky.wind.w);
+	// command buffer v writes weather map 1 - v, the clouds and the scene of this frame sample that one
+	sky.weather_map = swapBackgroundImages ? 0.0f : 1.0f;
+	if ((ENABLE_DYNAMIC_WEATHER))
+	{
+		updateWeather(time, wind);
+	}
+	updateDensityClipmap(sky, cloudrenderer);
+	updateFarField();
 	//sun.intensity = sun.intensity*rendererSystem.GetFloatParams("sun_intensity");
 
+	// pushed by recordComputeCommandBuffer, the uniforms above are only written when they change
+	FrameConstants frame = {};
+	frame.frameIndex = static_cast<uint32_t>(frameCount);
+	frame.time = time * 10.f; // same as the sky's, which the scene still reads
+	const int pixel = static_cast<int>(frameCount % 16); // update every 16th pixel
+	frame.pixelOffset = glm::ivec2(pixel % 4, pixel / 4);
+	frame.resolution = glm::vec2(swapChainExtent.width, swapChainExtent.height);
+	frame.debugFlags = cloudrenderer.cloudinfo4.x == 1.0f ? FRAME_DEBUG_VOXEL_CLOUD_BOUNDS : 0;
+	computeShader->setFrameConstants(frame);
+	reprojectShader->setFrameConstants(frame);
+
 	computeShader->updateUniformBuffers(uco, ucoPrev, sky, sun, cloudrenderer);
+	jobs->wait(voxelCloudJob);
+	computeShader->updateVoxelClouds(voxelCloudSceneObject);
 	reprojectShader->updateUniformBuffers(uco, ucoPrev, sky, sun);
-	meshShader->updateUniformBuffers(uco, umo, sun, sky);
-	godRayShader->updateUniformBuffers(uco, sun);
-	radialBlurShader->updateUniformBuffers(uco, sun);
+
+	// the graphics queue may still be reading its uniforms, they go up in updateGraphicsUniformBuffers
+	frameCamera = uco;
+	frameModel = umo;
+	frameSky = sky;
+	frameSun = sun;
 
 	std::stringstream ss;
 	ss << 1.0 / deltaTime;
 	glfwSetWindowTitle(window, ss.str().c_str());
 }
 
+// The two authored clouds sit at tempVector and 20km along x from it. Any further instances are copies of them
+// scattered on a spiral around the same point, to see the grid hold the cost flat.
+void VulkanApplication::placeVoxelClouds(const glm::vec3& anchor) {
+	const uint32_t volumes = static_cast<uint32_t>(sizeof(voxelClouds) / sizeof(voxelClouds[0]));
+	const int count = static_cast<int>(rendererSystem.GetFloatParams("voxel_cloud_count"));
+
+	voxelCloudScene.clear();
+	for (int i = 0; i < count; i++) {
+		VoxelCloudInstance instance = {};
+		instance.volume = voxelCloudHandles[i % volumes];
+		if (i < 2) {
+			instance.position = anchor + glm::vec3(20000.0f * i, 0.0f, 0.0f);
+			instance.size = 10000.0f;
+			instance.yaw = 0.0f;
+			instance.densityScale = 1.0f;
+		}
+		else {
+			const float angle = 2.39996f * i; // golden angle
+			const float radius = 10000.0f * sqrt(static_cast<float>(i));
+			instance.position = anchor + glm::vec3(radius * cos(angle), 0.0f, radius * sin(angle));
+			instance.size = 6000.0f + 4000.0f * glm::fract(0.618034f * i);
+			instance.yaw = angle;
+			instance.densityScale = 0.7f + 0.3f * glm::fract(0.381966f * i);
+		}
+		voxelCloudScene.add(instance);
+	}
+}
+
+// Moves the window of weather-map.comp on to the next tiles, which evolve by the time since the window last came
+// round. The window of the frame before is only copied into the map this frame writes.
+void VulkanApplication::updateWeather(float time, const glm::vec4& wind) {
+	const uint32_t tilesPerRow = WEATHER_MAP_SIZE / WEATHER_TILE_SIZE;
+	const uint32_t tileCount = tilesPerRow * tilesPerRow;
+	const uint32_t window = weatherTile / WEATHER_TILES_PER_FRAME;
+
+	// a feature of the noise sits at its uv minus the offset, so it drifts along the wind
+	weatherWindOffset -= WEATHER_DRIFT * deltaTime * glm::vec2(wind.x, wind.z);
+
+	UniformWeatherObject weather = {};
+	weather.params = glm::vec4(time, time - weatherWindowTimes[window], weatherWindOffset.x, weatherWindOffset.y);
+	weather.tiles = glm::uvec4(weatherTile, WEATHER_TILES_PER_FRAME, (weatherTile + tileCount - WEATHER_TILES_PER_FRAME) % tileCount, tilesPerRow);
+	weatherShader->updateUniformBuffers(weather);
+
+	weatherWindowTimes[window] = time;
+	weatherTile = (weatherTile + WEATHER_TILES_PER_FRAME) % tileCount;
+}
+
+// Centres the windows of the density clipmap on the camera, in the space cloudTest samples: world position plus the
+// wind offset of its height, the mid-layer one here. While a level is thinner than the cloud layer it stays inside
+// the layer as close to the camera as it can. The update evaluates the cells a window moved onto, and a few columns
+// of every level each frame.
+void VulkanApplication::updateDensityClipmap(const UniformSkyObject& sky, const UniformCloudRendererObject& cloudrenderer) {
+	// cloudWindOffset(0.5) of compute-clouds.comp
+	const float midLayer = 0.5f;
+	const glm::vec3 windOffset = cloudrenderer.cloudinfo3.x * (glm::vec3(sky.wind) + midLayer * glm::vec3(0.1f, 0.05f, 0.0f)) * (sky.wind.w + midLayer * 200.0f);
+	const glm::vec3 cameraPos = mainCamera.getPosition();
+
+	UniformClipmapObject clipmap = {};
+	float cellSize = DENSITY_CLIPMAP_CELL_SIZE;
+	for (int level = 0; level < DENSITY_CLIPMAP_LEVELS; level++, cellSize *= DENSITY_CLIPMAP_LEVEL_SCALE) {
+		const float halfExtent = 0.5f * DENSITY_CLIPMAP_SIZE * cellSize;
+		const float low = CLOUD_LAYER_BOTTOM + halfExtent;
+		const float high = CLOUD_LAYER_TOP - halfExtent;
+		const float height = low <= high ? glm::clamp(cameraPos.y, low, high) : 0.5f * (CLOUD_LAYER_BOTTOM + CLOUD_LAYER_TOP);
+
+		const glm::vec3 centre = glm::vec3(cameraPos.x, height, cameraPos.z) + windOffset;
+		clipmap.origin[level] = glm::ivec4(glm::ivec3(glm::floor(centre / cellSize)) - DENSITY_CLIPMAP_SIZE / 2, 0);
+		// a window that shares no cell with the new one has every texel evaluated
+		clipmap.previousOrigin[level] = densityClipmapValid ? densityClipmapOrigins[level] : clipmap.origin[level] + glm::ivec4(DENSITY_CLIPMAP_SIZE);
+		densityClipmapOrigins[level] = clipmap.origin[level];
+	}
+
+	const uint32_t refreshWindows = DENSITY_CLIPMAP_SIZE / DENSITY_CLIPMAP_REFRESH_COLUMNS;
+	const uint32_t firstColumn = densityClipmapFrame % refreshWindows * DENSITY_CLIPMAP_REFRESH_COLUMNS;
+	clipmap.params = glm::vec4(DENSITY_CLIPMAP_CELL_SIZE, static_cast<float>(firstColumn), static_cast<float>(DENSITY_CLIPMAP_REFRESH_COLUMNS), (ENABLE_DENSITY_CLIPMAP) ? 1.0f : 0.0f);
+	computeShader->updateDensityClipmap(clipmap);
+
+	densityClipmapValid = true;
+	densityClipmapFrame++;
+}
+
+// Moves the window of the FAR_FIELD variant on to the next panorama tiles. The panorama is rendered from wherever the
+// camera is when a tile comes round, so once the camera is too far from where the current pass over the tiles began
+// the view march stops sampling it until every tile has been rendered again.
+void VulkanApplication::updateFarField() {
+	const uint32_t tilesPerRow = FAR_FIELD_SIZE / FAR_FIELD_TILE_SIZE;
+	const uint32_t tileCount = tilesPerRow * tilesPerRow;
+	const glm::vec3 cameraPos = mainCamera.getPosition();
+
+	if (glm::distance(cameraPos, farFieldOrigin) > FAR_FIELD_MAX_DRIFT) {
+		farFieldOrigin = cameraPos;
+		farFieldTile = 0;
+		farFieldComplete = false;
+	}
+
+	UniformFarFieldObject farField = {};
+	farField.params = glm::vec4(FAR_FIELD_DISTANCE, FAR_FIELD_BLEND, 0.0f, ((ENABLE_FAR_FIELD) && farFieldComplete) ? 1.0f : 0.0f);
+	farField.tiles = glm::uvec4(farFieldTile, tilesPerRow, 0, 0);
+	computeShader->updateFarField(farField);
+
+	farFieldTile += FAR_FIELD_TILES_PER_FRAME;
+	if (farFieldTile >= tileCount) {
+		farFieldTile = 0;
+		farFieldOrigin = cameraPos;
+		farFieldComplete = true;
+	}
+}
+
+void VulkanApplication::updateGraphicsUniformBuffers() {
+	meshShader->updateUniformBuffers(frameCamera, frameModel, frameSun, frameSky);
+	if ((ENABLE_HEIGHTMAP_TERRAIN))
+	{
+		jobs->wait(terrainJob);
+		terrain->upload();
+	}
+	if ((ENABLE_SCENE_PROPS))
+	{
+		UniformCullObject cull = {};
+		cull.viewProj = frameCamera.proj * frameCamera.view;
+		cull.counts = glm::uvec4(sceneProps->getInstanceCount(), 0, 0, 0);
+		cullShader->updateUniformBuffers(cull);
+	}
+	if ((ENABLE_FUSED_POST))
+	{
+		lightShaftShader->updateUniformBuffers(frameCamera, frameSun);
+		compositeShader->updateUniformBuffers(frameCamera, frameSun);
+	}
+	else
+	{
+		godRayShader->updateUniformBuffers(frameCamera, frameSun);
+		radialBlurShader->updateUniformBuffers(frameCamera, frameSun);
+	}
+}
+
 uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, VkPhysicalDevice physicalDevice) {
 	VkPhysicalDeviceMemoryProperties memProperties;
 	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
@@ -991,6 +1991,18 @@ uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, V
 	throw std::runtime_error("failed to find suitable memory type!");
 }
 
+// Returns -1 when no lazily allocated type fits, which is the usual case on desktop GPUs
+int32_t findLazyMemoryType(uint32_t typeFilter, VkPhysicalDevice physicalDevice) {
+	VkPhysicalDeviceMemoryProperties memProperties;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+	for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+		if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)) {
+			return static_cast<int32_t>(i);
+		}
+	}
+	return -1;
+}
+
 // copy the contents from one buffer to another
 void VulkanApplication::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
 	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
@@ -1115,6 +2127,9 @@ std::vector<const char*> VulkanApplication::getRequiredExtensions() {
 		extensions.push_back(glfwExtensions[i]);
 	}
 
+	// descriptor indexing features are queried through it, the memory report reads the heap budgets with it
+	extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+
 #ifdef _DEBUG
 	extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
 	
@@ -1159,7 +2174,32 @@ bool VulkanApplication::isDeviceSuitable(VkPhysicalDevice device) {
 		swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
 	}
 
-	return indices.isComplete() && extensionsSupported && swapChainAdequate;
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
+
+	// what DescriptorHeap relies on: partially written arrays updated while bound, indexed per invocation
+	bool descriptorIndexing = false;
+	if (extensionsSupported) {
+		VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+		indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+		VkPhysicalDeviceFeatures2KHR features2 = {};
+		features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+		features2.pNext = &indexingFeatures;
+		auto getFeatures2 = (PFN_vkGetPhysicalDeviceFeatures2KHR)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR");
+		if (getFeatures2 != nullptr) {
+			getFeatures2(device, &features2);
+			descriptorIndexing = indexingFeatures.descriptorBindingPartiallyBound &&
+				indexingFeatures.descriptorBindingSampledImageUpdateAfterBind && indexingFeatures.shaderSampledImageArrayNonUniformIndexing;
+		}
+	}
+
+	// the heap arrays are also indexed by the handles in the push constants
+	descriptorIndexing = descriptorIndexing && supportedFeatures.shaderSampledImageArrayDynamicIndexing;
+
+	// r11f_g11f_b10f and r8 storage images of the cloud history, see createLogicalDevice
+	bool historyFormats = !(CLOUD_HISTORY_FORMAT == HISTORY_FORMAT_R11G11B10_A8) || supportedFeatures.shaderStorageImageExtendedFormats;
+
+	return indices.isComplete() && extensionsSupported && swapChainAdequate && supportedFeatures.multiDrawIndirect && supportedFeatures.drawIndirectFirstInstance && descriptorIndexing && historyFormats;
 }
 
 // Find the best GPU to run Vulkan on. Fail if nothing is suitable.
@@ -1223,6 +2263,22 @@ QueueFamilyIndices VulkanApplication::findQueueFamilies(VkPhysicalDevice device)
 		i++;
 	}
 
+	if ((ENABLE_ASYNC_COMPUTE) && indices.graphicsFamily >= 0)
+	{
+		// A compute only family runs alongside graphics on AMD and NVIDIA, failing that a second graphics queue
+		for (uint32_t f = 0; f < queueFamilyCount; f++) {
+			if (queueFamilies[f].queueCount > 0 && (queueFamilies[f].queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queueFamilies[f].queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+				indices.computeFamily = f;
+				indices.computeQueueIndex = 0;
+				return indices;
+			}
+		}
+		if (queueFamilies[indices.graphicsFamily].queueCount > 1) {
+			indices.computeFamily = indices.graphicsFamily;
+			indices.computeQueueIndex = 1;
+		}
+	}
+
 	return indices;
 }
 
@@ -1232,15 +2288,15 @@ void VulkanApplication::createLogicalDevice() {
 	QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-	std::set<int> uniqueQueueFamilies = { indices.graphicsFamily, indices.presentFamily };
+	std::set<int> uniqueQueueFamilies = { indices.graphicsFamily, indices.presentFamily, indices.computeFamily };
 
-	float queuePriority = 1.0f;
+	float queuePriorities[] = { 1.0f, 1.0f };
 	for (int queueFamily : uniqueQueueFamilies) {
 		VkDeviceQueueCreateInfo queueCreateInfo = {};
 		queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
 		queueCreateInfo.queueFamilyIndex = queueFamily;
-		queueCreateInfo.queueCount = 1;
-		queueCreateInfo.pQueuePriorities = &queuePriority;
+		queueCreateInfo.queueCount = queueFamily == indices.computeFamily ? indices.computeQueueIndex + 1 : 1;
+		queueCreateInfo.pQueuePriorities = queuePriorities;
 		queueCreateInfos.push_back(queueCreateInfo);
 	}
 
@@ -1250,9 +2306,25 @@ void VulkanApplication::createLogicalDevice() {
 	resetFeatures.pNext = nullptr;
 	resetFeatures.hostQueryReset = VK_TRUE;
 
+	// the features of DescriptorHeap, checked by isDeviceSuitable
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+	indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+	indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+	indexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+	resetFeatures.pNext = &indexingFeatures;
+
 	// TODO : modify with specific features
 	VkPhysicalDeviceFeatures deviceFeatures = {};
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
+	deviceFeatures.multiDrawIndirect = VK_TRUE; // the terrain draws all of its nodes with one call
+	deviceFeatures.drawIndirectFirstInstance = VK_TRUE; // the props find their instance through it
+	deviceFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE; // the descriptor heap, at the handles in the push constants
+	if ((CLOUD_HISTORY_FORMAT == HISTORY_FORMAT_R11G11B10_A8))
+	{
+		// r11f_g11f_b10f and r8 storage images
+		deviceFeatures.shaderStorageImageExtendedFormats = VK_TRUE;
+	}
 
 	VkDeviceCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -1261,8 +2333,21 @@ void VulkanApplication::createLogicalDevice() {
 	createInfo.pEnabledFeatures = &deviceFeatures;
 	createInfo.pNext = &resetFeatures;//enable requestreset feature
 
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-	createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+	// VK_EXT_memory_budget is optional, without it the memory report only knows the heap sizes
+	std::vector<const char*> enabledExtensions = deviceExtensions;
+	uint32_t extensionCount;
+	vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+	for (const auto& extension : availableExtensions) {
+		if (strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0) {
+			enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+			memoryBudget = true;
+		}
+	}
+
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+	createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
 #ifdef _DEBUG //DEBUG_VALIDATION
 
@@ -1280,8 +2365,9 @@ void VulkanApplication::createLogicalDevice() {
 
 	// TODO : multiple queues
 	vkGetDeviceQueue(device, indices.graphicsFamily, 0, &graphicsQueue);
-	vkGetDeviceQueue(device, indices.computeFamily, 0, &computeQueue);
+	vkGetDeviceQueue(device, indices.computeFamily, indices.computeQueueIndex, &computeQueue);
 	vkGetDeviceQueue(device, indices.presentFamily, 0, &presentQueue);
+	asyncCompute = computeQueue != graphicsQueue;
 }
 
 // Make a surface for Vulkan to draw on. GLFW handles this. (Platform-dependent)
@@ -1425,7 +2511,22 @@ void VulkanApplication::createSemaphores() {
 		throw std::runtime_error("failed to create semaphores!");
 	}
 
+	queueEdgeSemaphores.resize(renderGraph.getQueueEdges().size());
+	for (VkSemaphore& semaphore : queueEdgeSemaphores) {
+		if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create queue semaphores!");
+		}
+	}
+
+	// signalled, the first frame has nothing to wait for
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+	if (vkCreateFence(device, &fenceInfo, nullptr, &computeFence) != VK_SUCCESS ||
+		vkCreateFence(device, &fenceInfo, nullptr, &graphicsFence) != VK_SUCCESS) {
 
+		throw std::runtime_error("failed to create fences!");
+	}
 }
 
 void VulkanApplication::createCommandPool() {
@@ -1445,53 +2546,84 @@ void VulkanApplication::createCommandPool() {
 	VkCommandPoolCreateInfo computePoolInfo = {};
 	computePoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 	computePoolInfo.queueFamilyIndex = queueFamilyIndices.computeFamily; //TODO: need compute index or whatever
-	computePoolInfo.flags = 0;
+	computePoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT; // recorded every frame
 
 	if (vkCreateCommandPool(device, &computePoolInfo, nullptr, &computeCommandPool) != VK_SUCCESS) {
 		throw std::runtime_error("Failed to create command pool");
 	}
 }
 
-//void VulkanApplication::CreateQueryPool()
-//{
-//	VkQueryPoolCreateInfo createInfo{};
-//	createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
-//	createInfo.pNext = nullptr; // Optional
-//	createInfo.flags = 0; // Reserved for future use, must be 0!
-//
-//	createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
-//	createInfo.queryCount = offscreenPass.commandBuffers.size() * 2; // REVIEW
-//
-//	VkResult result = vkCreateQueryPool(device, &createInfo, nullptr, &mTimeQueryPool);
-//	if (result != VK_SUCCESS)
-//	{
-//		throw std::runtime_error("Failed to create time query pool!");
-//	}
-//}
-
-//void VulkanApplication::FetchRenderTimeResults(uint32_t swapchainIndex)
-//{
-//	uint64_t buffer[2];
-//
-//	VkResult result = vkGetQueryPoolResults(device, mTimeQueryPool, swapchainIndex * 2, 2, sizeof(uint64_t) * 2, buffer, sizeof(uint64_t),
-//		VK_QUERY_RESULT_64_BIT);
-//	if (result == VK_NOT_READY)
-//	{
-//		return;
-//	}
-//	else if (result == VK_SUCCESS)
-//	{
-//		mTimeQueryResults[swapchainIndex] = buffer[1] - buffer[0];
-//	}
-//	else
-//	{
-//		throw std::runtime_error("Failed to receive query results!");
-//	}
-//
-//	// Queries must be reset after each individual use.
-//	// resetquery is supported since Vulkan 1.2
-//	//vkResetQueryPoolEXT(device, mTimeQueryPool, swapchainIndex * 2, 2);
-//}
+// Two timestamps per render graph pass, see RenderGraph::enableTimestamps
+void VulkanApplication::CreateQueryPool()
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	timestampPeriod = properties.limits.timestampPeriod;
+
+	VkQueryPoolCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	createInfo.pNext = nullptr; // Optional
+	createInfo.flags = 0; // Reserved for future use, must be 0!
+
+	createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	createInfo.queryCount = renderGraph.getPassCount() * 2;
+
+	VkResult result = vkCreateQueryPool(device, &createInfo, nullptr, &mTimeQueryPool);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create time query pool!");
+	}
+
+	// the command buffers reset the queries before writing them, results may be read before the first write though
+	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+	vkCmdResetQueryPool(commandBuffer, mTimeQueryPool, 0, createInfo.queryCount);
+	endSingleTimeCommands(commandBuffer);
+
+	mTimeQueryResults.assign(createInfo.queryCount, 0);
+	timelineResults.assign(createInfo.queryCount, 0);
+
+	// findQueueFamilies insists on timestamps for graphics, a compute only family may not have them
+	QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+	renderGraph.enableTimestamps(RenderGraphQueue::Offscreen, mTimeQueryPool);
+	renderGraph.enableTimestamps(RenderGraphQueue::Present, mTimeQueryPool);
+	if (queueFamilies[indices.computeFamily].timestampValidBits > 0)
+	{
+		renderGraph.enableTimestamps(RenderGraphQueue::Compute, mTimeQueryPool);
+	}
+}
+
+// Reads the timestamps of the passes on one queue, once its fence says the last submit is done
+void VulkanApplication::FetchRenderTimeResults(RenderGraphQueue queue)
+{
+	// the passes of a queue are next to each other, see RenderGraph::addPass
+	uint32_t firstPass = UINT32_MAX, passCount = 0;
+	for (uint32_t p = 0; p < renderGraph.getPassCount(); p++) {
+		if (renderGraph.getPassQueue(p) == queue) {
+			firstPass = std::min(firstPass, p);
+			passCount++;
+		}
+	}
+	if (mTimeQueryPool == VK_NULL_HANDLE || passCount == 0) {
+		return;
+	}
+
+	VkResult result = vkGetQueryPoolResults(device, mTimeQueryPool, firstPass * 2, passCount * 2, sizeof(uint64_t) * passCount * 2,
+		&mTimeQueryResults[firstPass * 2], sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+	if (result == VK_NOT_READY)
+	{
+		// not written yet, the first frame or a queue without timestamps
+		return;
+	}
+	else if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to receive query results!");
+	}
+}
 
 VkCommandBuffer VulkanApplication::beginSingleTimeCommands() {
 	VkCommandBufferAllocateInfo allocInfo = {};
@@ -1563,68 +2695,145 @@ void VulkanApplication::createCommandBuffers() {
 	for (int i = 0; i < offscreenPass.commandBuffers.size(); i++) {
 		vkBeginCommandBuffer(offscreenPass.commandBuffers[i], &beginInfo);
 
-		std::array<VkClearValue, 2> clearValues = {};
-		clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
-		clearValues[1].depthStencil = { 1.0f, 0 };
-
-		// Actual render pass creation
-		VkRenderPassBeginInfo renderPassInfo = {};
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.renderPass = offscreenPass.renderPass;
-		renderPassInfo.framebuffer = offscreenPass.framebuffers[0].framebuffer;
-		renderPassInfo.renderArea.offset = { 0, 0 };
-		renderPassInfo.renderArea.extent = swapChainExtent;
-		VkClearValue clearColor = { 0.0f, 0.0f, 0.0f, 0.0f };
-		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-		renderPassInfo.pClearValues = clearValues.data();
-
-		//// time stamp query supported since vulkan1.2
-		//vkCmdWriteTimestamp(offscreenPass.commandBuffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, mTimeQueryPool, i * 2);
-
-		// Render pass recording
-		vkCmdBeginRenderPass(offscreenPass.commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		// Scene and post passes, see buildRenderGraph. Timestamped per pass when CreateQueryPool enabled it.
+		renderGraph.record(RenderGraphQueue::Offscreen, offscreenPass.commandBuffers[i], i);
 
-		// Draw Background
-		backgroundShader->bindShader(offscreenPass.commandBuffers[i]);
-		backgroundGeometry->enqueueDrawCommands(offscreenPass.commandBuffers[i]);
+		if (vkEndCommandBuffer(offscreenPass.commandBuffers[i]) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record offscreen command buffer!");
+		}
+	}
 
-		vkCmdEndRenderPass(offscreenPass.commandBuffers[i]);
+}
 
-		// Use the next framebuffer in the offscreen pass
-		renderPassInfo.framebuffer = offscreenPass.framebuffers[1].framebuffer;
+void VulkanApplication::beginOffscreenRenderPass(VkCommandBuffer commandBuffer, const std::string& target) {
+	std::array<VkClearValue, 2> clearValues = {};
+	clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
+	clearValues[1].depthStencil = { 1.0f, 0 };
 
-		// God rays and mesh drawing
+	VkRenderPassBeginInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = offscreenPass.renderPass;
+	renderPassInfo.framebuffer = offscreenPass.framebuffers.at(target).framebuffer;
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent = swapChainExtent;
+	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+	renderPassInfo.pClearValues = clearValues.data();
 
-		vkCmdBeginRenderPass(offscreenPass.commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+}
 
-		godRayShader->bindShader(offscreenPass.commandBuffers[i]);
-		backgroundGeometry->enqueueDrawCommands(offscreenPass.commandBuffers[i]);
+void VulkanApplication::beginSwapchainRenderPass(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+	std::array<VkClearValue, 2> clearValues = {};
+	clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
+	clearValues[1].depthStencil = { 1.0f, 0 };
 
-		vkCmdEndRenderPass(offscreenPass.commandBuffers[i]);
+	VkRenderPassBeginInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = renderPass;
+	renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent = swapChainExtent;
+	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+	renderPassInfo.pClearValues = clearValues.data();
 
-		// Use the next framebuffer in the offscreen pass
-		renderPassInfo.framebuffer = offscreenPass.framebuffers[2].framebuffer;
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+}
 
-		// Radial Blur
-		vkCmdBeginRenderPass(offscreenPass.commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+// Picks the SPIR-V variant compiled for CLOUD_HISTORY_FORMAT, see the custom build steps in SkyEngine.vcxproj
+std::string VulkanApplication::historyShaderPath(const std::string& path) {
+	if ((CLOUD_HISTORY_FORMAT == HISTORY_FORMAT_RGBA16F)) {
+		return path + ".rgba16f.spv";
+	}
+	if ((CLOUD_HISTORY_FORMAT == HISTORY_FORMAT_R11G11B10_A8)) {
+		return path + ".r11g11b10a8.spv";
+	}
+	return path + ".spv";
+}
 
-		radialBlurShader->bindShader(offscreenPass.commandBuffers[i]);
-		backgroundGeometry->enqueueDrawCommands(offscreenPass.commandBuffers[i]);
+// Reports the size and bandwidth of each history format. With the RGBA32F history the current frame is read back and
+// every pixel is round-tripped through the smaller formats on the cpu to get the quantization error of a single store.
+// Error that builds up through repeated reprojection is not captured.
+void VulkanApplication::measureHistoryPrecision() {
+	VkExtent2D extent = backgroundTexture->getExtent();
+	size_t pixelCount = static_cast<size_t>(extent.width) * extent.height;
 
-		// Draw Scene
-		meshShader->bindShader(offscreenPass.commandBuffers[i]);
-		sceneGeometry->enqueueDrawCommands(offscreenPass.commandBuffers[i]);
+	// per frame: reproject reads the previous history and writes the current one, the background pass samples it,
+	// and compute-clouds rewrites one pixel in 16 (gather taps of the reprojection filter are not counted)
+	const double touchesPerPixel = 3.0 + 1.0 / 16.0;
+	const char* formatNames[3] = { "RGBA32F", "RGBA16F", "R11G11B10F+R8" };
+	const double bytesPerPixel[3] = { 16.0, 8.0, 5.0 };
 
-		vkCmdEndRenderPass(offscreenPass.commandBuffers[i]);
+	std::ostringstream report;
+	report.setf(std::ios::fixed);
+	report.precision(2);
+	report << "history " << extent.width << "x" << extent.height << ", x2 for ping-pong" << std::endl;
+	for (int i = 0; i < 3; i++) {
+		double imageMB = bytesPerPixel[i] * pixelCount / (1024.0 * 1024.0);
+		report << (i == CLOUD_HISTORY_FORMAT ? "* " : "  ") << formatNames[i] << ": " << bytesPerPixel[i] << " B/px, "
+			<< imageMB << " MB/image, " << imageMB * touchesPerPixel << " MB/frame" << std::endl;
+	}
 
-		//// time stamp query
-		//vkCmdWriteTimestamp(offscreenPass.commandBuffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, mTimeQueryPool, i * 2 + 1);
+	if ((CLOUD_HISTORY_FORMAT != HISTORY_FORMAT_RGBA32F)) {
+		report << "set CLOUD_HISTORY_FORMAT to HISTORY_FORMAT_RGBA32F to measure the error" << std::endl;
+	}
+	else {
+		vkDeviceWaitIdle(device);
+		std::vector<char> pixels;
+		// the history belongs to the compute queue family with async compute, its copy to the graphics one
+		Texture* source = asyncCompute ? cloudDisplayTexture : backgroundTexture;
+		source->readStorage(pixels, sizeof(glm::vec4));
+		const glm::vec4* history = reinterpret_cast<const glm::vec4*>(pixels.data());
+
+		struct PrecisionError {
+			double maxAbs = 0.0, sumAbs = 0.0, maxRel = 0.0;
+			double maxAlpha = 0.0, sumAlpha = 0.0;
+		};
+		PrecisionError errors[2];
+		size_t measured = 0;
+
+		for (size_t p = 0; p < pixelCount; p++) {
+			glm::vec4 ref = history[p];
+			if (!std::isfinite(ref.r) || !std::isfinite(ref.g) || !std::isfinite(ref.b) || !std::isfinite(ref.a)) continue;
+
+			glm::vec4 approx[2];
+			approx[0] = glm::unpackHalf4x16(glm::packHalf4x16(ref));
+			approx[1] = glm::vec4(glm::unpackF2x11_1x10(glm::packF2x11_1x10(glm::vec3(ref))), glm::unpackUnorm1x8(glm::packUnorm1x8(ref.a)));
+
+			for (int f = 0; f < 2; f++) {
+				for (int c = 0; c < 3; c++) {
+					double absError = std::abs(double(approx[f][c]) - ref[c]);
+					errors[f].maxAbs = std::max(errors[f].maxAbs, absError);
+					errors[f].sumAbs += absError;
+					errors[f].maxRel = std::max(errors[f].maxRel, absError / std::max(std::abs(double(ref[c])), 1e-4));
+				}
+				double alphaError = std::abs(double(approx[f].a) - ref.a);
+				errors[f].maxAlpha = std::max(errors[f].maxAlpha, alphaError);
+				errors[f].sumAlpha += alphaError;
+			}
+			measured++;
+		}
 
-		if (vkEndCommandBuffer(offscreenPass.commandBuffers[i]) != VK_SUCCESS) {
-			throw std::runtime_error("failed to record offscreen command buffer!");
+		report.setf(std::ios::scientific, std::ios::floatfield);
+		for (int f = 0; f < 2; f++) {
+			report << formatNames[f + 1] << " rgb max " << errors[f].maxAbs << " mean " << errors[f].sumAbs / std::max<size_t>(measured * 3, 1)
+				<< " max rel " << errors[f].maxRel << ", alpha max " << errors[f].maxAlpha << " mean " << errors[f].sumAlpha / std::max<size_t>(measured, 1) << std::endl;
 		}
 	}
 
+	historyPrecisionReport = report.str();
+	std::cout << historyPrecisionReport;
+}
+
+// Half res god rays for the fused post path, recorded on the graphics queue right after the scene pass.
+// The render graph orders it against the scene pass and the composite that samples the shafts.
+void VulkanApplication::recordLightShaftPass(VkCommandBuffer commandBuffer) {
+	lightShaftShader->bindShader(commandBuffer);
+
+	const glm::ivec2 texDims(swapChainExtent.width / 2, swapChainExtent.height / 2);
+	vkCmdDispatch(commandBuffer,
+		static_cast<uint32_t>((texDims.x + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE),
+		static_cast<uint32_t>((texDims.y + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE),
+		1);
 }
 
 // Run the final post process that renders to the screen
@@ -1648,28 +2857,7 @@ void VulkanApplication::createPostProcessCommandBuffer() {
 
 		vkBeginCommandBuffer(commandBuffers[i], &beginInfo);
 
-		std::array<VkClearValue, 2> clearValues = {};
-		clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
-		clearValues[1].depthStencil = { 1.0f, 0 };
-
-		// Actual render pass creation
-		VkRenderPassBeginInfo renderPassInfo = {};
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.renderPass = renderPass;
-		renderPassInfo.framebuffer = swapChainFramebuffers[i];
-		renderPassInfo.renderArea.offset = { 0, 0 };
-		renderPassInfo.renderArea.extent = swapChainExtent;
-		VkClearValue clearColor = { 0.0f, 0.0f, 0.0f, 1.0f };
-		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-		renderPassInfo.pClearValues = clearValues.data();
-
-		// Render pass recording
-		vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-		toneMapShader->bindShader(commandBuffers[i]);
-		backgroundGeometry->enqueueDrawCommands(commandBuffers[i]);
-
-		vkCmdEndRenderPass(commandBuffers[i]);
+		renderGraph.record(RenderGraphQueue::Present, commandBuffers[i], static_cast<uint32_t>(i));
 
 		if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
 			throw std::runtime_error("failed to record command buffer!");
@@ -1691,42 +2879,29 @@ void VulkanApplication::createComputeCommandBuffer() {
 		throw std::runtime_error("Failed to allocate command buffers");
 	}
 
+	// need 2 buffers to ping-pong draw targets
+	for (uint32_t i = 0; i < 2; i++) {
+		recordComputeCommandBuffer(i);
+	}
+}
+
+void VulkanApplication::recordComputeCommandBuffer(uint32_t variant) {
 	VkCommandBufferBeginInfo beginInfo = {};
 	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 	beginInfo.pInheritanceInfo = nullptr;
 
-	// need 2 buffers to ping-pong draw targets
-	for (int i = 0; i < 2; i++) {
-		// Begin recording
-		if (vkBeginCommandBuffer(computeCommandBuffers[i], &beginInfo) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to begin recording compute command buffer");
-		}
-
-		reprojectShader->bindShader(computeCommandBuffers[i]);
-
-		const glm::ivec2 texDimsFull(swapChainExtent.width, swapChainExtent.height);
-		vkCmdDispatch(computeCommandBuffers[i],
-			static_cast<uint32_t>((texDimsFull.x + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE),
-			static_cast<uint32_t>((texDimsFull.y + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE),
-			1);
+	// Begin recording, resets what the buffer held
+	if (vkBeginCommandBuffer(computeCommandBuffers[variant], &beginInfo) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to begin recording compute command buffer");
+	}
 
-		// compute shader will switch descriptor set binding inside this function
-		computeShader->bindShader(computeCommandBuffers[i]);
+	// reproject then raymarch, the graph puts a barrier between the two
+	renderGraph.record(RenderGraphQueue::Compute, computeCommandBuffers[variant], variant);
 
-		// TODO: dispatch according to the number of pixels, do in a 2d manner? see the raytracing example
-		// first TODO: launch this compute shader for the triangle being rendered
-		//const int IMAGE_SIZE = 32;
-		const glm::ivec2 texDims(swapChainExtent.width / 4, swapChainExtent.height / 4);
-		vkCmdDispatch(computeCommandBuffers[i],
-			static_cast<uint32_t>((texDims.x + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE),
-			static_cast<uint32_t>((texDims.y + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE),
-			1);
-
-		// End recording
-		if (vkEndCommandBuffer(computeCommandBuffers[i]) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to record compute command buffer");
-		}
+	// End recording
+	if (vkEndCommandBuffer(computeCommandBuffers[variant]) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to record compute command buffer");
 	}
 }
 
@@ -1756,97 +2931,135 @@ void VulkanApplication::createFramebuffers() {
 
 // Needs to be called once for each post process effect
 // Expects a framebuffer, color and depth format to sample
-void VulkanApplication::createOffscreenFramebuffer(FrameBuffer* framebuffer, VkFormat colorFormat, VkFormat depthFormat)
+// Image only, memory is bound by the caller. Takes the extent so reportOffscreenMemory can probe other resolutions.
+VkImage VulkanApplication::createAttachmentImage(VkFormat format, VkImageUsageFlags usage, VkExtent2D extent)
 {
-	// Color attachment
 	VkImageCreateInfo image{};
 	image.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 	image.imageType = VK_IMAGE_TYPE_2D;
-	image.format = colorFormat;
-	image.extent.width = WIDTH;
-	image.extent.height = HEIGHT;
+	image.format = format;
+	image.extent.width = extent.width;
+	image.extent.height = extent.height;
 	image.extent.depth = 1;
 	image.mipLevels = 1;
 	image.arrayLayers = 1;
 	image.samples = VK_SAMPLE_COUNT_1_BIT;
 	image.tiling = VK_IMAGE_TILING_OPTIMAL;
-	// We will sample directly from the color attachment
-	image.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	image.usage = usage;
 
-	VkMemoryAllocateInfo memAlloc{};
-	memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	VkMemoryRequirements memReqs;
-
-	VkImageViewCreateInfo colorImageView{};
-	colorImageView.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-	colorImageView.viewType = VK_IMAGE_VIEW_TYPE_2D;
-	colorImageView.format = colorFormat;
-	colorImageView.flags = 0;
-	colorImageView.subresourceRange = {};
-	colorImageView.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	colorImageView.subresourceRange.baseMipLevel = 0;
-	colorImageView.subresourceRange.levelCount = 1;
-	colorImageView.subresourceRange.baseArrayLayer = 0;
-	colorImageView.subresourceRange.layerCount = 1;
-
-	if (vkCreateImage(device, &image, nullptr, &framebuffer->color.image) != VK_SUCCESS) {
+	VkImage result;
+	if (vkCreateImage(device, &image, nullptr, &result) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create image!");
 	}
+	return result;
+}
 
-	vkGetImageMemoryRequirements(device, framebuffer->color.image, &memReqs);
-	memAlloc.allocationSize = memReqs.size;
-	memAlloc.memoryTypeIndex = findMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, physicalDevice);
-	if (vkAllocateMemory(device, &memAlloc, nullptr, &framebuffer->color.mem) != VK_SUCCESS) {
-		throw std::runtime_error("failed to allocate memory!");
-	}
-
-	if (vkBindImageMemory(device, framebuffer->color.image, framebuffer->color.mem, 0) != VK_SUCCESS) {
-		throw std::runtime_error("failed to bind image memory!");
-	}
-
-	colorImageView.image = framebuffer->color.image;
-	if (vkCreateImageView(device, &colorImageView, nullptr, &framebuffer->color.view) != VK_SUCCESS) {
+VkImageView VulkanApplication::createAttachmentView(VkImage image, VkFormat format, VkImageAspectFlags aspect)
+{
+	VkImageViewCreateInfo imageView{};
+	imageView.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	imageView.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	imageView.format = format;
+	imageView.flags = 0;
+	imageView.subresourceRange = {};
+	imageView.subresourceRange.aspectMask = aspect;
+	imageView.subresourceRange.baseMipLevel = 0;
+	imageView.subresourceRange.levelCount = 1;
+	imageView.subresourceRange.baseArrayLayer = 0;
+	imageView.subresourceRange.layerCount = 1;
+	imageView.image = image;
+
+	VkImageView result;
+	if (vkCreateImageView(device, &imageView, nullptr, &result) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create image view!");
 	}
+	return result;
+}
 
-	// Depth stencil attachment
-	image.format = depthFormat;
-	image.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+// The depth buffer is cleared on load and never stored, nothing outside a render pass reads it.
+// It is transient and goes to lazily allocated memory where the device has it (tilers keep it in tile memory).
+void VulkanApplication::createOffscreenDepth(VkFormat depthFormat)
+{
+	offscreenPass.depth.image = createAttachmentImage(depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+		{ static_cast<uint32_t>(WIDTH), static_cast<uint32_t>(HEIGHT) });
 
-	VkImageViewCreateInfo depthStencilView{};
-	depthStencilView.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-	depthStencilView.viewType = VK_IMAGE_VIEW_TYPE_2D;
-	depthStencilView.format = depthFormat;
-	depthStencilView.flags = 0;
-	depthStencilView.subresourceRange = {};
-	depthStencilView.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;// | VK_IMAGE_ASPECT_STENCIL_BIT;
-	depthStencilView.subresourceRange.baseMipLevel = 0;
-	depthStencilView.subresourceRange.levelCount = 1;
-	depthStencilView.subresourceRange.baseArrayLayer = 0;
-	depthStencilView.subresourceRange.layerCount = 1;
+	VkMemoryRequirements memReqs;
+	vkGetImageMemoryRequirements(device, offscreenPass.depth.image, &memReqs);
 
-	if (vkCreateImage(device, &image, nullptr, &framebuffer->depth.image) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create image!");
-	}
-	vkGetImageMemoryRequirements(device, framebuffer->depth.image, &memReqs);
+	VkMemoryAllocateInfo memAlloc{};
+	memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
 	memAlloc.allocationSize = memReqs.size;
-	memAlloc.memoryTypeIndex = findMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, physicalDevice);
-	if (vkAllocateMemory(device, &memAlloc, nullptr, &framebuffer->depth.mem) != VK_SUCCESS) {
+	int32_t lazyType = findLazyMemoryType(memReqs.memoryTypeBits, physicalDevice);
+	memAlloc.memoryTypeIndex = lazyType >= 0 ? static_cast<uint32_t>(lazyType) : findMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, physicalDevice);
+	const std::string depthDetail = std::to_string(WIDTH) + "x" + std::to_string(HEIGHT) + " " + FormatName(depthFormat) + (lazyType >= 0 ? ", lazily allocated" : "");
+	if (AllocateTrackedMemory(device, memAlloc, offscreenPass.depth.mem, MemoryCategory::Framebuffer, "offscreen depth", depthDetail) != VK_SUCCESS) {
 		throw std::runtime_error("failed to allocate memory!");
 	}
 
-	if (vkBindImageMemory(device, framebuffer->depth.image, framebuffer->depth.mem, 0) != VK_SUCCESS) {
+	if (vkBindImageMemory(device, offscreenPass.depth.image, offscreenPass.depth.mem, 0) != VK_SUCCESS) {
 		throw std::runtime_error("failed to bind image!");
 	}
 
-	depthStencilView.image = framebuffer->depth.image;
-	if (vkCreateImageView(device, &depthStencilView, nullptr, &framebuffer->depth.view) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create image view!");
+	offscreenPass.depth.view = createAttachmentView(offscreenPass.depth.image, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);// | VK_IMAGE_ASPECT_STENCIL_BIT;
+}
+
+// blockOf is the render graph's aliasing plan, parallel to its transients
+void VulkanApplication::allocateOffscreenTargets(const std::vector<uint32_t>& blockOf)
+{
+	const std::vector<RenderGraphResource>& targets = renderGraph.getTransients();
+	size_t blockCount = 0;
+	for (uint32_t block : blockOf) {
+		blockCount = std::max<size_t>(blockCount, block + 1);
+	}
+
+	// a block has to fit and be bindable for every image placed in it, all are bound at offset 0
+	std::vector<VkMemoryRequirements> blockReqs(blockCount);
+	for (auto& reqs : blockReqs) {
+		reqs.size = 0;
+		reqs.memoryTypeBits = ~0u;
+	}
+	for (size_t i = 0; i < targets.size(); i++) {
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(device, offscreenPass.framebuffers.at(renderGraph.getName(targets[i])).color.image, &memReqs);
+		VkMemoryRequirements& reqs = blockReqs[blockOf[i]];
+		reqs.size = std::max(reqs.size, memReqs.size);
+		reqs.memoryTypeBits &= memReqs.memoryTypeBits;
+	}
+
+	// the memory report lists every block with the targets aliased in it
+	std::vector<std::string> blockTargets(blockCount);
+	for (size_t i = 0; i < targets.size(); i++) {
+		std::string& names = blockTargets[blockOf[i]];
+		names += (names.empty() ? "" : ", ") + renderGraph.getName(targets[i]);
+	}
+
+	offscreenPass.colorMemory.resize(blockCount);
+	for (size_t b = 0; b < blockCount; b++) {
+		VkMemoryAllocateInfo memAlloc{};
+		memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		memAlloc.allocationSize = blockReqs[b].size;
+		memAlloc.memoryTypeIndex = findMemoryType(blockReqs[b].memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, physicalDevice);
+		const std::string blockDetail = std::to_string(WIDTH) + "x" + std::to_string(HEIGHT) + " " + FormatName(VK_FORMAT_R32G32B32A32_SFLOAT) + ": " + blockTargets[b];
+		if (AllocateTrackedMemory(device, memAlloc, offscreenPass.colorMemory[b], MemoryCategory::Framebuffer, "offscreen block " + std::to_string(b), blockDetail) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate memory!");
+		}
 	}
 
+	for (size_t i = 0; i < targets.size(); i++) {
+		if (vkBindImageMemory(device, offscreenPass.framebuffers.at(renderGraph.getName(targets[i])).color.image, offscreenPass.colorMemory[blockOf[i]], 0) != VK_SUCCESS) {
+			throw std::runtime_error("failed to bind image memory!");
+		}
+	}
+}
+
+// Colour image must already be created and bound, see allocateOffscreenTargets
+void VulkanApplication::createOffscreenFramebuffer(FrameBuffer* framebuffer)
+{
+	framebuffer->color.view = createAttachmentView(framebuffer->color.image, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT);
+
 	VkImageView attachments[2];
 	attachments[0] = framebuffer->color.view;
-	attachments[1] = framebuffer->depth.view;
+	attachments[1] = offscreenPass.depth.view;
 
 	VkFramebufferCreateInfo fbufCreateInfo{};
 	fbufCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
@@ -1867,6 +3080,258 @@ void VulkanApplication::createOffscreenFramebuffer(FrameBuffer* framebuffer, VkF
 	framebuffer->descriptor.sampler = offscreenPass.sampler;
 }
 
+// Prints what the offscreen targets cost with one colour and one depth image per framebuffer against the aliased colour
+// blocks plus the shared transient depth. Sizes come from the driver for throwaway images at each resolution.
+void VulkanApplication::reportOffscreenMemory(VkFormat colorFormat, VkFormat depthFormat, size_t targetCount, size_t blockCount)
+{
+	const VkExtent2D resolutions[3] = { { 1920, 1080 }, { 2560, 1440 }, { 3840, 2160 } };
+
+	for (const VkExtent2D& extent : resolutions) {
+		VkImage colorImage = createAttachmentImage(colorFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, extent);
+		VkImage depthImage = createAttachmentImage(depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, extent);
+		VkImage transientImage = createAttachmentImage(depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT, extent);
+
+		VkMemoryRequirements colorReqs, depthReqs, transientReqs;
+		vkGetImageMemoryRequirements(device, colorImage, &colorReqs);
+		vkGetImageMemoryRequirements(device, depthImage, &depthReqs);
+		vkGetImageMemoryRequirements(device, transientImage, &transientReqs);
+		bool lazyDepth = findLazyMemoryType(transientReqs.memoryTypeBits, physicalDevice) >= 0;
+
+		vkDestroyImage(device, colorImage, nullptr);
+		vkDestroyImage(device, depthImage, nullptr);
+		vkDestroyImage(device, transientImage, nullptr);
+
+		VkDeviceSize before = targetCount * (colorReqs.size + depthReqs.size);
+		VkDeviceSize after = blockCount * colorReqs.size + (lazyDepth ? 0 : transientReqs.size);
+
+		std::cout << "offscreen targets " << extent.width << "x" << extent.height << ": "
+			<< before / (1024.0 * 1024.0) << " MB -> " << after / (1024.0 * 1024.0) << " MB ("
+			<< targetCount << " colour in " << blockCount << " blocks, depth " << (lazyDepth ? "lazily allocated" : "shared") << ")" << std::endl;
+	}
+}
+
+// Every pass of a frame in submission order, with the images it reads and writes. The graph derives the barriers,
+// layout transitions and queue ownership transfers between them and which offscreen targets can alias, so a new
+// pass only needs its shader and an entry here. Record functions run later, once the shaders exist.
+void VulkanApplication::buildRenderGraph() {
+	QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+	renderGraph.setQueue(RenderGraphQueue::Compute, computeQueue, indices.computeFamily);
+	renderGraph.setQueue(RenderGraphQueue::Offscreen, graphicsQueue, indices.graphicsFamily);
+	renderGraph.setQueue(RenderGraphQueue::Present, graphicsQueue, indices.graphicsFamily);
+
+	// both history images are touched by every pass that uses one, the shaders swap them each frame
+	std::vector<VkImage> historyImages = { backgroundTexture->getImage(), backgroundTexturePrev->getImage() };
+	if (backgroundAlpha != nullptr) {
+		historyImages.push_back(backgroundAlpha->getImage());
+		historyImages.push_back(backgroundAlphaPrev->getImage());
+	}
+	RenderGraphResource history = renderGraph.importImage("history", historyImages, VK_IMAGE_LAYOUT_GENERAL);
+	RenderGraphResource scene = renderGraph.createTransient("scene");
+
+	// what the clouds and the pass drawing the terrain sample for weather, nothing while it is CloudPlacement.png
+	std::vector<std::pair<RenderGraphResource, ImageUsage>> cloudUses = { { history, ImageUsage::StorageReadWrite } };
+	std::vector<std::pair<RenderGraphResource, ImageUsage>> meshUses;
+	// what the density clipmap update and the far field sample, the kernels that evaluate cloud density before the clouds
+	std::vector<std::pair<RenderGraphResource, ImageUsage>> densityUses;
+
+	renderGraph.addPass("reproject", RenderGraphQueue::Compute, { { history, ImageUsage::StorageReadWrite } }, [this](VkCommandBuffer commandBuffer, uint32_t variant) {
+		reprojectShader->bindShader(commandBuffer, variant);
+
+		const glm::ivec2 texDimsFull(swapChainExtent.width, swapChainExtent.height);
+		vkCmdDispatch(commandBuffer,
+			static_cast<uint32_t>((texDimsFull.x + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE),
+			static_cast<uint32_t>((texDimsFull.y + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE),
+			1);
+	});
+
+	if ((ENABLE_DYNAMIC_WEATHER))
+	{
+		// both maps again, each pass reads one and writes the other
+		RenderGraphResource weather = renderGraph.importImage("weather", { weatherMaps[0]->getImage(), weatherMaps[1]->getImage() }, VK_IMAGE_LAYOUT_GENERAL);
+		cloudUses.push_back({ weather, ImageUsage::SampledCompute });
+		meshUses.push_back({ weather, ImageUsage::SampledFragment });
+		densityUses.push_back({ weather, ImageUsage::SampledCompute });
+
+		renderGraph.addPass("weather", RenderGraphQueue::Compute, { { weather, ImageUsage::StorageReadWrite } }, [this](VkCommandBuffer commandBuffer, uint32_t variant) {
+			weatherShader->bindShader(commandBuffer, variant);
+			// the window of this frame, then the copy of the one before
+			vkCmdDispatch(commandBuffer, 2 * WEATHER_TILES_PER_FRAME, 1, 1);
+		});
+
+		if (asyncCompute)
+		{
+			RenderGraphResource display = renderGraph.importImage("weatherDisplay", { weatherDisplay->getImage() }, VK_IMAGE_LAYOUT_GENERAL);
+			meshUses.back().first = display;
+
+			renderGraph.addPass("publishWeather", RenderGraphQueue::Compute, { { weather, ImageUsage::TransferSrc }, { display, ImageUsage::TransferDst } }, [this](VkCommandBuffer commandBuffer, uint32_t variant) {
+				VkImageCopy region = {};
+				region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+				region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+				region.extent = { WEATHER_MAP_SIZE, WEATHER_MAP_SIZE, 1 };
+				vkCmdCopyImage(commandBuffer, weatherMaps[1 - variant]->getImage(), VK_IMAGE_LAYOUT_GENERAL,
+					weatherDisplay->getImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+			});
+		}
+	}
+
+	// all levels together, the update writes some texels of each and leaves the others as they were
+	std::vector<VkImage> clipmapImages;
+	for (Texture3D* level : densityClipmap) {
+		clipmapImages.push_back(level->getImage());
+	}
+	RenderGraphResource clipmap = renderGraph.importImage("densityClipmap", clipmapImages, VK_IMAGE_LAYOUT_GENERAL);
+	cloudUses.push_back({ clipmap, ImageUsage::SampledCompute });
+	if ((ENABLE_DENSITY_CLIPMAP))
+	{
+		std::vector<std::pair<RenderGraphResource, ImageUsage>> clipmapUses = densityUses;
+		clipmapUses.push_back({ clipmap, ImageUsage::StorageWrite });
+		renderGraph.addPass("densityClipmap", RenderGraphQueue::Compute, clipmapUses, [this](VkCommandBuffer commandBuffer, uint32_t) {
+			computeShader->bindClipmapUpdate(commandBuffer);
+			// levels stacked along z
+			const uint32_t groups = DENSITY_CLIPMAP_SIZE / DENSITY_CLIPMAP_WORKGROUP_SIZE;
+			vkCmdDispatch(commandBuffer, groups, groups, groups * DENSITY_CLIPMAP_LEVELS);
+		});
+	}
+	densityUses.push_back({ clipmap, ImageUsage::SampledCompute });
+
+	// the tiles of this frame only, the rest of the panorama stays as it was
+	RenderGraphResource farField = renderGraph.importImage("farField", { farFieldPanorama->getImage() }, VK_IMAGE_LAYOUT_GENERAL);
+	cloudUses.push_back({ farField, ImageUsage::SampledCompute });
+	if ((ENABLE_FAR_FIELD))
+	{
+		std::vector<std::pair<RenderGraphResource, ImageUsage>> farFieldUses = densityUses;
+		farFieldUses.push_back({ farField, ImageUsage::StorageWrite });
+		renderGraph.addPass("farField", RenderGraphQueue::Compute, farFieldUses, [this](VkCommandBuffer commandBuffer, uint32_t) {
+			computeShader->bindFarField(commandBuffer);
+			// one workgroup per tile
+			vkCmdDispatch(commandBuffer, FAR_FIELD_TILES_PER_FRAME, 1, 1);
+		});
+	}
+
+	renderGraph.addPass("clouds", RenderGraphQueue::Compute, cloudUses, [this](VkCommandBuffer commandBuffer, uint32_t variant) {
+		// the sets of the ping-pong variant, and the push constants of the frame
+		computeShader->bindShader(commandBuffer, variant);
+
+		// one pixel of every 4x4 block is raymarched per frame
+		const glm::ivec2 texDims(swapChainExtent.width / 4, swapChainExtent.height / 4);
+		vkCmdDispatch(commandBuffer,
+			static_cast<uint32_t>((texDims.x + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE),
+			static_cast<uint32_t>((texDims.y + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE),
+			1);
+	});
+
+	// With async compute the background samples a copy of the finished history instead. The history then never
+	// leaves the compute queue, only the copy is handed to the graphics queue (an ownership transfer when the queue
+	// families differ), and the clouds of the next frame need not wait for the scene pass to be done with it.
+	RenderGraphResource clouds = history;
+	if (asyncCompute)
+	{
+		std::vector<VkImage> displayImages = { cloudDisplayTexture->getImage() };
+		if (cloudDisplayAlpha != nullptr) {
+			displayImages.push_back(cloudDisplayAlpha->getImage());
+		}
+		clouds = renderGraph.importImage("cloudDisplay", displayImages, VK_IMAGE_LAYOUT_GENERAL);
+
+		renderGraph.addPass("publishClouds", RenderGraphQueue::Compute, { { history, ImageUsage::TransferSrc }, { clouds, ImageUsage::TransferDst } }, [this](VkCommandBuffer commandBuffer, uint32_t variant) {
+			// command buffer 0 raymarches into the first image of each ping-pong pair
+			VkImageCopy region = {};
+			region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+			region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+			region.extent = { swapChainExtent.width, swapChainExtent.height, 1 };
+
+			Texture* color = variant == 0 ? backgroundTexture : backgroundTexturePrev;
+			vkCmdCopyImage(commandBuffer, color->getImage(), VK_IMAGE_LAYOUT_GENERAL,
+				cloudDisplayTexture->getImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+			if (cloudDisplayAlpha != nullptr) {
+				Texture* alpha = variant == 0 ? backgroundAlpha : backgroundAlphaPrev;
+				vkCmdCopyImage(commandBuffer, alpha->getImage(), VK_IMAGE_LAYOUT_GENERAL,
+					cloudDisplayAlpha->getImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+			}
+		});
+	}
+
+	if ((ENABLE_SCENE_PROPS))
+	{
+		// touches no images, MeshRegistry::recordCulling orders the draw buffer itself
+		renderGraph.addPass("cullProps", RenderGraphQueue::Offscreen, {}, [this](VkCommandBuffer commandBuffer, uint32_t) {
+			cullShader->bindShader(commandBuffer);
+			sceneProps->recordCulling(commandBuffer);
+		});
+	}
+
+	std::vector<std::pair<RenderGraphResource, ImageUsage>> sceneUses = { { scene, ImageUsage::ColorAttachment }, { clouds, ImageUsage::SampledFragment } };
+	if ((ENABLE_FUSED_POST))
+	{
+		sceneUses.insert(sceneUses.end(), meshUses.begin(), meshUses.end());
+	}
+	renderGraph.addPass("scene", RenderGraphQueue::Offscreen, sceneUses, [this](VkCommandBuffer commandBuffer, uint32_t) {
+		beginOffscreenRenderPass(commandBuffer, "scene");
+
+		// Draw Background
+		backgroundShader->bindShader(commandBuffer);
+		backgroundGeometry->enqueueDrawCommands(commandBuffer);
+
+		if ((ENABLE_FUSED_POST))
+		{
+			// Scene goes straight over the sky, the composite pass leaves it out of the shaft blur
+			meshShader->bindShader(commandBuffer);
+			drawScene(commandBuffer);
+		}
+
+		vkCmdEndRenderPass(commandBuffer);
+	});
+
+	if ((ENABLE_FUSED_POST))
+	{
+		RenderGraphResource shafts = renderGraph.importImage("shafts", { lightShaftTexture->getImage() }, VK_IMAGE_LAYOUT_GENERAL);
+
+		renderGraph.addPass("lightShafts", RenderGraphQueue::Offscreen, { { scene, ImageUsage::SampledCompute }, { shafts, ImageUsage::StorageWrite } }, [this](VkCommandBuffer commandBuffer, uint32_t) {
+			recordLightShaftPass(commandBuffer);
+		});
+
+		renderGraph.addPass("composite", RenderGraphQueue::Present, { { scene, ImageUsage::SampledFragment }, { shafts, ImageUsage::SampledFragment } }, [this](VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+			beginSwapchainRenderPass(commandBuffer, imageIndex);
+			compositeShader->bindShader(commandBuffer);
+			backgroundGeometry->enqueueDrawCommands(commandBuffer);
+			vkCmdEndRenderPass(commandBuffer);
+		});
+		return;
+	}
+
+	// The scene target is dead once the god rays have read it, so the radial blur output reuses its memory
+	RenderGraphResource godRays = renderGraph.createTransient("godRays");
+	RenderGraphResource blurred = renderGraph.createTransient("blurred");
+
+	renderGraph.addPass("godRays", RenderGraphQueue::Offscreen, { { godRays, ImageUsage::ColorAttachment }, { scene, ImageUsage::SampledFragment } }, [this](VkCommandBuffer commandBuffer, uint32_t) {
+		beginOffscreenRenderPass(commandBuffer, "godRays");
+		godRayShader->bindShader(commandBuffer);
+		backgroundGeometry->enqueueDrawCommands(commandBuffer);
+		vkCmdEndRenderPass(commandBuffer);
+	});
+
+	std::vector<std::pair<RenderGraphResource, ImageUsage>> blurUses = { { blurred, ImageUsage::ColorAttachment }, { godRays, ImageUsage::SampledFragment } };
+	blurUses.insert(blurUses.end(), meshUses.begin(), meshUses.end());
+	renderGraph.addPass("radialBlur", RenderGraphQueue::Offscreen, blurUses, [this](VkCommandBuffer commandBuffer, uint32_t) {
+		beginOffscreenRenderPass(commandBuffer, "blurred");
+
+		radialBlurShader->bindShader(commandBuffer);
+		backgroundGeometry->enqueueDrawCommands(commandBuffer);
+
+		// Draw Scene
+		meshShader->bindShader(commandBuffer);
+		drawScene(commandBuffer);
+
+		vkCmdEndRenderPass(commandBuffer);
+	});
+
+	renderGraph.addPass("tonemap", RenderGraphQueue::Present, { { blurred, ImageUsage::SampledFragment } }, [this](VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+		beginSwapchainRenderPass(commandBuffer, imageIndex);
+		toneMapShader->bindShader(commandBuffer);
+		backgroundGeometry->enqueueDrawCommands(commandBuffer);
+		vkCmdEndRenderPass(commandBuffer);
+	});
+}
+
 void VulkanApplication::setupOffscreenPass() {
 	offscreenPass.width = WIDTH;
 	offscreenPass.height = HEIGHT;
@@ -1957,10 +3422,28 @@ void VulkanApplication::setupOffscreenPass() {
 		throw std::runtime_error("failed to create sampler!");
 	}
 
-	// Create offscreen frame buffers - note the image format, they are HDR
-	createOffscreenFramebuffer(&offscreenPass.framebuffers[0], VK_FORMAT_R32G32B32A32_SFLOAT, fbDepthFormat);
-	createOffscreenFramebuffer(&offscreenPass.framebuffers[1], VK_FORMAT_R32G32B32A32_SFLOAT, fbDepthFormat);
-	createOffscreenFramebuffer(&offscreenPass.framebuffers[2], VK_FORMAT_R32G32B32A32_SFLOAT, fbDepthFormat);
+	// Create offscreen frame buffers - note the image format, they are HDR. The render graph decides which targets
+	// exist and which of them share memory.
+	buildRenderGraph();
+
+	const std::vector<RenderGraphResource>& targets = renderGraph.getTransients();
+	std::vector<uint32_t> blockOf = renderGraph.planAliasing();
+	for (RenderGraphResource target : targets) {
+		FrameBuffer& framebuffer = offscreenPass.framebuffers[renderGraph.getName(target)];
+		framebuffer.color.image = createAttachmentImage(VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+			{ static_cast<uint32_t>(WIDTH), static_cast<uint32_t>(HEIGHT) });
+		renderGraph.setImage(target, framebuffer.color.image);
+	}
+	allocateOffscreenTargets(blockOf);
+	createOffscreenDepth(fbDepthFormat);
+	for (auto& framebuffer : offscreenPass.framebuffers) {
+		createOffscreenFramebuffer(&framebuffer.second);
+	}
+
+	renderGraph.compile();
+	renderGraph.print();
+
+	reportOffscreenMemory(VK_FORMAT_R32G32B32A32_SFLOAT, fbDepthFormat, targets.size(), offscreenPass.colorMemory.size());
 }
 
 void VulkanApplication::createSwapChain() {
@@ -22,12 +22,22 @@
 #include <fstream>
 #include <array>
 #include <chrono>
+#include <map>
+#include <functional>
+#include <mutex>
 
 #include "camera.h"
 #include "Texture.h"
 #include "Geometry.h"
+#include "Terrain.h"
+#include "MeshRegistry.h"
 #include "Shader.h"
 #include "RendererManager.h"
+#include "RenderGraph.h"
+#include "JobSystem.h"
+#include "TextureCache.h"
+#include "MemoryReport.h"
+#include "DescriptorHeap.h"
 
 #define DEBUG_VALIDATION 1
 
@@ -35,10 +45,58 @@
 
 //enable keywords
 #define ENABLE_NEW_NOISE 0 // set in compute-clouds shader at the same time
+#define ENABLE_FUSED_POST 1 // half res light shafts + one composite pass instead of god ray, radial blur and tonemap passes
+#define ENABLE_ASYNC_COMPUTE 1 // run the cloud kernels on a separate compute queue when the device has one
+#define ENABLE_GPU_NOISE 0 // generate the cloud noise volumes with noise-volume.comp at startup instead of loading them
+#define ENABLE_DYNAMIC_WEATHER 1 // evolve the cloud placement map with weather-map.comp instead of sampling CloudPlacement.png
+#define ENABLE_DENSITY_CLIPMAP 1 // the view and light samples read the low-res cloud density from a clipmap around the camera
+#define ENABLE_HEIGHTMAP_TERRAIN 1 // chunked LOD ground from tilesHeight.png instead of terrain.obj
+#define ENABLE_FAR_FIELD 1 // clouds beyond FAR_FIELD_DISTANCE come from a panorama marched a window of tiles per frame
+#define ENABLE_SCENE_PROPS 1 // a field of blocks on the ground drawn from a MeshRegistry, culled on the GPU
+
+// Weather map of ENABLE_DYNAMIC_WEATHER, evolved a window of tiles per frame
+#define WEATHER_MAP_SIZE 512
+#define WEATHER_TILE_SIZE 16 // set in weather-map.comp at the same time
+#define WEATHER_TILES_PER_FRAME 32 // all 32x32 tiles every 32 frames
+#define WEATHER_DRIFT 0.0002f // uv per second per unit of wind, about 20m/s at the scale the clouds sample the map
+
+// Density clipmap of ENABLE_DENSITY_CLIPMAP, levels and their size are in Shader.h
+#define DENSITY_CLIPMAP_CELL_SIZE 125.0f // metres, level 0 spans 8km, level 2 128km
+#define DENSITY_CLIPMAP_REFRESH_COLUMNS 2 // of every level each frame, all of them every 32 frames
+#define CLOUD_LAYER_BOTTOM 2500.0f // heights of the atmosphere shells of compute-clouds.comp above the camera
+#define CLOUD_LAYER_TOP 12500.0f
+
+// Far field panorama of ENABLE_FAR_FIELD, octahedral, rendered by the FAR_FIELD variant of compute-clouds.comp
+#define FAR_FIELD_SIZE 1024
+#define FAR_FIELD_TILE_SIZE 16 // set in compute-clouds.comp at the same time
+#define FAR_FIELD_TILES_PER_FRAME 32 // all 64x64 tiles every 128 frames
+#define FAR_FIELD_DISTANCE 30000.0f // metres along the ray the far field starts at
+#define FAR_FIELD_BLEND 10000.0f // over which the view march fades out and the far field in
+#define FAR_FIELD_MAX_DRIFT 1000.0f // camera movement after which the panorama is started over
+
+// Ground of ENABLE_HEIGHTMAP_TERRAIN, centred on the origin. The patch size and LOD distance are in Terrain.h
+#define TERRAIN_SIZE 20480.0f // metres across, about what terrain.obj covered
+#define TERRAIN_HEIGHT 500.0f // between the darkest and the brightest texel of the heightmap
+#define TERRAIN_BASE -300.0f
+
+// Props of ENABLE_SCENE_PROPS, DisplayCube.obj blocks of random height scattered over a grid around the origin
+#define SCENE_PROP_GRID 32 // props along each side
+#define SCENE_PROP_SPACING 250.0f // metres between grid points
+#define SCENE_PROP_SIZE 40.0f // metres across, they are one to four times as tall
+
+// VRAM budget of the texture cache, unused textures are evicted least recently used first while it is over it
+#define TEXTURE_CACHE_BUDGET_MB 256
+
+// Storage format of the cloud history (backgroundTexture / backgroundTexturePrev)
+#define HISTORY_FORMAT_RGBA32F 0
+#define HISTORY_FORMAT_RGBA16F 1
+#define HISTORY_FORMAT_R11G11B10_A8 2 // colour in B10G11R11_UFLOAT, sun visibility in a separate R8 plane
+#define CLOUD_HISTORY_FORMAT HISTORY_FORMAT_RGBA16F
 
 struct QueueFamilyIndices {
     int graphicsFamily = -1; // capable of graphics pipeline?
     int computeFamily = -1; // capable of compute pipeline? TODO not sure if this is done
+    int computeQueueIndex = 0; // 1 when async compute uses the second queue of the graphics family
     int presentFamily = -1; // capable of presenting image to screen surface?
 
     bool isComplete() {
@@ -63,7 +121,7 @@ struct FrameBufferAttachment {
 
 struct FrameBuffer {
     VkFramebuffer framebuffer;
-    FrameBufferAttachment color, depth;
+    FrameBufferAttachment color; // memory may be shared with other targets, see OffscreenPass::colorMemory
     VkDescriptorImageInfo descriptor;
 };
 
@@ -74,8 +132,10 @@ struct OffscreenPass {
     std::vector<VkCommandBuffer> commandBuffers;
     // Semaphore used to synchronize between offscreen and final scene rendering
     VkSemaphore semaphore = VK_NULL_HANDLE;
-    std::array<FrameBuffer, 3> framebuffers; // the length of the array is equal to the total number of render passes - 1
-};                                           // as in everything prior to the last pass is offscreen
+    std::map<std::string, FrameBuffer> framebuffers; // one per transient target of the render graph, by name
+    FrameBufferAttachment depth = {}; // cleared and discarded every pass, so one transient image serves all framebuffers
+    std::vector<VkDeviceMemory> colorMemory; // aliased blocks backing the framebuffer colour images
+};
 
 class VulkanApplication
 {
@@ -86,7 +146,28 @@ private:
     void mainLoop();
     void cleanup();
 
+    // startup, every phase of initVulkan is timed and printed at its end
+    struct StartupPhase {
+        std::string name;
+        uint32_t thread; // JobSystem::currentThread of the thread that ran it
+        float begin, end; // ms since run
+    };
+    std::vector<StartupPhase> startupPhases;
+    std::chrono::high_resolution_clock::time_point startupBegin;
+    bool firstFrameDrawn = false;
+    float millisecondsSinceStartup() const;
+    void timeStartupPhase(const std::string& name, const std::function<void()>& phase);
+    JobHandle submitStartupPhase(const std::string& name, std::function<void()> phase, const std::vector<JobHandle>& dependencies = {});
+    void printStartupTimeline();
+    void createPipelineCache();
+    void savePipelineCache();
+
     void updateUniformBuffer();
+    void updateGraphicsUniformBuffers();
+    void placeVoxelClouds(const glm::vec3& anchor);
+    void updateWeather(float time, const glm::vec4& wind);
+    void updateDensityClipmap(const UniformSkyObject& sky, const UniformCloudRendererObject& cloudrenderer);
+    void updateFarField();
 
     GLFWwindow* window;
 
@@ -108,12 +189,12 @@ private:
 
     // --- Imgui Integration----
     void init_imgui(GLFWwindow* window, VkFormat format);
-    void draw_imgui();
+    void draw_imgui(uint32_t imageIndex);
     void initImguiFrameBuffer();
     void createCommandPool(VkCommandPool* commandPool, VkCommandPoolCreateFlags flags);
     void createCommandBuffers(VkCommandBuffer* commandBuffer, uint32_t commandBufferCount, VkCommandPool& commandPool);
     void CreateImguiSemaphore(VkSemaphore* semaphore);
-    VkSubmitInfo ImguiQueueSubmit(VkSemaphore* waitSemaphore);
+    VkSubmitInfo ImguiQueueSubmit(VkSemaphore* waitSemaphore, uint32_t imageIndex);
     void DestroyImguiFrameBuffer();
     void Cleanup_imgui();
     //draw ui panel 
@@ -121,11 +202,19 @@ private:
     void ShowModelingPanel(bool* enable);
     void ShowLightingPanel(bool* enable);
     void ShowRenderingPanel(bool* enable);
+    void ShowGpuTimeline();
+    void ShowJobStats();
+    void ShowMemoryReport();
 
     /// --- Graphics Pipeline
     void createRenderPass(); // <------ ech
     void createFramebuffers();
-    void createOffscreenFramebuffer(FrameBuffer* frameBuf, VkFormat colorFormat, VkFormat depthFormat);
+    void createOffscreenFramebuffer(FrameBuffer* frameBuf);
+    VkImage createAttachmentImage(VkFormat format, VkImageUsageFlags usage, VkExtent2D extent);
+    VkImageView createAttachmentView(VkImage image, VkFormat format, VkImageAspectFlags aspect);
+    void createOffscreenDepth(VkFormat depthFormat);
+    void allocateOffscreenTargets(const std::vector<uint32_t>& blockOf);
+    void reportOffscreenMemory(VkFormat colorFormat, VkFormat depthFormat, size_t targetCount, size_t blockCount);
     void createCommandPool();
     void createCommandBuffers();
     void createPostProcessCommandBuffer();
@@ -133,7 +222,7 @@ private:
 
     //timeStamp query func
     void CreateQueryPool();
-    void FetchRenderTimeResults(uint32_t swapchainIndex);
+    void FetchRenderTimeResults(RenderGraphQueue queue);
 
     // command buffer helpers
     VkCommandBuffer beginSingleTimeCommands();
@@ -141,14 +230,30 @@ private:
 
     /// --- Compute Pipeline
     void createComputeCommandBuffer(); // TODO: rename this to be plural if we end up needing more compute shaders
+    // variant: ping-pong index. Idle once computeFence is signalled, drawFrame records the one it submits again.
+    void recordComputeCommandBuffer(uint32_t variant);
 
     void drawFrame();
     VkSemaphore imageAvailableSemaphore;
     VkSemaphore renderFinishedSemaphore;
+    std::vector<VkSemaphore> queueEdgeSemaphores; // one per renderGraph.getQueueEdges()
+    VkFence computeFence; // the compute and graphics halves of the last frame, before their uniforms are rewritten
+    VkFence graphicsFence;
+    uint64_t frameCount = 0;
     void createSemaphores();
     
     /// Post
     void setupOffscreenPass();
+    void buildRenderGraph();
+    void beginOffscreenRenderPass(VkCommandBuffer commandBuffer, const std::string& target);
+    void beginSwapchainRenderPass(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+    void recordLightShaftPass(VkCommandBuffer commandBuffer);
+    RenderGraph renderGraph;
+
+    /// Cloud history precision
+    static std::string historyShaderPath(const std::string& path);
+    void measureHistoryPrecision();
+    std::string historyPrecisionReport;
 
     /// --- Swap Chain Setup Functions
     void createSwapChain();
@@ -197,6 +302,8 @@ private:
     VkQueue graphicsQueue;
     VkQueue computeQueue;
     VkQueue presentQueue;
+    bool asyncCompute = false; // computeQueue is a different queue than graphicsQueue
+    bool memoryBudget = false; // VK_EXT_memory_budget is enabled on the device, see QueryMemoryReport
 
     // these can likely be moved to their own class
     VkSwapchainKHR swapChain;
@@ -225,17 +332,28 @@ private:
     VkCommandPool computeCommandPool;
 
     //time stamp query
-    //VkQueryPool mTimeQueryPool;
-    //std::vector<uint64_t> mTimeQueryResults;
+    VkQueryPool mTimeQueryPool = VK_NULL_HANDLE;
+    std::vector<uint64_t> mTimeQueryResults; // begin and end tick of every render graph pass
+    std::vector<uint64_t> timelineResults; // compute of a frame next to the graphics of the frame before
+    float timestampPeriod = 1.0f;
 
     void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
 
     Geometry* sceneGeometry;
     Geometry* backgroundGeometry;
+    Terrain* terrain = nullptr; // ENABLE_HEIGHTMAP_TERRAIN, drawn in place of sceneGeometry
+    MeshRegistry* sceneProps = nullptr; // ENABLE_SCENE_PROPS
     void initializeGeometry();
+    void drawScene(VkCommandBuffer commandBuffer);
     void cleanupGeometry();
 
     // TODO: convenient way of managing textures
+    void decodeAssets();
+    TextureCache* textureCache = nullptr; // owns the textures from files and the noise volumes
+    DescriptorHeap* descriptorHeap = nullptr; // sampled images of the cloud kernel
+    JobHandle textureDecodes; // the files of initializeTextures, from decodeAssets
+    JobHandle meshDecodes;    // and of initializeGeometry
+    BrickPool voxelCloudPool; // until initializeTextures uploads it
     void initializeTextures();
     void cleanupTextures();
     Texture* meshTexture;
@@ -243,17 +361,51 @@ private:
     Texture* meshNormals;
     Texture* backgroundTexture;
     Texture* backgroundTexturePrev;
+    Texture* backgroundAlpha = nullptr; // HISTORY_FORMAT_R11G11B10_A8 only
+    Texture* backgroundAlphaPrev = nullptr;
+    Texture* cloudDisplayTexture = nullptr; // async compute only, copy of the history the graphics queue samples
+    Texture* cloudDisplayAlpha = nullptr;
     Texture* depthTexture;
     Texture* cloudPlacementTexture;
     Texture* nightSkyTexture;
     Texture* cloudCurlNoise;
     Texture* cloudCirroNoise;
-    Texture3D* lowResCloudShapeTexture3D;
-    Texture3D* SDFCloudShapeTexture3D_01;
-    Texture3D* SDFCloudShapeTexture3D_02;
-    Texture3D* hiResCloudShapeTexture3D;
-
-    void initializeShaders();
+    Texture3D* lowResCloudShapeTexture3D = nullptr;
+    Texture3D* voxelBrickAtlas;       // resident bricks of every voxel cloud
+    std::vector<Texture3D*> voxelBrickIndirections; // grid of brick entries of each cloud
+    std::vector<uint32_t> voxelCloudHandles;        // of the grids in descriptorHeap, VoxelCloudInstance.volume
+    Texture3D* hiResCloudShapeTexture3D = nullptr;
+    Texture* lightShaftTexture = nullptr;
+
+    // ENABLE_DYNAMIC_WEATHER: ping-ponged weather maps, weatherShader writes a window of tiles of one per frame
+    Texture* weatherMaps[2] = { nullptr, nullptr };
+    Texture* weatherDisplay = nullptr; // async compute only, copy of the current map the graphics queue samples
+    uint32_t weatherTile = 0; // first tile of the window of this frame
+    std::vector<float> weatherWindowTimes; // when each window was last evolved
+    glm::vec2 weatherWindOffset = glm::vec2(0.0f);
+
+    // ENABLE_DENSITY_CLIPMAP: one volume per level, written by the CLIPMAP_UPDATE variant of compute-clouds.comp
+    std::array<Texture3D*, DENSITY_CLIPMAP_LEVELS> densityClipmap = {};
+    glm::ivec4 densityClipmapOrigins[DENSITY_CLIPMAP_LEVELS];
+    bool densityClipmapValid = false; // cleared to evaluate every texel on the next update
+    uint32_t densityClipmapFrame = 0;
+
+    // ENABLE_FAR_FIELD: the view march only samples the panorama once every tile has been rendered since the camera was at farFieldOrigin
+    Texture* farFieldPanorama = nullptr;
+    glm::vec3 farFieldOrigin = glm::vec3(0.0f);
+    uint32_t farFieldTile = 0; // first tile of the window of this frame
+    bool farFieldComplete = false;
+
+    // ENABLE_GPU_NOISE: the noise volumes at the sizes of a quality tier, regenerated when the tier changes
+    NoiseShader* noiseShader = nullptr;
+    int noiseQuality = 1;
+    int pendingNoiseQuality = 1; // set by the rendering panel, applied between frames
+    float noiseMilliseconds = 0.0f;
+    float noiseGpuMilliseconds = 0.0f;
+    void generateCloudNoise();
+    void regenerateCloudNoise();
+
+    void initializeShaders(const JobHandle& geometry);
     void cleanupShaders();
     MeshShader* meshShader;
     BackgroundShader* backgroundShader;
@@ -262,6 +414,10 @@ private:
     PostProcessShader* toneMapShader;
     PostProcessShader* godRayShader;
     PostProcessShader* radialBlurShader;
+    LightShaftShader* lightShaftShader = nullptr;
+    CompositeShader* compositeShader = nullptr;
+    WeatherShader* weatherShader = nullptr;
+    CullShader* cullShader = nullptr; // ENABLE_SCENE_PROPS
 
     /// Post
     OffscreenPass offscreenPass;
@@ -278,7 +434,9 @@ private:
 #endif
 
     const std::vector<const char*> deviceExtensions = {
-        VK_KHR_SWAPCHAIN_EXTENSION_NAME
+        VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+        VK_KHR_MAINTENANCE3_EXTENSION_NAME, // required by descriptor indexing
+        VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME // DescriptorHeap
     };
 
     /// --- Window interaction / functionality
@@ -286,8 +444,31 @@ private:
     void processInputs();
     float deltaTime;
     float prevTime;
+
+    // written by updateUniformBuffer, uploaded once the graphics queue is done with the frame before
+    UniformCameraObject frameCamera;
+    UniformModelObject frameModel;
+    UniformSkyObject frameSky;
+    UniformSunObject frameSun;
+
+    // voxel cloud instances, binned around the camera every frame
+    VoxelCloudScene voxelCloudScene;
+    VoxelCloudSceneObject voxelCloudSceneObject;
+
+    // per-frame CPU work and asset loading, the main thread records and submits and only waits on the results
+    JobSystem* jobs = nullptr;
+    JobHandle terrainJob;
+    JobHandle voxelCloudJob;
+    std::vector<JobWorkerStats> jobStats; // of the last second, refreshed by ShowJobStats
+    float jobStatsTime = 0.0f;
+    MemoryReport memoryReport; // refreshed by ShowMemoryReport once a second
+    float memoryReportTime = 0.0f;
 public:
+    static void packAssets();
+    static void bakeVolumeSDF(const std::string& path, uint32_t depth, float threshold);
+    static void bakeNoise(const std::string& name, uint32_t size, uint32_t seed);
     void run() {
+        startupBegin = std::chrono::high_resolution_clock::now();
         initWindow();
         initVulkan();
         mainLoop();
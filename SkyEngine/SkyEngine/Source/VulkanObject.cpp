@@ -45,7 +45,28 @@ void VulkanObject::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkM
     allocInfo.allocationSize = memRequirements.size;
     allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
 
-    if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
+    // listed in the memory report by what the usage says the buffer is for
+    MemoryCategory category = MemoryCategory::Buffer;
+    const char* name = "storage buffer";
+    if (usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT) {
+        category = MemoryCategory::UniformBuffer;
+        name = "uniform buffer";
+    }
+    else if ((usage & ~(VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT)) == 0) {
+        category = MemoryCategory::Staging;
+        name = (usage & VK_BUFFER_USAGE_TRANSFER_DST_BIT) ? "readback buffer" : "staging buffer";
+    }
+    else if (usage & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT) {
+        name = "vertex buffer";
+    }
+    else if (usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT) {
+        name = "index buffer";
+    }
+    else if (usage & VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT) {
+        name = "indirect buffer";
+    }
+
+    if (AllocateTrackedMemory(device, allocInfo, bufferMemory, category, name) != VK_SUCCESS) {
         throw std::runtime_error("failed to allocate buffer memory!");
     }
 
@@ -1,6 +1,7 @@
 #pragma once
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
+#include "MemoryReport.h"
 #include <iostream>
 #include <vector>
 #include <array>
@@ -1,7 +1,38 @@
 #pragma once
 #include "VulkanApplication.h"
 
-int main() {
+int main(int argc, char** argv) {
+    if (argc > 1 && std::string(argv[1]) == "--pack-assets") {
+        try {
+            VulkanApplication::packAssets();
+        }
+        catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+    if (argc > 3 && std::string(argv[1]) == "--bake-sdf") {
+        try {
+            VulkanApplication::bakeVolumeSDF(argv[2], static_cast<uint32_t>(std::stoul(argv[3])), argc > 4 ? std::stof(argv[4]) : 0.5f);
+        }
+        catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+    if (argc > 3 && std::string(argv[1]) == "--bake-noise") {
+        try {
+            VulkanApplication::bakeNoise(argv[2], static_cast<uint32_t>(std::stoul(argv[3])), argc > 4 ? static_cast<uint32_t>(std::stoul(argv[4])) : 0u);
+        }
+        catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
     VulkanApplication app = VulkanApplication();
 
     // remove this pls